@@ -0,0 +1,398 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <locale.h>
+
+#include "table.h"
+#include "dump.h"
+#include "table_pack.h"
+#include "table_extsort.h"
+#include "csv.h"
+#include "table_trgm.h"
+#include "collate.h"
+#include "gen.h"
+#include "clock.h"
+
+/*
+ * bench [--rows N] [--c3-card N] [--c5-card N] [--c1-dist D] [--c2-dist D]
+ *       [--seed N] [--repeat N] [--out FILE]
+ * D is one of uniform, normal, skewed
+ * writes json with ns/row and MB/s for every measured operation
+ * each figure is the best of --repeat runs
+ */
+
+typedef struct {
+	size_t rows;
+	size_t repeat;
+	uint64_t seed;
+	gen_params_t gen;
+	char const *out_path;
+} bench_config_t;
+
+typedef struct {
+	FILE *out;
+	int first;
+} bench_json_t;
+
+#define COLUMN_NAME(a, name, tag, kind, len, charset) [tag] = #name,
+static char const *const column_names[] = { TABLE_SCHEMA(COLUMN_NAME, _) };
+static char const *const condition_names[] = { "eq", "neq", "lt", "gt", "le", "ge", "btw", "contains", "prefix" };
+static volatile size_t sink;
+
+static void emit(bench_json_t *json, char const *op, column_t const *column, char const *variant,
+	size_t rows, size_t bytes, uint64_t ns) {
+	double ns_per_row = rows ? (double) ns / (double) rows : 0.0;
+	double mb_per_s = ns ? (double) bytes / (1024.0 * 1024.0) / ((double) ns / 1e9) : 0.0;
+	fprintf(json->out, "%s\n    {\"op\": \"%s\"", json->first ? "" : ",", op);
+	if (column != NULL) fprintf(json->out, ", \"column\": \"%s\"", column_names[*column]);
+	if (variant != NULL) fprintf(json->out, ", \"variant\": \"%s\"", variant);
+	fprintf(json->out, ", \"rows\": %zu, \"bytes\": %zu, \"ns\": %llu"
+		", \"ns_per_row\": %.3f, \"mb_per_s\": %.3f}",
+		rows, bytes, (unsigned long long) ns, ns_per_row, mb_per_s);
+	json->first = 0;
+}
+
+static table_t *build_table(bench_config_t const *cfg, uint64_t *out_ns, uint64_t *out_batch_ns) {
+	gen_t gen;
+	gen_init(&gen, cfg->gen, cfg->seed);
+	dbrow_t *rows = malloc(sizeof(dbrow_t) * cfg->rows);
+	if (rows == NULL) return NULL;
+	for (size_t i = 0; i < cfg->rows; i++) gen_row(&gen, i + 1, &rows[i]);
+	table_t *table = table_new(16);
+	if (table == NULL) goto no_table;
+	uint64_t start = clock_ns();
+	for (size_t i = 0; i < cfg->rows; i++) {
+		if (table_append(table, rows[i]) == 0) goto no_append;
+	}
+	*out_ns = clock_ns() - start;
+	table->next_id = cfg->rows + 1;
+	table_t *batch = table_new(16);
+	if (batch == NULL) goto no_append;
+	start = clock_ns();
+	int ok = table_reserve(batch, cfg->rows) && table_append_batch(batch, rows, cfg->rows);
+	*out_batch_ns = clock_ns() - start;
+	table_free(batch);
+	if (!ok) goto no_append;
+	free(rows);
+	return table;
+no_append:
+	table_free(table);
+no_table:
+	free(rows);
+	return NULL;
+}
+
+// operands between two existing values, in the column's order
+#define OPERAND_CASE(a, name, tag, kind, len, charset) case tag: OPERAND_##kind(name, len) break;
+#define OPERAND_UINT(name, len) \
+	findspec.data1.name = r1->name < r2->name ? r1->name : r2->name; \
+	findspec.data2.name = r1->name < r2->name ? r2->name : r1->name;
+#define OPERAND_INT(name, len) OPERAND_UINT(name, len)
+#define OPERAND_FLOAT(name, len) OPERAND_UINT(name, len)
+#define OPERAND_BOOL(name, len) findspec.data1.name = r1->name;
+#define OPERAND_STR(name, len) \
+	if (collate_cmp(r1->name, r2->name, len) > 0) { dbrow_t const *t = r1; r1 = r2; r2 = t; } \
+	wcscpy(findspec.data1.name, r1->name); \
+	wcscpy(findspec.data2.name, r2->name); \
+	needle = findspec.data1.name;
+
+static table_find_t make_findspec(table_t const *table, gen_t *gen, column_t column,
+	condition_t condition) {
+	table_find_t findspec = {.column = column, .condition = condition};
+	dbrow_t const *r1 = &table->rows[gen_next(gen) % table->len];
+	dbrow_t const *r2 = &table->rows[gen_next(gen) % table->len];
+	wchar_t *needle = NULL;
+	switch (column) {
+	default: break;
+	TABLE_SCHEMA(OPERAND_CASE, _)
+	}
+	if (needle != NULL && (condition == C_CONTAINS || condition == C_PREFIX)) {
+		// a few characters from the middle or the start of an existing value
+		size_t len = wcslen(needle), from = condition == C_CONTAINS && len > 6 ? len / 2 - 2 : 0;
+		size_t n = condition == C_CONTAINS ? 4 : 3;
+		if (from + n < len) {
+			wmemmove(needle, needle + from, n);
+			needle[n] = L'\0';
+		}
+	}
+	return findspec;
+}
+
+// best time to walk all matches with table_find_first
+static uint64_t measure_find(bench_config_t const *cfg, table_t const *table, table_find_t findspec) {
+	uint64_t best = UINT64_MAX;
+	for (size_t r = 0; r < cfg->repeat; r++) {
+		size_t matches = 0, idx;
+		findspec.start_pos = 0;
+		uint64_t start = clock_ns();
+		while (table_find_first(table, findspec, &idx)) {
+			matches++;
+			findspec.start_pos = idx + 1;
+		}
+		uint64_t ns = clock_ns() - start;
+		sink += matches;
+		if (ns < best) best = ns;
+	}
+	return best;
+}
+
+static void bench_find(bench_json_t *json, bench_config_t const *cfg, table_t const *table) {
+	gen_t gen;
+	gen_init(&gen, cfg->gen, cfg->seed ^ 0xF1);
+	for (column_t column = TC_ID; column < TABLE_NCOLUMNS; column++) {
+		for (condition_t condition = C_EQ; condition <= C_PREFIX; condition++) {
+			if (!table_find_valid(&(table_find_t) {.column = column, .condition = condition})) continue;
+			table_find_t findspec = make_findspec(table, &gen, column, condition);
+			emit(json, "table_find_first", &column, condition_names[condition],
+				table->len, table->len * sizeof(dbrow_t), measure_find(cfg, table, findspec));
+		}
+	}
+}
+
+static void bench_trgm(bench_json_t *json, bench_config_t const *cfg, table_t *table) {
+	static char const *const variants[] = { [C_CONTAINS] = "contains+trgm", [C_PREFIX] = "prefix+trgm" };
+	gen_t gen;
+	gen_init(&gen, cfg->gen, cfg->seed ^ 0xF1);
+	for (column_t column = TC_ID; column < TABLE_NCOLUMNS; column++) {
+		if (!table_trgm_column(column)) continue;
+		uint64_t start = clock_ns();
+		if (!table_trgm_add(table, column)) return;
+		emit(json, "trgm_build", &column, NULL, table->len, table->len * sizeof(dbrow_t), clock_ns() - start);
+		for (condition_t condition = C_CONTAINS; condition <= C_PREFIX; condition++) {
+			table_find_t findspec = make_findspec(table, &gen, column, condition);
+			emit(json, "table_find_first", &column, variants[condition],
+				table->len, table->len * sizeof(dbrow_t), measure_find(cfg, table, findspec));
+		}
+		table_trgm_drop(table, column);
+	}
+}
+
+static void bench_sort(bench_json_t *json, bench_config_t const *cfg, table_t const *table) {
+	for (column_t column = TC_ID; column < TABLE_NCOLUMNS; column++) {
+		for (sort_dir_t dir = S_ASC; dir <= S_DESC; dir++) {
+			table_sort_t sortspec = {.column = column, .direction = dir};
+			uint64_t best = UINT64_MAX;
+			for (size_t r = 0; r < cfg->repeat; r++) {
+				dbrow_t *sorted = NULL;
+				uint64_t start = clock_ns();
+				int ok = table_sort(table, sortspec, &sorted);
+				uint64_t ns = clock_ns() - start;
+				if (!ok) return;
+				sink += sorted[0].id;
+				free(sorted);
+				if (ns < best) best = ns;
+			}
+			emit(json, "table_sort", &column, dir == S_ASC ? "asc" : "desc",
+				table->len, table->len * sizeof(dbrow_t), best);
+		}
+	}
+}
+
+static int count_rows(void *ctx, dbrow_t const *rows, size_t n) {
+	(void) ctx;
+	sink += rows[0].id + n;
+	return 1;
+}
+
+// budget of an eighth of the table, so runs are spilled and merged
+static void bench_extsort(bench_json_t *json, bench_config_t const *cfg, table_t const *table) {
+	size_t budget = table->len * sizeof(dbrow_t) / 8;
+	column_t const columns[] = {TC_C1, TC_C3};
+	for (size_t c = 0; c < sizeof(columns) / sizeof(columns[0]); c++) {
+		table_sort_t sortspec = {.column = columns[c], .direction = S_ASC};
+		uint64_t best = UINT64_MAX;
+		for (size_t r = 0; r < cfg->repeat; r++) {
+			uint64_t start = clock_ns();
+			int ok = table_extsort(table, sortspec, budget, NULL, count_rows, NULL);
+			uint64_t ns = clock_ns() - start;
+			if (!ok) return;
+			if (ns < best) best = ns;
+		}
+		emit(json, "table_extsort", &columns[c], "asc", table->len, table->len * sizeof(dbrow_t), best);
+	}
+}
+
+static void bench_remove(bench_json_t *json, bench_config_t const *cfg, table_t const *table) {
+	size_t ops = table->len / 2 < 100 ? table->len / 2 : 100;
+	uint64_t best = UINT64_MAX;
+	size_t moved = 0;
+	for (size_t r = 0; r < cfg->repeat; r++) {
+		table_t *copy = table_new(table->len);
+		if (copy == NULL) return;
+		memcpy(copy->rows, table->rows, sizeof(dbrow_t) * table->len);
+		copy->len = table->len;
+		gen_t gen;
+		gen_init(&gen, cfg->gen, cfg->seed ^ 0xDE1);
+		moved = 0;
+		uint64_t start = clock_ns();
+		for (size_t i = 0; i < ops; i++) {
+			size_t pos = gen_next(&gen) % copy->len;
+			moved += copy->len - pos - 1;
+			table_remove_at(copy, pos);
+		}
+		uint64_t ns = clock_ns() - start;
+		table_free(copy);
+		if (ns < best) best = ns;
+	}
+	emit(json, "table_remove_at", NULL, NULL, moved, moved * sizeof(dbrow_t), best);
+}
+
+static void bench_dump(bench_json_t *json, bench_config_t const *cfg, table_t const *table) {
+	uint64_t best_save = UINT64_MAX, best_load = UINT64_MAX;
+	long bytes = 0;
+	wchar_t line[MAX_LINE_SIZE] = {0};
+	for (size_t r = 0; r < cfg->repeat; r++) {
+		FILE *f = tmpfile();
+		if (f == NULL) return;
+		fwide(f, 1);
+		uint64_t start = clock_ns();
+		print_table(f, NULL, table, 1);
+		fflush(f);
+		uint64_t ns = clock_ns() - start;
+		if (ns < best_save) best_save = ns;
+		bytes = ftell(f);
+		rewind(f);
+		table_t *loaded = NULL;
+		start = clock_ns();
+		int ok = load_table(f, stderr, &loaded, line);
+		ns = clock_ns() - start;
+		fclose(f);
+		if (!ok) return;
+		sink += loaded->len;
+		table_free(loaded);
+		if (ns < best_load) best_load = ns;
+	}
+	emit(json, "dump_save", NULL, NULL, table->len, (size_t) bytes, best_save);
+	emit(json, "dump_load", NULL, NULL, table->len, (size_t) bytes, best_load);
+}
+
+static void bench_pack(bench_json_t *json, bench_config_t const *cfg, table_t const *table) {
+	uint64_t best_save = UINT64_MAX, best_load = UINT64_MAX;
+	long bytes = 0;
+	for (size_t r = 0; r < cfg->repeat; r++) {
+		FILE *f = tmpfile();
+		if (f == NULL) return;
+		uint64_t start = clock_ns();
+		int ok = table_pack(f, table);
+		uint64_t ns = clock_ns() - start;
+		if (!ok) {
+			fclose(f);
+			return;
+		}
+		if (ns < best_save) best_save = ns;
+		bytes = ftell(f);
+		rewind(f);
+		table_t *loaded = NULL;
+		start = clock_ns();
+		ok = table_unpack(f, &loaded, 0);
+		ns = clock_ns() - start;
+		fclose(f);
+		if (!ok) return;
+		sink += loaded->len;
+		table_free(loaded);
+		if (ns < best_load) best_load = ns;
+	}
+	emit(json, "pack_save", NULL, NULL, table->len, (size_t) bytes, best_save);
+	emit(json, "pack_load", NULL, NULL, table->len, (size_t) bytes, best_load);
+}
+
+static void bench_csv(bench_json_t *json, bench_config_t const *cfg, table_t const *table) {
+	uint64_t best_save = UINT64_MAX, best_load = UINT64_MAX;
+	long bytes = 0;
+	for (size_t r = 0; r < cfg->repeat; r++) {
+		FILE *f = tmpfile();
+		if (f == NULL) return;
+		uint64_t start = clock_ns();
+		int ok = csv_export(f, table, ',', 0);
+		uint64_t ns = clock_ns() - start;
+		if (!ok) {
+			fclose(f);
+			return;
+		}
+		if (ns < best_save) best_save = ns;
+		bytes = ftell(f);
+		rewind(f);
+		table_t *loaded = NULL;
+		start = clock_ns();
+		ok = csv_import(f, stderr, ',', 0, &loaded);
+		ns = clock_ns() - start;
+		fclose(f);
+		if (!ok) return;
+		sink += loaded->len;
+		table_free(loaded);
+		if (ns < best_load) best_load = ns;
+	}
+	emit(json, "csv_save", NULL, NULL, table->len, (size_t) bytes, best_save);
+	emit(json, "csv_load", NULL, NULL, table->len, (size_t) bytes, best_load);
+}
+
+static int parse_args(int argc, char *argv[], bench_config_t *cfg) {
+	for (int i = 1; i < argc; i++) {
+		char const *arg = argv[i];
+		char const *val = i + 1 < argc ? argv[i + 1] : NULL;
+		if (val == NULL) goto bad_arg;
+		if (strcmp(arg, "--rows") == 0) { cfg->rows = strtoull(val, NULL, 10); }
+		else if (strcmp(arg, "--c3-card") == 0) { cfg->gen.c3_card = strtoull(val, NULL, 10); }
+		else if (strcmp(arg, "--c5-card") == 0) { cfg->gen.c5_card = strtoull(val, NULL, 10); }
+		else if (strcmp(arg, "--c1-dist") == 0) { if (!gen_parse_dist(val, &cfg->gen.c1_dist)) goto bad_arg; }
+		else if (strcmp(arg, "--c2-dist") == 0) { if (!gen_parse_dist(val, &cfg->gen.c2_dist)) goto bad_arg; }
+		else if (strcmp(arg, "--seed") == 0) { cfg->seed = strtoull(val, NULL, 10); }
+		else if (strcmp(arg, "--repeat") == 0) { cfg->repeat = strtoull(val, NULL, 10); }
+		else if (strcmp(arg, "--out") == 0) { cfg->out_path = val; }
+		else { goto bad_arg; }
+		i++;
+	}
+	if (cfg->rows < 2 || cfg->repeat == 0) goto bad_arg;
+	return 1;
+bad_arg:
+	fprintf(stderr, "usage: %s [--rows N] [--c3-card N] [--c5-card N] [--c1-dist D] [--c2-dist D]"
+		" [--seed N] [--repeat N] [--out FILE]\n"
+		"D is one of uniform, normal, skewed\n", argv[0]);
+	return 0;
+}
+
+int main(int argc, char *argv[]) {
+	// generated strings contain cyrillic, dump needs utf-8 ctype
+	if (setlocale(LC_ALL, "ru_RU.utf8") == NULL) setlocale(LC_ALL, "C.UTF-8");
+	setlocale(LC_NUMERIC, "C");
+	bench_config_t cfg = {
+		.rows = 100000,
+		.repeat = 3,
+		.seed = 42,
+		.gen = gen_default_params(),
+		.out_path = NULL,
+	};
+	if (!parse_args(argc, argv, &cfg)) return EXIT_FAILURE;
+	FILE *out = cfg.out_path != NULL ? fopen(cfg.out_path, "w") : stdout;
+	if (out == NULL) {
+		fprintf(stderr, "Cannot open '%s'\n", cfg.out_path);
+		return EXIT_FAILURE;
+	}
+	uint64_t append_ns, batch_ns;
+	table_t *table = build_table(&cfg, &append_ns, &batch_ns);
+	if (table == NULL) {
+		fprintf(stderr, "Cannot build table of %zu rows\n", cfg.rows);
+		return EXIT_FAILURE;
+	}
+	bench_json_t json = {.out = out, .first = 1};
+	fprintf(out, "{\n  \"config\": {\"rows\": %zu, \"row_size\": %zu, \"repeat\": %zu, \"seed\": %llu"
+		", \"c3_card\": %zu, \"c5_card\": %zu, \"c1_dist\": \"%s\", \"c2_dist\": \"%s\"},\n"
+		"  \"results\": [",
+		cfg.rows, sizeof(dbrow_t), cfg.repeat, (unsigned long long) cfg.seed,
+		cfg.gen.c3_card, cfg.gen.c5_card,
+		gen_dist_name(cfg.gen.c1_dist), gen_dist_name(cfg.gen.c2_dist));
+	emit(&json, "table_append", NULL, NULL, table->len, table->len * sizeof(dbrow_t), append_ns);
+	emit(&json, "table_append_batch", NULL, NULL, table->len, table->len * sizeof(dbrow_t), batch_ns);
+	bench_find(&json, &cfg, table);
+	bench_sort(&json, &cfg, table);
+	bench_extsort(&json, &cfg, table);
+	bench_remove(&json, &cfg, table);
+	bench_dump(&json, &cfg, table);
+	bench_pack(&json, &cfg, table);
+	bench_csv(&json, &cfg, table);
+	bench_trgm(&json, &cfg, table);
+	fprintf(out, "\n  ]\n}\n");
+	table_free(table);
+	if (out != stdout) fclose(out);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,52 @@
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include <stddef.h>
+#include <wchar.h>
+
+#include "table.h"
+
+/*
+ * named tables of one session
+ * the catalog owns its tables, an entry may hold NULL (no table yet)
+ */
+
+#define CATALOG_NAME_LEN 32
+
+typedef struct {
+	wchar_t name[CATALOG_NAME_LEN + 1];
+	table_t *table;
+} catalog_entry_t;
+
+typedef struct {
+	catalog_entry_t *entries;
+	size_t len, cap;
+} catalog_t;
+
+/*
+ * returns NULL on failure
+ */
+catalog_t *catalog_new(void);
+
+// frees all tables
+void catalog_free(catalog_t *catalog);
+
+/*
+ * returns entry named name, NULL if there is none
+ * entries stay valid until the next catalog_add
+ */
+catalog_entry_t *catalog_find(catalog_t const *catalog, wchar_t const *name);
+
+/*
+ * returns entry named name, adds an empty one if there is none
+ * returns NULL on failure (bad name or no memory)
+ * names are 1..CATALOG_NAME_LEN characters without whitespace
+ */
+catalog_entry_t *catalog_add(catalog_t *catalog, wchar_t const *name);
+
+/*
+ * frees the entry's table and stores table instead
+ */
+void catalog_replace(catalog_entry_t *entry, table_t *table);
+
+#endif
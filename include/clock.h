@@ -0,0 +1,12 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <stdint.h>
+
+/*
+ * monotonic time in nanoseconds (arbitrary origin)
+ * only differences between calls are meaningful
+ */
+uint64_t clock_ns(void);
+
+#endif
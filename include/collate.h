@@ -0,0 +1,43 @@
+#ifndef COLLATE_H
+#define COLLATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <wchar.h>
+
+#include "table.h"
+
+/*
+ * binary collation keys for STR columns, ordered like ru_RU
+ *
+ * key of a string of up to n characters is COLLATE_KEY_SIZE(n) bytes:
+ * - n primary weights, one byte per character, zero-padded:
+ *   space < punctuation < digits < latin < cyrillic, case-insensitive, ё weighs as е
+ * - diacritic bits (ё/Ё), one per character, msb first
+ * - case bits (uppercase), one per character, msb first
+ * so memcmp on keys compares letters first, then ё against е, then case (lowercase first)
+ * characters outside the input alphabet all weigh 255
+ *
+ * table_append and table_append_batch fill row keys, code that builds rows for other
+ * stores (table_mvcc, the server) should call collate_row
+ */
+
+void collate_key(wchar_t const *str, size_t maxlen, uint8_t *out_key);
+
+/*
+ * fills <name>_key of every STR column, see schema.h
+ */
+void collate_row(dbrow_t *row);
+
+/*
+ * collate_row for n rows, large batches are split across threads
+ */
+void collate_rows(dbrow_t *rows, size_t n);
+
+/*
+ * compares two strings of up to maxlen characters by their keys
+ * returns <0, 0, >0 like wcscmp
+ */
+int collate_cmp(wchar_t const *a, wchar_t const *b, size_t maxlen);
+
+#endif
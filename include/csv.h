@@ -0,0 +1,47 @@
+#ifndef CSV_H
+#define CSV_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+#include "table.h"
+
+/*
+ * csv/tsv import and export
+ *
+ * one row per line: id, c1, c2, c3, c4, c5 separated by sep (',' or '\t'), utf-8
+ * csv fields may be quoted ("a ""b"", c"), tsv fields are taken as is
+ * blank lines, a leading byte order mark and a first line starting with "id" are skipped
+ * fields follow the rules of interactive input (get_c1..get_c5),
+ * a blank id gets the next free id
+ * rows are kept in ascending id order: an input in another order is sorted by id,
+ * duplicate ids are rejected
+ *
+ * import reads the whole stream, splits it at line boundaries into one chunk per thread,
+ * parses the chunks in parallel and appends them in input order
+ * export formats runs of rows in parallel and writes them in order
+ * threads = 0 uses one per cpu
+ * streams should be byte-oriented (opened with "b")
+ */
+
+/*
+ * returns 1 on success and new table in out_table, 0 on failure
+ * the first bad line is reported to ferr
+ */
+int csv_import(FILE *fin, FILE *ferr, char sep, size_t threads, table_t **out_table);
+
+/*
+ * writes a header line and all rows
+ * returns 1 on success, 0 on failure
+ */
+int csv_export(FILE *fout, table_t const *table, char sep, size_t threads);
+
+/*
+ * streaming export of rows that are not in a table: the header line, then rows in order
+ * returns 1 on success, 0 on failure
+ */
+int csv_export_header(FILE *fout, char sep);
+
+int csv_export_rows(FILE *fout, dbrow_t const *rows, size_t n, char sep, size_t threads);
+
+#endif
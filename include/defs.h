@@ -30,5 +30,11 @@
 #define ALPH_RU_UPP L"АБВГДЕЁЖЗИЙКЛМНОПРСТУФХЦЧШЩЪЫЬЭЮЯ"
 #define ALPH_RU ALPH_RU_LOW ALPH_RU_UPP
 
+// character sets of string columns (see schema.h) and their descriptions for error messages
+#define C3_CHARS DIGITS ALPH_EN ALPH_RU
+#define C3_CHARS_HELP L"0-9 a-z A-Z а-я А-Я"
+#define C5_CHARS L" " PUNCTS DIGITS ALPH_EN ALPH_RU
+#define C5_CHARS_HELP L"0-9 a-z A-Z а-я А-Я punctuation and space"
+
 #endif
 
@@ -0,0 +1,68 @@
+#ifndef DUMP_H
+#define DUMP_H
+
+#include <stdio.h>
+#include <wchar.h>
+
+#include "table.h"
+#include "defs.h"
+
+// wprintf format of one field, by column kind
+#ifdef _MSC_VER
+#define ROW_FMT_UINT L"%zd"
+#define ROW_FMT_INT L"%lld"
+#else
+#define ROW_FMT_UINT L"%zu"
+#define ROW_FMT_INT L"%zd"
+#endif
+#define ROW_FMT_FLOAT L"%f"
+#define ROW_FMT_BOOL L"%d"
+#define ROW_FMT_STR WSTR_FMT
+#define ROW_QUOTE_UINT
+#define ROW_QUOTE_INT
+#define ROW_QUOTE_FLOAT
+#define ROW_QUOTE_BOOL
+#define ROW_QUOTE_STR L"'"
+
+#define ROW_HUMAN_FIRST(a, name, tag, kind, len, charset) ROW_QUOTE_##kind ROW_FMT_##kind ROW_QUOTE_##kind
+#define ROW_HUMAN_NEXT(a, name, tag, kind, len, charset) L"\t" ROW_HUMAN_FIRST(a, name, tag, kind, len, charset)
+#define ROW_DUMP_FIELD(a, name, tag, kind, len, charset) ROW_FMT_##kind L"\n"
+#define ROW_HEADER_FIRST(a, name, tag, kind, len, charset) SCHEMA_WSTR(name)
+#define ROW_HEADER_NEXT(a, name, tag, kind, len, charset) L"\t" SCHEMA_WSTR(name)
+
+// formats take ROW_ARG
+#define ROW_HUMAN_FIELDS TABLE_SCHEMA_ID(ROW_HUMAN_FIRST, _) TABLE_SCHEMA_DATA(ROW_HUMAN_NEXT, _)
+#define ROW_DUMP_FORMAT TABLE_SCHEMA(ROW_DUMP_FIELD, _)
+#define ROW_HUMAN_FORMAT ROW_HUMAN_FIELDS L"\n"
+#define ROW_HEADER_FIELDS TABLE_SCHEMA_ID(ROW_HEADER_FIRST, _) TABLE_SCHEMA_DATA(ROW_HEADER_NEXT, _)
+#define ROW_HEADER ROW_HEADER_FIELDS L"\n"
+// pair of rows, takes ROW_ARG of both
+#define ROW_JOIN_FORMAT ROW_HUMAN_FIELDS L"\t|\t" ROW_HUMAN_FIELDS L"\n"
+#define ROW_JOIN_HEADER ROW_HEADER_FIELDS L"\t|\t" ROW_HEADER_FIELDS L"\n"
+
+/*
+ * fopen with wide path and mode
+ * returned stream is wide-oriented
+ */
+FILE *wide_fopen(wchar_t const *path, wchar_t const *mode);
+
+/*
+ * returns 1 on success, 0 on failure
+ * retries `interactive` times with each field
+ * gets id automatically if interactive
+ */
+int add_row(FILE *fin, FILE *fout, FILE *ferr, table_t *table, wchar_t *line, int interactive);
+
+/*
+ * dump = 1 prints in ROW_DUMP_FORMAT (loadable by load_table)
+ * returns 1 on success, 0 on failure
+ */
+int print_table(FILE *fout, FILE *ferr, table_t const *table, int dump);
+
+/*
+ * reads table in ROW_DUMP_FORMAT
+ * returns 1 on success and new table in out_table, 0 on failure
+ */
+int load_table(FILE *fin, FILE *ferr, table_t **out_table, wchar_t *line);
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef GEN_H
+#define GEN_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "table.h"
+
+/*
+ * synthetic row generator
+ * deterministic for the same params and seed
+ */
+
+typedef enum { GD_UNIFORM, GD_NORMAL, GD_SKEWED } gen_dist_t;
+
+typedef struct {
+	size_t c3_card; // distinct c3 values, 0 = every row gets its own
+	size_t c5_card; // distinct c5 values, 0 = every row gets its own
+	gen_dist_t c1_dist;
+	gen_dist_t c2_dist;
+	int64_t c1_min, c1_max;
+	double c2_min, c2_max;
+} gen_params_t;
+
+typedef struct {
+	uint64_t state;
+	gen_params_t params;
+} gen_t;
+
+gen_params_t gen_default_params(void);
+
+void gen_init(gen_t *gen, gen_params_t params, uint64_t seed);
+
+// splitmix64
+uint64_t gen_next(gen_t *gen);
+
+void gen_row(gen_t *gen, size_t id, dbrow_t *out_row);
+
+/*
+ * name is one of uniform, normal, skewed
+ * returns 1 on success, 0 on failure
+ */
+int gen_parse_dist(char const *name, gen_dist_t *out_dist);
+
+char const *gen_dist_name(gen_dist_t dist);
+
+#endif
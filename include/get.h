@@ -6,6 +6,8 @@
 #include <stdbool.h>
 #include <wchar.h>
 
+#include "table.h"
+
 /*
  * interactive = 1 if interactive input
  * returns 1 on success, 0 on failure
@@ -32,23 +34,48 @@ int get_str(FILE *fin, FILE *fout, FILE *ferr, wchar_t *line,
 	size_t maxlen,
 	wchar_t *out_result);
 
-int get_id(FILE *fin, FILE *fout, FILE *ferr, wchar_t *line,
-	wchar_t const *prompt, wchar_t const *onerror,
-	int interactive, size_t *out_result);
+/*
+ * non-interactive check with the rules of get_str
+ * str holds len characters, no terminator needed
+ * returns 1 if str is valid, 0 otherwise
+ */
+int check_str(wchar_t const *str, size_t len, wchar_t const *whitelist, size_t maxlen);
 
-int get_c1(FILE *fin, FILE *fout, FILE *ferr, wchar_t *line,
-	wchar_t const *prompt, wchar_t const *onerror, int interactive, int64_t *out_result);
+/*
+ * per-column functions, one set for every column of schema.h
+ *
+ * get_<name> reads the column with its own prompt and error message (NULL for defaults)
+ * parse_<name> parses str of n characters (terminated) non-interactively
+ * check_<name> (STR columns) checks str of n characters, no terminator needed,
+ * returns 1 if str is valid, 0 otherwise
+ */
+#define GET_DECLARE(a, name, tag, kind, len, charset) \
+	int get_##name(FILE *fin, FILE *fout, FILE *ferr, wchar_t *line, \
+		wchar_t const *prompt, wchar_t const *onerror, int interactive, SCHEMA_CTYPE_##kind *out_result); \
+	int parse_##name(wchar_t *str, size_t n, SCHEMA_CTYPE_##kind *out_result); \
+	GET_DECLARE_CHECK_##kind(name)
+#define GET_DECLARE_CHECK_UINT(name)
+#define GET_DECLARE_CHECK_INT(name)
+#define GET_DECLARE_CHECK_FLOAT(name)
+#define GET_DECLARE_CHECK_BOOL(name)
+#define GET_DECLARE_CHECK_STR(name) int check_##name(wchar_t const *str, size_t n);
 
-int get_c2(FILE *fin, FILE *fout, FILE *ferr, wchar_t *line,
-	wchar_t const *prompt, wchar_t const *onerror, int interactive, double *out_result);
+TABLE_SCHEMA(GET_DECLARE, _)
 
-int get_c3(FILE *fin, FILE *fout, FILE *ferr, wchar_t *line,
-	wchar_t const *prompt, wchar_t const *onerror, int interactive, wchar_t *out_result);
+/*
+ * checks data that did not come through the parsers (a client request) with their rules:
+ * STR fields are terminated within their length and pass check_<name>, BOOL fields hold 0 or 1
+ * check_findspec checks the condition (table_find_valid) and the operands on its column, data2 for C_BTW only
+ * returns 1 if valid, 0 otherwise
+ */
+int check_row(dbrow_t const *row);
 
-int get_c4(FILE *fin, FILE *fout, FILE *ferr, wchar_t *line,
-	wchar_t const *prompt, wchar_t const *onerror, int interactive, bool *out_result);
+int check_findspec(table_find_t const *findspec);
 
-int get_c5(FILE *fin, FILE *fout, FILE *ferr, wchar_t *line,
-	wchar_t const *prompt, wchar_t const *onerror, int interactive, wchar_t *out_result);
+/*
+ * default error message of column, without line break
+ * returns NULL on bad column
+ */
+wchar_t const *get_column_error(column_t column);
 
 #endif
@@ -0,0 +1,26 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <wchar.h>
+
+/*
+ * hashes of column values for the hash tables, sketches and statistics
+ * every bit of the result depends on every bit of the input, so both the low bits
+ * (table slots) and the high bits (sketch registers) are usable
+ */
+
+// murmur3 finalizer of an integer key
+uint64_t hash_u64(uint64_t x);
+
+/*
+ * fnv-1a over code units of a string of at most cap characters (SIZE_MAX if it is terminated),
+ * then hash_u64
+ */
+uint64_t hash_wcs(wchar_t const *s, size_t cap);
+
+// qsort comparator of uint64_t values
+int hash_cmp_u64(void const *a, void const *b);
+
+#endif
@@ -3,6 +3,7 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include <wchar.h>
 
 /*
@@ -23,5 +24,12 @@ int wparse_int(wchar_t *str, int64_t *out_result);
  */
 int wparse_float(wchar_t *str, double *out_result);
 
+/*
+ * returns 1 on success and result in out_result, 0 on failure
+ * success if str is one of (blank) 0 F f OFF off FALSE false
+ * or 1 T t ON on TRUE true, optionally followed by '\n'
+ */
+int wparse_bool(wchar_t *str, bool *out_result);
+
 #endif
 
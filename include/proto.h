@@ -0,0 +1,133 @@
+#ifndef PROTO_H
+#define PROTO_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "table.h"
+
+/*
+ * request/response protocol of server mode (unix domain socket)
+ * every message is a header followed by `len` bytes of payload
+ * structs are sent in native layout, so client and server must come from the same build
+ */
+
+#define PROTO_MAX_PAYLOAD (64u * 1024u * 1024u)
+#define PROTO_MAX_ROWS (PROTO_MAX_PAYLOAD / sizeof(dbrow_t) - 1)
+
+typedef enum {
+	// reads, run concurrently
+	OP_COUNT = 1, // -> proto_count_t
+	OP_SCAN, // proto_scan_t -> proto_rows_t + rows
+	OP_FIND, // proto_find_t -> proto_rows_t + rows
+	OP_SORT, // proto_sort_t -> proto_rows_t + rows
+	// writes, serialized
+	OP_APPEND = 16, // rows (id 0 = assign next id, others ascend from next id) -> proto_count_t
+	OP_REMOVE, // uint64_t id -> nothing, PS_NOT_FOUND if there is no such row
+	// replication (repl.h), primaries only
+	OP_FOLLOW = 32, // proto_follow_t -> endless stream of proto_change_t + rows
+} proto_op_t;
+
+typedef enum {
+	PS_OK = 0,
+	PS_NOT_FOUND,
+	PS_BAD_REQUEST,
+	PS_ERROR,
+	PS_READ_ONLY, // writes sent to a replica
+} proto_status_t;
+
+typedef struct {
+	uint32_t op; // proto_op_t in requests, proto_status_t in responses
+	uint32_t len;
+} proto_header_t;
+
+typedef struct {
+	uint64_t len;
+	uint64_t next_id;
+} proto_count_t;
+
+typedef struct {
+	uint64_t start;
+	uint64_t limit;
+} proto_scan_t;
+
+typedef struct {
+	table_find_t spec; // rows are matched from spec.start_pos
+	uint64_t limit;
+} proto_find_t;
+
+typedef struct {
+	table_sort_t spec;
+	uint64_t offset;
+	uint64_t limit;
+} proto_sort_t;
+
+typedef struct {
+	uint64_t count; // rows following this struct
+	uint64_t next; // position to continue scan/find from, table length when done
+} proto_rows_t;
+
+typedef struct {
+	// last change the follower has, zeros for none
+	uint64_t epoch;
+	uint64_t seq;
+} proto_follow_t;
+
+/*
+ * change stream: every message is a PS_OK response with proto_change_t + `count` rows
+ * a snapshot (CH_SNAPSHOT, CH_ROWS..., CH_SYNCED) is sent when the follower cannot resume,
+ * then CH_APPEND and CH_REMOVE with consecutive seq
+ */
+typedef enum {
+	CH_SNAPSHOT = 1, // id = rows in the snapshot
+	CH_ROWS, // next rows of the snapshot
+	CH_SYNCED, // snapshot holds changes up to seq, id = next_id
+	CH_APPEND, // rows with ids and collation keys
+	CH_REMOVE, // id = removed row
+} proto_change_op_t;
+
+typedef struct {
+	uint32_t op; // proto_change_op_t
+	uint32_t count;
+	uint64_t epoch; // primary run, seq restarts with every run
+	uint64_t seq;
+	uint64_t id;
+} proto_change_t;
+
+/*
+ * client side
+ * all functions return 1 on success, 0 on failure
+ * row results are written to caller-provided out_rows with capacity cap
+ */
+
+int client_connect(char const *path, int *out_fd);
+
+void client_close(int fd);
+
+int client_count(int fd, proto_count_t *out_count);
+
+int client_scan(int fd, proto_scan_t req, dbrow_t *out_rows, size_t cap, proto_rows_t *out_info);
+
+int client_find(int fd, proto_find_t req, dbrow_t *out_rows, size_t cap, proto_rows_t *out_info);
+
+int client_sort(int fd, proto_sort_t req, dbrow_t *out_rows, size_t cap, proto_rows_t *out_info);
+
+int client_append(int fd, dbrow_t const *rows, size_t n, proto_count_t *out_count);
+
+/*
+ * returns 0 also when there is no row with such id
+ */
+int client_remove(int fd, uint64_t id);
+
+/*
+ * turns the connection into a change stream after req (see proto_change_t)
+ */
+int client_follow(int fd, proto_follow_t req);
+
+/*
+ * reads the next message of a change stream, its rows go to *rows (realloc'ed, *cap rows)
+ * blocks until there is one
+ */
+int client_next_change(int fd, proto_change_t *out_change, dbrow_t **rows, size_t *cap);
+
+#endif
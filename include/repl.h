@@ -0,0 +1,67 @@
+#ifndef REPL_H
+#define REPL_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "table.h"
+#include "proto.h"
+#include "table_mvcc.h"
+
+/*
+ * change log replication between server processes (server.h), posix only
+ *
+ * a primary numbers every write it serves (an append batch or a remove) and keeps
+ * the encoded changes in memory; OP_FOLLOW hands the connection to a thread of its own,
+ * which sends a snapshot if the follower cannot resume from the log, then every change
+ * as soon as it is logged
+ * the log keeps the last REPL_LOG_KEEP bytes for followers that reconnect,
+ * a follower more than REPL_LOG_MAX bytes behind is disconnected and comes back for a snapshot
+ *
+ * a replica applies the stream to its own table_mvcc_t as its only writer: readers see
+ * each change whole, a snapshot replaces all rows at once
+ * on a gap in seq or a lost connection it reconnects and resumes after its last change
+ */
+
+#define REPL_LOG_KEEP (16u * 1024u * 1024u)
+#define REPL_LOG_MAX (256u * 1024u * 1024u)
+#define REPL_SNAPSHOT_ROWS 4096
+
+typedef struct repl_log repl_log_t;
+typedef struct repl_replica repl_replica_t;
+
+/*
+ * primary side
+ * returns NULL on failure
+ */
+repl_log_t *repl_log_new(void);
+
+/*
+ * disconnects followers and waits for their threads
+ */
+void repl_log_free(repl_log_t *log);
+
+/*
+ * log a change already applied to the served table, call with the server write lock held
+ * if the change cannot be logged, followers are disconnected and come back for a snapshot
+ */
+void repl_log_append(repl_log_t *log, dbrow_t const *rows, size_t n);
+
+void repl_log_remove(repl_log_t *log, uint64_t id);
+
+/*
+ * starts streaming changes after req to fd and takes ownership of fd
+ * call with the server write lock held, so a snapshot of mvcc matches the log
+ * returns 1 on success, 0 on failure (fd is closed)
+ */
+int repl_log_follow(repl_log_t *log, table_mvcc_t *mvcc, int fd, proto_follow_t req);
+
+/*
+ * replica side, follows the primary serving at path until stopped
+ * returns NULL on failure
+ */
+repl_replica_t *repl_replica_start(char const *primary, table_mvcc_t *mvcc, FILE *ferr);
+
+void repl_replica_stop(repl_replica_t *replica);
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef SCHEMA_H
+#define SCHEMA_H
+
+/*
+ * table schema, the only list of columns
+ *
+ * TABLE_SCHEMA(X, a) expands X(a, name, tag, kind, len, charset) for every column in order
+ *   a        passed through unchanged (row expression, stream, ...)
+ *   name     field of dbrow_t and dbrow_u, also names get_<name>, check_<name>, parse_<name>
+ *   tag      column_t value
+ *   kind     UINT (size_t), INT (int64_t), FLOAT (double), BOOL (bool), STR (wchar_t[len + 1])
+ *   len      max characters of a STR column, 0 otherwise
+ *   charset  STR only: <charset>_CHARS and <charset>_CHARS_HELP from defs.h, `_` otherwise
+ *
+ * the first column is the UINT row id, rows are kept in its ascending order,
+ * so it is listed on its own in TABLE_SCHEMA_ID
+ * every STR column gets a collation key <name>_key in dbrow_t (see collate.h)
+ *
+ * row layout, column_t, comparators, scan loops, dump formats, interactive and csv parsers
+ * and formatters, the pack codec, trigram index and join keys are expanded per column from this list,
+ * so each column keeps its own loops
+ * modules that work on particular columns (generator, sketches, aggregates) name fields directly
+ */
+
+#define TABLE_SCHEMA_ID(X, a) \
+	X(a, id, TC_ID, UINT, 0, _)
+
+#define TABLE_SCHEMA_DATA(X, a) \
+	X(a, c1, TC_C1, INT, 0, _) \
+	X(a, c2, TC_C2, FLOAT, 0, _) \
+	X(a, c3, TC_C3, STR, 16, C3) \
+	X(a, c4, TC_C4, BOOL, 0, _) \
+	X(a, c5, TC_C5, STR, 32, C5)
+
+#define TABLE_SCHEMA(X, a) TABLE_SCHEMA_ID(X, a) TABLE_SCHEMA_DATA(X, a)
+
+// per-kind building blocks, use as SCHEMA_<WHAT>_##kind
+#define SCHEMA_CTYPE_UINT size_t
+#define SCHEMA_CTYPE_INT int64_t
+#define SCHEMA_CTYPE_FLOAT double
+#define SCHEMA_CTYPE_BOOL bool
+#define SCHEMA_CTYPE_STR wchar_t
+
+// address of a field for parsers (arrays decay)
+#define SCHEMA_REF_UINT(x) &(x)
+#define SCHEMA_REF_INT(x) &(x)
+#define SCHEMA_REF_FLOAT(x) &(x)
+#define SCHEMA_REF_BOOL(x) &(x)
+#define SCHEMA_REF_STR(x) (x)
+
+#define SCHEMA_IS_STR_UINT 0
+#define SCHEMA_IS_STR_INT 0
+#define SCHEMA_IS_STR_FLOAT 0
+#define SCHEMA_IS_STR_BOOL 0
+#define SCHEMA_IS_STR_STR 1
+
+#define SCHEMA_WSTR_(s) L ## s
+#define SCHEMA_WSTR(x) SCHEMA_WSTR_(#x)
+
+// generators used by table.h
+#define SCHEMA_FIELD(a, name, tag, kind, len, charset) SCHEMA_FIELD_##kind(name, len)
+#define SCHEMA_FIELD_UINT(name, len) size_t name;
+#define SCHEMA_FIELD_INT(name, len) int64_t name;
+#define SCHEMA_FIELD_FLOAT(name, len) double name;
+#define SCHEMA_FIELD_BOOL(name, len) bool name;
+#define SCHEMA_FIELD_STR(name, len) wchar_t name[(len) + 1];
+
+#define SCHEMA_KEY(a, name, tag, kind, len, charset) SCHEMA_KEY_##kind(name, len)
+#define SCHEMA_KEY_UINT(name, len)
+#define SCHEMA_KEY_INT(name, len)
+#define SCHEMA_KEY_FLOAT(name, len)
+#define SCHEMA_KEY_BOOL(name, len)
+#define SCHEMA_KEY_STR(name, len) uint8_t name##_key[COLLATE_KEY_SIZE(len)];
+
+// a union member as long as the longest STR column
+#define SCHEMA_STRLEN(a, name, tag, kind, len, charset) char name[(len) + 1];
+
+#define SCHEMA_TAG(a, name, tag, kind, len, charset) tag,
+#define SCHEMA_COUNT(a, name, tag, kind, len, charset) + 1
+
+#endif
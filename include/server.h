@@ -0,0 +1,25 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "table.h"
+
+#define SERVER_RECV_TIMEOUT 10
+
+/*
+ * serves table over unix domain socket at path (see proto.h)
+ * reads run concurrently on `workers` threads (0 = one per cpu) on snapshots (table_mvcc.h)
+ * and never wait for writes, writes are serialized
+ * on clean shutdown table holds the final state
+ * with primary == NULL writes are logged for replicas (repl.h), otherwise the server
+ * is a read-only replica of the server at primary and table is replaced by its rows
+ * a request has to arrive within SERVER_RECV_TIMEOUT seconds once it started, stalled clients
+ * are disconnected; on stop, connections still in a request are shut down
+ * blocks until SIGINT or SIGTERM
+ * returns 1 on clean shutdown, 0 on failure (or on platforms without unix sockets)
+ */
+int server_run(table_t *table, char const *path, char const *primary, size_t workers, FILE *ferr);
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/*
+ * hot-path counters and latency histograms
+ * compiled in only with WITH_STATS (cmake -DWITH_STATS=ON),
+ * otherwise STATS_* macros expand to nothing
+ * counters are atomic, server workers record into them concurrently
+ */
+
+typedef enum {
+	ST_FIND, ST_SORT, ST_APPEND, ST_REMOVE, ST_LOAD, ST_PRINT,
+	ST_COUNT
+} stats_op_t;
+
+// bucket k holds calls that took [2^k, 2^(k+1)) ns
+#define STATS_BUCKETS 40
+
+typedef struct {
+	uint64_t calls;
+	uint64_t rows; // rows scanned / moved / copied
+	uint64_t bytes_in;
+	uint64_t bytes_out;
+	uint64_t ns_total;
+	uint64_t hist[STATS_BUCKETS];
+} stats_counter_t;
+
+#ifdef WITH_STATS
+#include "clock.h"
+#define STATS_START(var) uint64_t var = clock_ns()
+#define STATS_END(op, var, rows, bytes_in, bytes_out) \
+	stats_record(op, clock_ns() - (var), rows, bytes_in, bytes_out)
+#else
+#define STATS_START(var)
+#define STATS_END(op, var, rows, bytes_in, bytes_out)
+#endif
+
+void stats_record(stats_op_t op, uint64_t ns, uint64_t rows, uint64_t bytes_in, uint64_t bytes_out);
+
+void stats_reset(void);
+
+/*
+ * returns 1 on success, 0 if stats are compiled out
+ */
+int stats_get(stats_op_t op, stats_counter_t *out_counter);
+
+void stats_print(FILE *fout);
+
+#endif
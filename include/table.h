@@ -6,36 +6,54 @@
 #include <stdbool.h>
 #include <wchar.h>
 
+#include "schema.h"
+
+// collation key of a string of up to n characters, see collate.h
+#define COLLATE_KEY_SIZE(n) ((n) + 2 * (((n) + 7) / 8))
+
+// fields in schema order, then collation keys
 typedef struct {
-	size_t id;
-	int64_t c1;
-	double c2; // todo: find some float64_t
-	wchar_t c3[17];
-	bool c4;
-	wchar_t c5[33];
+	TABLE_SCHEMA(SCHEMA_FIELD, _)
+	// filled by table_append*, not part of the dump
+	TABLE_SCHEMA(SCHEMA_KEY, _)
 } dbrow_t;
 
-#define ROW_ARG(row) row.id, row.c1, row.c2, row.c3, row.c4, row.c5
+#define ROW_ARG_FIRST(row, name, tag, kind, len, charset) (row).name
+#define ROW_ARG_NEXT(row, name, tag, kind, len, charset) , (row).name
+// all fields of row in schema order, for the ROW_*_FORMAT strings of dump.h
+#define ROW_ARG(row) TABLE_SCHEMA_ID(ROW_ARG_FIRST, row) TABLE_SCHEMA_DATA(ROW_ARG_NEXT, row)
 
 typedef union {
-	size_t id;
-	int64_t c1;
-	double c2;
-	wchar_t c3[17];
-	bool c4;
-	wchar_t c5[33];
+	TABLE_SCHEMA(SCHEMA_FIELD, _)
 } dbrow_u;
 
+// longest STR column in characters
+#define TABLE_STR_MAXLEN (sizeof(union { TABLE_SCHEMA(SCHEMA_STRLEN, _) }) - 1)
+
 typedef struct {
 	dbrow_t *rows;
 	size_t len;
 	size_t cap;
 	size_t next_id;
+	uint64_t version; // bumped by every change of rows
+	int ids_ascending; // ids strictly ascend with position, id search relies on it
+	struct table_map *map; // NULL for heap storage, see table_map.h
+	struct table_cache *cache; // NULL until the first cached query, see table_cache.h
+	struct table_views *views; // NULL without registered views, see table_view.h
+	struct table_trgm *trgm; // NULL without trigram indexes, see table_trgm.h
+	struct table_colstats *colstats; // NULL until analyzed, see table_plan.h
+	struct table_sketch *sketch; // NULL until the first distinct count, see table_sketch.h
+	struct table_aggs *aggs; // NULL without aggregates, see table_agg.h
 } table_t;
 
+// rows readable through table->rows, 0 if the storage is gone
+#define TABLE_ROWS_LEN(table) ((table)->rows != NULL ? (table)->len : 0)
+
 typedef enum { S_ASC, S_DESC } sort_dir_t;
-typedef enum { TC_ID, TC_C1, TC_C2, TC_C3, TC_C4, TC_C5 } column_t;
-typedef enum { C_EQ, C_NEQ, C_LT, C_GT, C_LE, C_GE, C_BTW } condition_t;
+typedef enum { TABLE_SCHEMA(SCHEMA_TAG, _) } column_t;
+#define TABLE_NCOLUMNS (0 TABLE_SCHEMA(SCHEMA_COUNT, _))
+// C_CONTAINS and C_PREFIX apply to STR columns only
+typedef enum { C_EQ, C_NEQ, C_LT, C_GT, C_LE, C_GE, C_BTW, C_CONTAINS, C_PREFIX } condition_t;
 
 typedef struct {
 	column_t column;
@@ -62,4 +80,72 @@ int table_append(table_t *table, dbrow_t row);
 
 int table_remove_at(table_t *table, size_t pos);
 
+/*
+ * makes room for at least cap rows, appends up to cap rows do not reallocate
+ * returns 1 on success, 0 on failure
+ */
+int table_reserve(table_t *table, size_t cap);
+
+/*
+ * batch api, works on caller-provided buffers
+ * all return 0 on bad arguments
+ */
+
+/*
+ * appends n rows with a single capacity check, rows are copied with one memcpy
+ * and their collation keys are computed in parallel for large n
+ * returns 1 on success, 0 on failure (table is left unchanged)
+ */
+int table_append_batch(table_t *table, dbrow_t const *rows, size_t n);
+
+/*
+ * writes positions of up to cap rows matching findspec (starting at findspec.start_pos)
+ * returns number of positions written
+ * out_next (optional) receives position to continue from, table->len when scan is complete
+ */
+size_t table_find_all(table_t const *table, table_find_t findspec, size_t *out_idx, size_t cap,
+	size_t *out_next);
+
+/*
+ * returns 1 if row satisfies findspec (start_pos is ignored), 0 otherwise
+ */
+int table_row_matches(dbrow_t const *row, table_find_t findspec);
+
+/*
+ * returns 1 if findspec names a column and a condition its kind has, 0 otherwise
+ * (contains and prefix are for STR columns, bool columns have only eq and neq)
+ */
+int table_find_valid(table_find_t const *findspec);
+
+/*
+ * sorts a copy of the table into out_rows, cap should be >= table->len
+ * returns 1 on success, 0 on failure
+ */
+int table_sort_into(table_t const *table, table_sort_t sortspec, dbrow_t *out_rows, size_t cap);
+
+/*
+ * sorts n rows in place
+ * returns 1 on success, 0 on failure
+ */
+int table_sort_rows(dbrow_t *rows, size_t n, table_sort_t sortspec);
+
+/*
+ * qsort-compatible row comparator used by table_sort
+ * returns NULL on bad sortspec
+ */
+typedef int (*table_cmp_t)(void const *, void const *);
+
+table_cmp_t table_sort_cmp(table_sort_t sortspec);
+
+/*
+ * copies up to cap rows starting at position start into out_rows
+ * returns number of rows copied
+ */
+size_t table_snapshot_rows(table_t const *table, size_t start, dbrow_t *out_rows, size_t cap);
+
+/*
+ * returns 1 if ids of n rows strictly ascend and exceed the id of prev (NULL for none)
+ */
+int table_ids_ascend(dbrow_t const *prev, dbrow_t const *rows, size_t n);
+
 #endif
@@ -0,0 +1,81 @@
+#ifndef TABLE_AGG_H
+#define TABLE_AGG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "table.h"
+
+/*
+ * materialized aggregates
+ *
+ * an aggregate groups the rows matching an optional filter by one column and keeps
+ * per group: count, sum, min and max of c1 and c2
+ * table_append* and table_remove_at update every aggregate: count and sums in O(1),
+ * min/max in deletable heaps (a heap of values and a heap of removed values still inside it,
+ * equal tops cancel), O(log n) amortized: appends are buffered and merged into the heaps
+ * of a group by its next removal
+ * reading costs O(groups) whatever the number of rows
+ *
+ * sum of c1 is exact while the true sum fits int64_t, sum of c2 is compensated (Neumaier)
+ * if an update runs out of memory the aggregate is dropped
+ */
+
+#define TABLE_AGG_MAX 16
+
+typedef struct {
+	column_t group;
+	int filtered; // 0 = all rows
+	table_find_t filter; // start_pos is ignored
+} table_agg_spec_t;
+
+typedef struct {
+	dbrow_u key; // value of the group column
+	size_t count;
+	int64_t sum_c1;
+	double sum_c2;
+	int64_t min_c1, max_c1;
+	double min_c2, max_c2;
+} table_agg_group_t;
+
+/*
+ * builds an aggregate from the current rows
+ * returns 1 on success and its id in out_id, 0 on failure (bad spec, TABLE_AGG_MAX reached)
+ */
+int table_agg_add(table_t *table, table_agg_spec_t spec, size_t *out_id);
+
+/*
+ * returns 1 if the aggregate was registered, 0 otherwise
+ */
+int table_agg_drop(table_t *table, size_t id);
+
+/*
+ * writes up to cap registered ids and specs (out_specs may be NULL)
+ * returns number of registered aggregates
+ */
+size_t table_agg_list(table_t const *table, size_t *out_ids, table_agg_spec_t *out_specs, size_t cap);
+
+/*
+ * writes up to cap non-empty groups in order of their first row
+ * returns 1 on success and number of non-empty groups in out_n, 0 if there is no such aggregate
+ */
+int table_agg_read(table_t const *table, size_t id, table_agg_group_t *out_groups, size_t cap,
+	size_t *out_n);
+
+/*
+ * maintenance hooks for table.c
+ * remove is called before the row is removed
+ */
+void table_aggs_insert(table_t *table, dbrow_t const *row);
+
+void table_aggs_remove(table_t *table, dbrow_t const *row);
+
+/*
+ * refills every aggregate from table->rows after the rows were replaced wholesale
+ * returns 1 on success, 0 on failure (aggregates that could not be refilled are dropped)
+ */
+int table_aggs_rebuild(table_t *table);
+
+void table_aggs_free(table_t *table);
+
+#endif
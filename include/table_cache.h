@@ -0,0 +1,61 @@
+#ifndef TABLE_CACHE_H
+#define TABLE_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "table.h"
+
+/*
+ * query result cache
+ *
+ * every table keeps results of its recent queries keyed by normalized findspec/sortspec
+ * (only the operands the condition uses take part in the key)
+ * entries belong to one table->version, the first query after a change drops them all
+ * least recently used entries are evicted past TABLE_CACHE_ENTRIES or TABLE_CACHE_BYTES,
+ * a result larger than TABLE_CACHE_BYTES is returned but not kept
+ *
+ * returned buffers are owned by the cache and stay valid until the next cached query
+ * on the same table, a change of the table or table_free
+ * not thread-safe
+ */
+
+#ifndef TABLE_CACHE_ENTRIES
+#define TABLE_CACHE_ENTRIES 32
+#endif
+
+#ifndef TABLE_CACHE_BYTES
+#define TABLE_CACHE_BYTES ((size_t) 64 << 20)
+#endif
+
+typedef struct {
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t evictions;
+	size_t entries;
+	size_t bytes;
+} table_cache_stats_t;
+
+/*
+ * positions of all rows matching findspec (from findspec.start_pos)
+ * returns 1 on success (also for no matches), 0 on failure
+ */
+int table_cached_find(table_t *table, table_find_t findspec, size_t const **out_idx, size_t *out_n);
+
+/*
+ * table->len rows sorted by sortspec
+ * returns 1 on success, 0 on failure
+ */
+int table_cached_sort(table_t *table, table_sort_t sortspec, dbrow_t const **out_rows);
+
+/*
+ * all zero if nothing was cached yet
+ */
+void table_cache_stats(table_t const *table, table_cache_stats_t *out_stats);
+
+/*
+ * drops all entries and counters
+ */
+void table_cache_clear(table_t *table);
+
+#endif
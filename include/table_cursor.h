@@ -0,0 +1,79 @@
+#ifndef TABLE_CURSOR_H
+#define TABLE_CURSOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "table.h"
+#include "table_view.h"
+
+/*
+ * lazy cursor over table rows with optional filter, order, offset and limit
+ *
+ * in table order rows are found on demand, a scan stops after offset + limit matches
+ * and an unfiltered offset costs nothing
+ * in sort order a registered view is walked when there is one, otherwise
+ * the best offset + limit matching positions are selected with a bounded heap,
+ * O(n log k) time and O(k) memory instead of a sorted copy of the table
+ * ties are broken by position (by id and the rest of the row in a view),
+ * so consecutive pages neither repeat nor skip rows
+ *
+ * a change of the table ends the iteration
+ */
+
+// limit for all remaining rows
+#define TABLE_CURSOR_ALL SIZE_MAX
+
+typedef struct {
+	table_t const *table;
+	uint64_t version;
+	int filtered;
+	table_find_t findspec;
+	size_t skip; // offset still to skip
+	size_t left; // rows still to return
+	size_t pos; // next position to scan
+	int mode; // scan, view or heap
+	table_view_iter_t iter;
+	size_t *top; // positions selected by the heap in output order
+	size_t ntop, at;
+} table_cursor_t;
+
+/*
+ * bounded top-k selection behind the sorted cursor, also for rows outside a table_t
+ * (snapshots): positions offered in ascending order, the first k in order of cmp are kept,
+ * ties by position; O(log k) per offer and O(k) memory
+ */
+typedef dbrow_t const *(*table_row_at_t)(void const *src, size_t pos);
+
+typedef struct {
+	size_t *pos; // kept positions, output order after table_top_finish, caller frees
+	size_t n, k;
+	void const *src;
+	table_row_at_t row_at;
+	table_cmp_t cmp;
+} table_top_t;
+
+// returns 1 on success, 0 on failure
+int table_top_init(table_top_t *top, size_t k, void const *src, table_row_at_t row_at, table_cmp_t cmp);
+
+void table_top_offer(table_top_t *top, size_t pos);
+
+// sorts the kept positions into output order, returns their number
+size_t table_top_finish(table_top_t *top);
+
+/*
+ * findspec and sortspec are optional (NULL for all rows, table order)
+ * returns 1 on success, 0 on failure
+ */
+int table_cursor_open(table_cursor_t *cur, table_t const *table, table_find_t const *findspec,
+	table_sort_t const *sortspec, size_t offset, size_t limit);
+
+/*
+ * returns next row, NULL past the last one or after the table changed
+ * the row is valid until the next change of the table
+ */
+dbrow_t const *table_cursor_next(table_cursor_t *cur);
+
+void table_cursor_close(table_cursor_t *cur);
+
+#endif
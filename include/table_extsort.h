@@ -0,0 +1,56 @@
+#ifndef TABLE_EXTSORT_H
+#define TABLE_EXTSORT_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+#include "table.h"
+
+/*
+ * external merge sort in bounded memory
+ *
+ * table_sort holds a sorted copy of every row; here about `budget` bytes of rows are held at once:
+ * the table is cut into runs that fit in the budget, each run is sorted and spilled to a temp file
+ * as blocks of the pack codec (table_pack.h), then the runs are merged k ways with a loser tree
+ * holding one decoded block per run
+ * when there are more runs than blocks fit in the budget, groups of runs are first merged into
+ * longer runs, each pass reading and writing the data once
+ * a table that fits in the budget is sorted in memory without temp files
+ *
+ * temp files are created in tmpdir (NULL = tmpfile()) and unlinked at once
+ * posix only for tmpdir, windows always uses tmpfile()
+ */
+
+#define TABLE_EXTSORT_BUDGET (64u * 1024u * 1024u)
+#define TABLE_EXTSORT_MIN_BUDGET (1024u * 1024u)
+
+/*
+ * receives sorted rows in order, up to TABLE_PACK_BLOCK_ROWS at a time
+ * collation keys are filled for the sort column only
+ * returns 1 to go on, 0 to stop the sort
+ */
+typedef int (*table_extsort_sink_t)(void *ctx, dbrow_t const *rows, size_t n);
+
+/*
+ * budget in bytes, 0 = TABLE_EXTSORT_BUDGET, smaller budgets are raised to TABLE_EXTSORT_MIN_BUDGET
+ * returns 1 on success, 0 on failure (bad sortspec, out of memory, temp file i/o, sink)
+ */
+int table_extsort(table_t const *table, table_sort_t sortspec, size_t budget, char const *tmpdir,
+	table_extsort_sink_t sink, void *ctx);
+
+/*
+ * writes the sorted rows as a packed snapshot (see table_pack.h)
+ * table_unpack loads it back in id order
+ * returns 1 on success, 0 on failure
+ */
+int table_extsort_pack(FILE *fout, table_t const *table, table_sort_t sortspec, size_t budget,
+	char const *tmpdir);
+
+/*
+ * writes the sorted rows as csv or tsv (see csv.h)
+ * returns 1 on success, 0 on failure
+ */
+int table_extsort_csv(FILE *fout, table_t const *table, table_sort_t sortspec, size_t budget,
+	char const *tmpdir, char sep);
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef TABLE_JOIN_H
+#define TABLE_JOIN_H
+
+#include <stddef.h>
+
+#include "table.h"
+
+/*
+ * hash equi-join
+ *
+ * key columns are UINT and INT columns (compared as integers) and STR columns (compared as strings),
+ * both sides need keys of the same kind
+ * the smaller table is hashed on its key, the larger one is scanned once and probes it,
+ * O(n + m) plus the number of pairs
+ * pairs are passed to emit as they are found, in scan order of the larger table
+ */
+
+typedef void (*table_join_emit_t)(dbrow_t const *left, dbrow_t const *right, void *arg);
+
+/*
+ * returns 1 if column can be a join key, 0 otherwise
+ */
+int table_join_column(column_t column);
+
+/*
+ * returns 1 on success and number of pairs in out_pairs (optional), 0 on failure
+ */
+int table_join(table_t const *left, column_t left_column, table_t const *right, column_t right_column,
+	table_join_emit_t emit, void *arg, size_t *out_pairs);
+
+#endif
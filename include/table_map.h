@@ -0,0 +1,54 @@
+#ifndef TABLE_MAP_H
+#define TABLE_MAP_H
+
+#include <stddef.h>
+
+#include "table.h"
+
+/*
+ * file-backed row storage
+ * rows live in a memory-mapped file that grows by remapping,
+ * the os page cache decides what stays resident
+ * table_find_first, table_sort and the rest work on such tables unchanged
+ * file layout: table_map_header_t, then cap rows
+ */
+
+#define TABLE_MAP_MAGIC "STKTBL1"
+
+typedef struct {
+	char magic[8];
+	uint64_t row_size; // sizeof(dbrow_t) of the build that created the file
+	uint64_t len;
+	uint64_t next_id;
+	uint64_t cap;
+	uint64_t reserved[3];
+} table_map_header_t;
+
+/*
+ * opens table stored at path or creates a new one with room for cap rows
+ * reopening needs no load step
+ * returns NULL on failure (bad file, different row layout, no mmap on this platform)
+ */
+table_t *table_map(char const *path, size_t cap);
+
+/*
+ * writes len and next_id to the file header and flushes dirty pages
+ * table_free does this as well
+ * returns 1 on success, 0 on failure or if table is not mapped
+ */
+int table_map_sync(table_t *table);
+
+/*
+ * used by table.c
+ * grow remaps the file to hold at least cap rows (table->cap is updated)
+ * store writes len and next_id to the mapped header after every change, so the file is
+ * consistent whenever the os writes it back, not only after a sync
+ * close syncs and unmaps, table->rows is NULL afterwards
+ */
+int table_map_grow(table_t *table, size_t cap);
+
+void table_map_store(table_t *table);
+
+void table_map_close(table_t *table);
+
+#endif
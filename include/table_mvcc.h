@@ -0,0 +1,82 @@
+#ifndef TABLE_MVCC_H
+#define TABLE_MVCC_H
+
+#include <stddef.h>
+
+#include "table.h"
+
+/*
+ * concurrency mode: one writer, any number of lock-free readers
+ *
+ * rows live in fixed-size chunks referenced from a chunk directory
+ * every change publishes a new immutable version (len + directory)
+ * - append writes past the end of the current version, which no published version can see,
+ *   and shares chunks and directory with older versions
+ * - remove copies the chunks from the removed position onwards (copy-on-write)
+ * readers acquire a version and scan it without locks; chunks are freed when the last
+ * version that references them is released
+ *
+ * writer functions must not be called concurrently with each other
+ */
+
+#ifndef TABLE_CHUNK_ROWS
+#define TABLE_CHUNK_ROWS 1024
+#endif
+
+typedef struct table_mvcc table_mvcc_t;
+typedef struct table_snap table_snap_t;
+
+/*
+ * copies rows of table if it is not NULL
+ * returns NULL on failure
+ */
+table_mvcc_t *table_mvcc_new(table_t const *table);
+
+/*
+ * all snapshots should be released before this
+ */
+void table_mvcc_free(table_mvcc_t *mvcc);
+
+/*
+ * writer side
+ * returns 1 on success, 0 on failure (current version is left unchanged)
+ */
+int table_mvcc_append(table_mvcc_t *mvcc, dbrow_t const *rows, size_t n);
+
+int table_mvcc_remove_at(table_mvcc_t *mvcc, size_t pos);
+
+int table_mvcc_set_next_id(table_mvcc_t *mvcc, size_t next_id);
+
+/*
+ * publishes a version holding exactly rows (with collation keys) in fresh chunks
+ */
+int table_mvcc_replace(table_mvcc_t *mvcc, dbrow_t const *rows, size_t n, size_t next_id);
+
+/*
+ * reader side
+ * acquire never fails and never waits for the writer
+ */
+table_snap_t const *table_snap_acquire(table_mvcc_t *mvcc);
+
+void table_snap_release(table_mvcc_t *mvcc, table_snap_t const *snap);
+
+size_t table_snap_len(table_snap_t const *snap);
+
+size_t table_snap_next_id(table_snap_t const *snap);
+
+// pos should be < table_snap_len(snap)
+dbrow_t const *table_snap_row(table_snap_t const *snap, size_t pos);
+
+/*
+ * same contracts as table_find_first, table_find_all, table_sort and table_snapshot_rows
+ */
+int table_snap_find_first(table_snap_t const *snap, table_find_t findspec, size_t *out_idx);
+
+size_t table_snap_find_all(table_snap_t const *snap, table_find_t findspec, size_t *out_idx,
+	size_t cap, size_t *out_next);
+
+int table_snap_sort(table_snap_t const *snap, table_sort_t sortspec, dbrow_t **out_result);
+
+size_t table_snap_rows(table_snap_t const *snap, size_t start, dbrow_t *out_rows, size_t cap);
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef TABLE_PACK_H
+#define TABLE_PACK_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "table.h"
+
+/*
+ * compressed binary snapshot
+ *
+ * file: magic "STKPAK1\0", varint len, varint next_id, then blocks until len rows are read
+ * block: varint nrows, varint payload size, payload
+ * payload is columnar and decodes on its own:
+ *   id  first id as varint, then zig-zag varint deltas
+ *   c1  zig-zag varints
+ *   c2  raw little-endian doubles
+ *   c3  dictionary: varint size, entries prefix-compressed against the previous entry,
+ *       then varint entry index per row
+ *   c4  bit-packed, lsb first
+ *   c5  same as c3
+ * strings are stored as varint code units
+ *
+ * streams should be byte-oriented (opened with "b")
+ */
+
+#define TABLE_PACK_MAGIC "STKPAK1"
+
+#ifndef TABLE_PACK_BLOCK_ROWS
+#define TABLE_PACK_BLOCK_ROWS 4096
+#endif
+
+/*
+ * returns 1 on success, 0 on failure
+ */
+int table_pack(FILE *fout, table_t const *table);
+
+/*
+ * blocks are read sequentially and decoded on `threads` threads (0 = one per cpu)
+ * rows stored in another order are loaded in ascending id order
+ * returns 1 on success and new table in out_table, 0 on failure
+ */
+int table_unpack(FILE *fin, table_t **out_table, size_t threads);
+
+/*
+ * single block codec
+ * encode appends payload of n rows to *buf (grown with realloc, *len and *cap updated)
+ * decode returns 1 if payload holds exactly n valid rows
+ */
+int table_pack_block(dbrow_t const *rows, size_t n, uint8_t **buf, size_t *len, size_t *cap);
+
+int table_unpack_block(uint8_t const *payload, size_t size, size_t n, dbrow_t *out_rows);
+
+/*
+ * streaming writer and reader, for rows that are never in memory at once
+ * a file is table_pack_header, then table_pack_write blocks holding len rows in total
+ * buf and cap are encoding scratch reused across calls (start with NULL and 0, free when done)
+ */
+int table_pack_header(FILE *fout, size_t len, size_t next_id);
+
+int table_pack_write(FILE *fout, dbrow_t const *rows, size_t n, uint8_t **buf, size_t *cap);
+
+/*
+ * reads and decodes the next block of up to max_rows rows
+ * returns 1 and its row count in out_n, 0 at end of file or on a bad or larger block
+ */
+int table_unpack_read(FILE *fin, dbrow_t *out_rows, size_t max_rows, uint8_t **buf, size_t *cap,
+	size_t *out_n);
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef TABLE_PLAN_H
+#define TABLE_PLAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "table.h"
+
+/*
+ * column statistics and access path choice for table_find_first and table_find_all
+ *
+ * table_analyze collects for every column: row count, distinct count estimate, min and max,
+ * and for numeric columns (UINT, INT, FLOAT, BOOL kinds of schema.h) an equi-depth histogram
+ * distinct counts and histograms come from a systematic sample of up to TABLE_ANALYZE_SAMPLE rows,
+ * min/max from all rows, distinct counts of sketched columns (table_sketch.h) too once the table
+ * is larger than the sample
+ * statistics are kept until the next analyze, later changes only make estimates older
+ *
+ * table_plan estimates the fraction of rows matching a findspec (defaults without statistics)
+ * and picks the cheapest path in row visits to the first match:
+ * - TP_SCAN      scan from start_pos
+ * - TP_ID_SEARCH binary search over ascending ids, any condition on the id column
+ *                of a table whose ids_ascending holds, other tables scan it
+ * - TP_TRGM      trigram index (table_trgm.h), contains/prefix with a usable needle
+ * - TP_PARALLEL  scan split across threads in rounds, for long expected scans
+ *
+ * table_find_first and table_find_all scan TABLE_PLAN_HEAD_ROWS rows before planning
+ * (except on the id column of a table in id order and with a trigram index), a walk over dense matches never plans,
+ * table_find_all plans once for the whole walk
+ */
+
+#define TABLE_PLAN_HEAD_ROWS 256
+#define TABLE_HIST_BUCKETS 32
+#define TABLE_ANALYZE_SAMPLE (1 << 17)
+
+typedef enum { TP_SCAN, TP_ID_SEARCH, TP_TRGM, TP_PARALLEL } table_path_t;
+
+typedef struct {
+	double distinct; // estimate
+	dbrow_u min, max; // STR columns in collation order
+	size_t nbounds; // histogram bounds, 0 for STR columns or an empty table
+	double bounds[TABLE_HIST_BUCKETS + 1]; // equal numbers of sampled rows between neighbours
+} table_column_stats_t;
+
+typedef struct {
+	uint64_t version; // table version at analyze time
+	size_t rows;
+	size_t sampled;
+	table_column_stats_t columns[TABLE_NCOLUMNS];
+} table_stats_t;
+
+typedef struct {
+	table_path_t path;
+	size_t threads; // TP_PARALLEL only, 1 otherwise
+	int analyzed; // 0 if selectivity is a default guess
+	double selectivity; // fraction of rows matching
+	double rows; // matching rows after start_pos
+	double cost; // row visits to the first match on the chosen path
+	double scan_cost; // same for TP_SCAN
+} table_plan_t;
+
+/*
+ * replaces statistics of table
+ * returns 1 on success, 0 on failure (old statistics are kept)
+ */
+int table_analyze(table_t *table);
+
+/*
+ * returns statistics of the last analyze, NULL if there were none
+ */
+table_stats_t const *table_stats(table_t const *table);
+
+void table_stats_free(table_t *table);
+
+/*
+ * returns 1 on success and the chosen path in out_plan, 0 on bad findspec
+ */
+int table_plan(table_t const *table, table_find_t const *findspec, table_plan_t *out_plan);
+
+wchar_t const *table_path_name(table_path_t path);
+
+#endif
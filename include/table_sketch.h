@@ -0,0 +1,66 @@
+#ifndef TABLE_SKETCH_H
+#define TABLE_SKETCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "table.h"
+
+/*
+ * approximate answers for large tables
+ *
+ * distinct counts of c1, c3 and c5 come from HyperLogLog sketches of 2^TABLE_SKETCH_BITS
+ * one-byte registers per column (standard error 1.04 / sqrt(2^bits), 0.8%)
+ * sketches are built by one pass on the first query, then table_append and table_append_batch
+ * update them per row; any other change (remove, rows written directly by load/import/map)
+ * leaves them behind the table and the next query builds them again
+ *
+ * counts with a predicate come from a uniform random sample of rows drawn at query time
+ * with a 95% Wilson score interval, tables not larger than the sample are counted exactly
+ */
+
+#define TABLE_SKETCH_BITS 14
+#define TABLE_ESTIMATE_SAMPLE 16384
+
+typedef struct {
+	double distinct;
+	double error; // relative standard error
+} table_distinct_t;
+
+typedef struct {
+	size_t rows; // table rows
+	size_t sampled; // rows checked, with repeats
+	size_t matched; // sampled rows matching findspec
+	double count; // estimated matching rows
+	double low, high; // 95% interval of count
+	int exact; // 1 if every row was checked
+} table_estimate_t;
+
+/*
+ * returns 1 if column has a sketch (TC_C1, TC_C3, TC_C5), 0 otherwise
+ */
+int table_sketch_column(column_t column);
+
+/*
+ * builds sketches if they are missing or behind the table
+ * returns 1 on success, 0 on bad column or out of memory
+ */
+int table_distinct(table_t *table, column_t column, table_distinct_t *out_distinct);
+
+/*
+ * sample is the number of rows to check, 0 for TABLE_ESTIMATE_SAMPLE
+ * the same seed on the same table gives the same sample
+ * returns 1 on success, 0 on bad findspec
+ */
+int table_estimate(table_t const *table, table_find_t const *findspec, size_t sample, uint64_t seed,
+	table_estimate_t *out_estimate);
+
+/*
+ * maintenance hooks for table.c
+ * insert adds rows [from, table->len) appended by a change from version (before the bump)
+ */
+void table_sketch_insert(table_t *table, size_t from, uint64_t version);
+
+void table_sketch_free(table_t *table);
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef TABLE_TRGM_H
+#define TABLE_TRGM_H
+
+#include <stddef.h>
+
+#include "table.h"
+
+/*
+ * trigram index for C_CONTAINS and C_PREFIX on STR columns
+ *
+ * a string is split into overlapping trigrams of code units after two leading
+ * boundary marks, so its first characters form trigrams too ("ab" -> "^^a", "^ab")
+ * every trigram maps to a posting list of ascending row positions
+ * a search intersects the lists of the needle's trigrams (leapfrog with galloping seeks)
+ * and checks only the rows found in all of them
+ *
+ * append adds the row's trigrams, remove renumbers positions after the removed row
+ * (O(index size), like the row shift itself)
+ * if an update runs out of memory the index is dropped and searches scan again
+ */
+
+/*
+ * builds index on a STR column, does nothing if it exists
+ * returns 1 on success, 0 on failure
+ */
+int table_trgm_add(table_t *table, column_t column);
+
+/*
+ * returns 1 if column can be indexed (a STR column), 0 otherwise
+ */
+int table_trgm_column(column_t column);
+
+/*
+ * returns 1 if the index existed, 0 otherwise
+ */
+int table_trgm_drop(table_t *table, column_t column);
+
+int table_trgm_has(table_t const *table, column_t column);
+
+/*
+ * returns -1 if the index cannot answer findspec (no index, other condition,
+ * needle too short to have trigrams), otherwise same as table_find_first
+ */
+int table_trgm_find(table_t const *table, table_find_t const *findspec, size_t *out_idx);
+
+/*
+ * returns 1 if table_trgm_find can answer findspec, 0 otherwise
+ */
+int table_trgm_usable(table_t const *table, table_find_t const *findspec);
+
+/*
+ * maintenance hooks for table.c
+ * insert indexes the row at pos == table->len - 1,
+ * remove is called before the row at pos is removed
+ */
+void table_trgm_insert(table_t *table, size_t pos);
+
+void table_trgm_remove(table_t *table, size_t pos);
+
+/*
+ * reindexes table->rows after the rows were replaced wholesale
+ */
+void table_trgm_rebuild(table_t *table);
+
+void table_trgm_free(table_t *table);
+
+#endif
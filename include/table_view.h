@@ -0,0 +1,66 @@
+#ifndef TABLE_VIEW_H
+#define TABLE_VIEW_H
+
+#include <stddef.h>
+
+#include "table.h"
+
+/*
+ * persistent sorted views
+ *
+ * a view keeps copies of all rows ordered by one (column, direction) pair,
+ * ties are ordered by id and then by the rest of the row
+ * table_append* insert into every view and table_remove_at removes from it, O(log n) per view
+ * rows live in a treap, iterating a view costs O(n) without sorting
+ */
+
+typedef struct {
+	void const *view;
+	size_t node;
+} table_view_iter_t;
+
+/*
+ * builds a view from the current rows, does nothing if it is already registered
+ * returns 1 on success, 0 on failure
+ */
+int table_view_add(table_t *table, table_sort_t sortspec);
+
+/*
+ * returns 1 if the view was registered, 0 otherwise
+ */
+int table_view_drop(table_t *table, table_sort_t sortspec);
+
+/*
+ * writes up to cap registered sortspecs to out_specs
+ * returns number of registered views
+ */
+size_t table_view_list(table_t const *table, table_sort_t *out_specs, size_t cap);
+
+/*
+ * iteration is invalidated by any change of the table
+ * begin returns 0 if there is no such view
+ * next returns NULL past the last row
+ */
+int table_view_begin(table_t const *table, table_sort_t sortspec, table_view_iter_t *out_iter);
+
+dbrow_t const *table_view_next(table_view_iter_t *iter);
+
+/*
+ * maintenance hooks for table.c
+ * reserve makes the next n inserts infallible
+ */
+int table_views_reserve(table_t *table, size_t n);
+
+void table_views_insert(table_t *table, dbrow_t const *row);
+
+void table_views_remove(table_t *table, dbrow_t const *row);
+
+/*
+ * refills every view from table->rows after the rows were replaced wholesale
+ * returns 1 on success, 0 on failure (views are dropped)
+ */
+int table_views_rebuild(table_t *table);
+
+void table_views_free(table_t *table);
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef THREAD_H
+#define THREAD_H
+
+#include <stddef.h>
+
+/*
+ * minimal threads: pthreads on posix, win32 api on windows
+ * all int functions return 1 on success, 0 on failure
+ */
+
+#ifdef _WIN32
+#include <windows.h>
+typedef HANDLE thread_t;
+typedef CRITICAL_SECTION mutex_t;
+typedef SRWLOCK rwlock_t;
+typedef CONDITION_VARIABLE cond_t;
+#else
+#include <pthread.h>
+typedef pthread_t thread_t;
+typedef pthread_mutex_t mutex_t;
+typedef pthread_rwlock_t rwlock_t;
+typedef pthread_cond_t cond_t;
+#endif
+
+typedef void (*thread_func)(void *arg);
+
+int thread_create(thread_t *thread, thread_func func, void *arg);
+void thread_join(thread_t thread);
+// number of online cpus, at least 1
+size_t thread_count_hint(void);
+
+/*
+ * calls func on each of n jobs (job i at (char *) jobs + i * size) and waits for all of them
+ * job 0 and jobs whose thread cannot be started run on the calling thread
+ */
+void thread_run(thread_func func, void *jobs, size_t size, size_t n);
+
+int mutex_init(mutex_t *mutex);
+void mutex_destroy(mutex_t *mutex);
+void mutex_lock(mutex_t *mutex);
+void mutex_unlock(mutex_t *mutex);
+
+int rwlock_init(rwlock_t *lock);
+void rwlock_destroy(rwlock_t *lock);
+void rwlock_rdlock(rwlock_t *lock);
+void rwlock_rdunlock(rwlock_t *lock);
+void rwlock_wrlock(rwlock_t *lock);
+void rwlock_wrunlock(rwlock_t *lock);
+
+int cond_init(cond_t *cond);
+void cond_destroy(cond_t *cond);
+void cond_wait(cond_t *cond, mutex_t *mutex);
+void cond_signal(cond_t *cond);
+void cond_broadcast(cond_t *cond);
+
+#endif
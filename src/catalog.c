@@ -0,0 +1,58 @@
+#include <stdlib.h>
+#include <string.h>
+#include <wctype.h>
+
+#include "catalog.h"
+
+catalog_t *catalog_new(void) {
+	return calloc(1, sizeof(catalog_t));
+}
+
+void catalog_free(catalog_t *catalog) {
+	if (catalog == NULL) return;
+	for (size_t i = 0; i < catalog->len; i++) {
+		if (catalog->entries[i].table != NULL) table_free(catalog->entries[i].table);
+	}
+	free(catalog->entries);
+	free(catalog);
+}
+
+catalog_entry_t *catalog_find(catalog_t const *catalog, wchar_t const *name) {
+	if (catalog == NULL || name == NULL) return NULL;
+	for (size_t i = 0; i < catalog->len; i++) {
+		if (wcscmp(catalog->entries[i].name, name) == 0) return &catalog->entries[i];
+	}
+	return NULL;
+}
+
+static int valid_name(wchar_t const *name) {
+	size_t len = 0;
+	while (name[len] != L'\0') {
+		if (iswspace((wint_t) name[len])) return 0;
+		len++;
+	}
+	return len > 0 && len <= CATALOG_NAME_LEN;
+}
+
+catalog_entry_t *catalog_add(catalog_t *catalog, wchar_t const *name) {
+	if (catalog == NULL || name == NULL || !valid_name(name)) return NULL;
+	catalog_entry_t *entry = catalog_find(catalog, name);
+	if (entry != NULL) return entry;
+	if (catalog->len == catalog->cap) {
+		size_t cap = catalog->cap < 4 ? 4 : catalog->cap * 2;
+		catalog_entry_t *grown = realloc(catalog->entries, cap * sizeof(catalog_entry_t));
+		if (grown == NULL) return NULL;
+		catalog->entries = grown;
+		catalog->cap = cap;
+	}
+	entry = &catalog->entries[catalog->len++];
+	memset(entry, 0, sizeof(*entry));
+	wcscpy(entry->name, name);
+	return entry;
+}
+
+void catalog_replace(catalog_entry_t *entry, table_t *table) {
+	if (entry == NULL) return;
+	if (entry->table != NULL && entry->table != table) table_free(entry->table);
+	entry->table = table;
+}
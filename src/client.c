@@ -0,0 +1,202 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "proto.h"
+
+#ifdef _WIN32
+
+int client_connect(char const *path, int *out_fd) { (void) path; (void) out_fd; return 0; }
+void client_close(int fd) { (void) fd; }
+int client_count(int fd, proto_count_t *out_count) { (void) fd; (void) out_count; return 0; }
+
+int client_scan(int fd, proto_scan_t req, dbrow_t *out_rows, size_t cap, proto_rows_t *out_info) {
+	(void) fd; (void) req; (void) out_rows; (void) cap; (void) out_info;
+	return 0;
+}
+
+int client_find(int fd, proto_find_t req, dbrow_t *out_rows, size_t cap, proto_rows_t *out_info) {
+	(void) fd; (void) req; (void) out_rows; (void) cap; (void) out_info;
+	return 0;
+}
+
+int client_sort(int fd, proto_sort_t req, dbrow_t *out_rows, size_t cap, proto_rows_t *out_info) {
+	(void) fd; (void) req; (void) out_rows; (void) cap; (void) out_info;
+	return 0;
+}
+
+int client_append(int fd, dbrow_t const *rows, size_t n, proto_count_t *out_count) {
+	(void) fd; (void) rows; (void) n; (void) out_count;
+	return 0;
+}
+
+int client_remove(int fd, uint64_t id) { (void) fd; (void) id; return 0; }
+int client_follow(int fd, proto_follow_t req) { (void) fd; (void) req; return 0; }
+
+int client_next_change(int fd, proto_change_t *out_change, dbrow_t **rows, size_t *cap) {
+	(void) fd; (void) out_change; (void) rows; (void) cap;
+	return 0;
+}
+
+#else
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+static int read_full(int fd, void *buf, size_t n) {
+	char *p = buf;
+	while (n > 0) {
+		ssize_t got = read(fd, p, n);
+		if (got < 0 && errno == EINTR) continue;
+		if (got <= 0) return 0;
+		p += got;
+		n -= (size_t) got;
+	}
+	return 1;
+}
+
+static int write_full(int fd, void const *buf, size_t n) {
+	char const *p = buf;
+	while (n > 0) {
+		ssize_t put = send(fd, p, n, MSG_NOSIGNAL);
+		if (put < 0 && errno == EINTR) continue;
+		if (put <= 0) return 0;
+		p += put;
+		n -= (size_t) put;
+	}
+	return 1;
+}
+
+// drops n bytes of unread payload so the connection stays usable
+static int skip(int fd, size_t n) {
+	char buf[4096];
+	while (n > 0) {
+		size_t chunk = n < sizeof(buf) ? n : sizeof(buf);
+		if (!read_full(fd, buf, chunk)) return 0;
+		n -= chunk;
+	}
+	return 1;
+}
+
+static int send_request(int fd, uint32_t op, void const *payload, size_t len) {
+	if (len > PROTO_MAX_PAYLOAD) return 0;
+	proto_header_t hdr = {.op = op, .len = (uint32_t) len};
+	return write_full(fd, &hdr, sizeof(hdr)) && (len == 0 || write_full(fd, payload, len));
+}
+
+/*
+ * reads response with payload of exactly `len` bytes (or empty on non-ok status)
+ */
+static int recv_fixed(int fd, void *out, size_t len) {
+	proto_header_t hdr;
+	if (!read_full(fd, &hdr, sizeof(hdr))) return 0;
+	if (hdr.op != PS_OK || hdr.len != len) {
+		skip(fd, hdr.len);
+		return 0;
+	}
+	return len == 0 || read_full(fd, out, len);
+}
+
+static int recv_rows(int fd, dbrow_t *out_rows, size_t cap, proto_rows_t *out_info) {
+	proto_header_t hdr;
+	proto_rows_t info;
+	if (!read_full(fd, &hdr, sizeof(hdr))) return 0;
+	if (hdr.op != PS_OK || hdr.len < sizeof(info)) goto bad_response;
+	if (!read_full(fd, &info, sizeof(info))) return 0;
+	hdr.len -= sizeof(info);
+	if (info.count > cap || info.count * sizeof(dbrow_t) != hdr.len) goto bad_response;
+	if (hdr.len > 0 && !read_full(fd, out_rows, hdr.len)) return 0;
+	if (out_info != NULL) *out_info = info;
+	return 1;
+bad_response:
+	skip(fd, hdr.len);
+	return 0;
+}
+
+int client_connect(char const *path, int *out_fd) {
+	struct sockaddr_un addr = {.sun_family = AF_UNIX};
+	if (path == NULL || out_fd == NULL || strlen(path) >= sizeof(addr.sun_path)) return 0;
+	strcpy(addr.sun_path, path);
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) return 0;
+	if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+		close(fd);
+		return 0;
+	}
+	*out_fd = fd;
+	return 1;
+}
+
+void client_close(int fd) {
+	if (fd >= 0) close(fd);
+}
+
+int client_count(int fd, proto_count_t *out_count) {
+	if (out_count == NULL) return 0;
+	return send_request(fd, OP_COUNT, NULL, 0) && recv_fixed(fd, out_count, sizeof(*out_count));
+}
+
+int client_scan(int fd, proto_scan_t req, dbrow_t *out_rows, size_t cap, proto_rows_t *out_info) {
+	if (out_rows == NULL) return 0;
+	if (req.limit == 0 || req.limit > cap) req.limit = cap;
+	return send_request(fd, OP_SCAN, &req, sizeof(req)) && recv_rows(fd, out_rows, cap, out_info);
+}
+
+int client_find(int fd, proto_find_t req, dbrow_t *out_rows, size_t cap, proto_rows_t *out_info) {
+	if (out_rows == NULL) return 0;
+	if (req.limit == 0 || req.limit > cap) req.limit = cap;
+	return send_request(fd, OP_FIND, &req, sizeof(req)) && recv_rows(fd, out_rows, cap, out_info);
+}
+
+int client_sort(int fd, proto_sort_t req, dbrow_t *out_rows, size_t cap, proto_rows_t *out_info) {
+	if (out_rows == NULL) return 0;
+	if (req.limit == 0 || req.limit > cap) req.limit = cap;
+	return send_request(fd, OP_SORT, &req, sizeof(req)) && recv_rows(fd, out_rows, cap, out_info);
+}
+
+int client_append(int fd, dbrow_t const *rows, size_t n, proto_count_t *out_count) {
+	if (rows == NULL || n == 0 || n > PROTO_MAX_ROWS) return 0;
+	proto_count_t count;
+	if (!send_request(fd, OP_APPEND, rows, n * sizeof(dbrow_t))) return 0;
+	if (!recv_fixed(fd, &count, sizeof(count))) return 0;
+	if (out_count != NULL) *out_count = count;
+	return 1;
+}
+
+int client_remove(int fd, uint64_t id) {
+	return send_request(fd, OP_REMOVE, &id, sizeof(id)) && recv_fixed(fd, NULL, 0);
+}
+
+int client_follow(int fd, proto_follow_t req) {
+	return send_request(fd, OP_FOLLOW, &req, sizeof(req));
+}
+
+int client_next_change(int fd, proto_change_t *out_change, dbrow_t **rows, size_t *cap) {
+	proto_header_t hdr;
+	proto_change_t change;
+	if (out_change == NULL || rows == NULL || cap == NULL) return 0;
+	if (!read_full(fd, &hdr, sizeof(hdr))) return 0;
+	if (hdr.op != PS_OK || hdr.len < sizeof(change)) goto bad_response;
+	if (!read_full(fd, &change, sizeof(change))) return 0;
+	hdr.len -= sizeof(change);
+	if (change.count > PROTO_MAX_ROWS || change.count * sizeof(dbrow_t) != hdr.len) goto bad_response;
+	if (change.count > *cap) {
+		dbrow_t *grown = realloc(*rows, change.count * sizeof(dbrow_t));
+		if (grown == NULL) goto bad_response;
+		*rows = grown;
+		*cap = change.count;
+	}
+	if (hdr.len > 0 && !read_full(fd, *rows, hdr.len)) return 0;
+	*out_change = change;
+	return 1;
+bad_response:
+	skip(fd, hdr.len);
+	return 0;
+}
+
+#endif
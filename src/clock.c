@@ -0,0 +1,13 @@
+#include <time.h>
+
+#include "clock.h"
+
+uint64_t clock_ns(void) {
+	struct timespec ts;
+#if defined(CLOCK_MONOTONIC) && !defined(_WIN32)
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+#else
+	timespec_get(&ts, TIME_UTC);
+#endif
+	return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
@@ -0,0 +1,101 @@
+#include <string.h>
+
+#include "collate.h"
+#include "defs.h"
+#include "thread.h"
+
+#define W_SPACE 1
+#define W_PUNCT 2 // + index in PUNCTS
+#define W_DIGIT 48
+#define W_LATIN 64
+#define W_CYRILLIC 96
+#define W_OTHER 255
+
+// rows per thread below which collate_rows stays on the calling thread
+#define COLLATE_PARALLEL_ROWS 16384
+#define COLLATE_MAX_THREADS 64
+
+static uint8_t weight(wchar_t c, int *out_diacritic, int *out_upper) {
+	*out_diacritic = 0;
+	*out_upper = 0;
+	if (c == L' ') return W_SPACE;
+	if (c >= L'0' && c <= L'9') return (uint8_t) (W_DIGIT + (c - L'0'));
+	if (c >= L'a' && c <= L'z') return (uint8_t) (W_LATIN + (c - L'a'));
+	if (c >= L'A' && c <= L'Z') {
+		*out_upper = 1;
+		return (uint8_t) (W_LATIN + (c - L'A'));
+	}
+	// а-я U+0430..U+044F, А-Я U+0410..U+042F, ё U+0451, Ё U+0401
+	if (c >= 0x0430 && c <= 0x044F) return (uint8_t) (W_CYRILLIC + (c - 0x0430));
+	if (c >= 0x0410 && c <= 0x042F) {
+		*out_upper = 1;
+		return (uint8_t) (W_CYRILLIC + (c - 0x0410));
+	}
+	if (c == 0x0451 || c == 0x0401) {
+		*out_diacritic = 1;
+		*out_upper = c == 0x0401;
+		return (uint8_t) (W_CYRILLIC + (0x0435 - 0x0430));
+	}
+	wchar_t const *p = c != L'\0' ? wcschr(PUNCTS, c) : NULL;
+	if (p != NULL) return (uint8_t) (W_PUNCT + (p - PUNCTS));
+	return W_OTHER;
+}
+
+void collate_key(wchar_t const *str, size_t maxlen, uint8_t *out_key) {
+	size_t nbits = (maxlen + 7) / 8;
+	uint8_t *diacritics = out_key + maxlen, *upper = diacritics + nbits;
+	memset(out_key, 0, COLLATE_KEY_SIZE(maxlen));
+	for (size_t i = 0; i < maxlen && str[i] != L'\0'; i++) {
+		int d, u;
+		out_key[i] = weight(str[i], &d, &u);
+		if (d) diacritics[i / 8] |= (uint8_t) (0x80 >> (i % 8));
+		if (u) upper[i / 8] |= (uint8_t) (0x80 >> (i % 8));
+	}
+}
+
+#define COLLATE_FIELD(row, name, tag, kind, len, charset) COLLATE_FIELD_##kind(row, name, len)
+#define COLLATE_FIELD_UINT(row, name, len)
+#define COLLATE_FIELD_INT(row, name, len)
+#define COLLATE_FIELD_FLOAT(row, name, len)
+#define COLLATE_FIELD_BOOL(row, name, len)
+#define COLLATE_FIELD_STR(row, name, len) collate_key((row)->name, len, (row)->name##_key);
+
+void collate_row(dbrow_t *row) {
+	TABLE_SCHEMA(COLLATE_FIELD, row)
+}
+
+typedef struct {
+	dbrow_t *rows;
+	size_t n;
+} collate_job_t;
+
+static void collate_worker(void *arg) {
+	collate_job_t *job = arg;
+	for (size_t i = 0; i < job->n; i++) collate_row(&job->rows[i]);
+}
+
+void collate_rows(dbrow_t *rows, size_t n) {
+	collate_job_t jobs[COLLATE_MAX_THREADS];
+	size_t threads = n / COLLATE_PARALLEL_ROWS, hint = thread_count_hint();
+	if (threads > hint) threads = hint;
+	if (threads > COLLATE_MAX_THREADS) threads = COLLATE_MAX_THREADS;
+	if (threads < 2) {
+		for (size_t i = 0; i < n; i++) collate_row(&rows[i]);
+		return;
+	}
+	for (size_t t = 0, from = 0; t < threads; t++) {
+		size_t to = n / threads * (t + 1);
+		if (t + 1 == threads) to = n;
+		jobs[t] = (collate_job_t) {rows + from, to - from};
+		from = to;
+	}
+	thread_run(collate_worker, jobs, sizeof(collate_job_t), threads);
+}
+
+int collate_cmp(wchar_t const *a, wchar_t const *b, size_t maxlen) {
+	uint8_t ka[COLLATE_KEY_SIZE(TABLE_STR_MAXLEN)], kb[COLLATE_KEY_SIZE(TABLE_STR_MAXLEN)];
+	if (maxlen > TABLE_STR_MAXLEN) maxlen = TABLE_STR_MAXLEN;
+	collate_key(a, maxlen, ka);
+	collate_key(b, maxlen, kb);
+	return memcmp(ka, kb, COLLATE_KEY_SIZE(maxlen));
+}
@@ -0,0 +1,440 @@
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+#include "csv.h"
+#include "defs.h"
+#include "get.h"
+#include "parse.h"
+#include "stats.h"
+#include "thread.h"
+
+// longer fields are invalid anyway, the longest valid one is a double or a STR column
+#define FIELD_CAP (TABLE_STR_MAXLEN + 1 > 64 ? TABLE_STR_MAXLEN + 1 : 64)
+// do not split input into chunks smaller than this
+#define MIN_CHUNK_BYTES (64 * 1024)
+// rows formatted by one export job per round
+#define EXPORT_RUN_ROWS 16384
+// upper bound of one formatted field: longest %f of a double is about 320 bytes,
+// strings take at most 6 bytes per character plus quotes
+#define FIELD_BYTES_UINT(len) 24
+#define FIELD_BYTES_INT(len) 24
+#define FIELD_BYTES_FLOAT(len) 320
+#define FIELD_BYTES_BOOL(len) 1
+#define FIELD_BYTES_STR(len) (6 * (len) + 2)
+#define ROW_BYTES(a, name, tag, kind, len, charset) + FIELD_BYTES_##kind(len) + 1
+// upper bound of one formatted row
+#define MAX_ROW_BYTES (0 TABLE_SCHEMA(ROW_BYTES, _))
+
+typedef struct {
+	char const *begin, *end; // whole lines
+	char sep;
+	int first; // chunk starts the input, may hold a header
+	dbrow_t *rows;
+	size_t len, cap;
+	size_t lines; // lines read so far
+	wchar_t const *error; // NULL if all lines parsed
+} import_job_t;
+
+typedef struct {
+	dbrow_t const *rows;
+	size_t n;
+	char sep;
+	char *buf;
+	size_t len, cap;
+	int ok;
+} export_job_t;
+
+/*
+ * decodes one code point from [p, end)
+ * returns number of bytes used, 0 on invalid or truncated input
+ */
+static size_t utf8_decode(unsigned char const *p, unsigned char const *end, uint32_t *out) {
+	uint32_t c = p[0];
+	size_t n;
+	if (c < 0x80) {
+		*out = c;
+		return 1;
+	}
+	else if ((c & 0xe0) == 0xc0) { n = 2; c &= 0x1f; }
+	else if ((c & 0xf0) == 0xe0) { n = 3; c &= 0x0f; }
+	else if ((c & 0xf8) == 0xf0) { n = 4; c &= 0x07; }
+	else { return 0; }
+	if ((size_t) (end - p) < n) return 0;
+	for (size_t i = 1; i < n; i++) {
+		if ((p[i] & 0xc0) != 0x80) return 0;
+		c = (c << 6) | (p[i] & 0x3f);
+	}
+	// overlong forms, surrogates and out of range
+	static uint32_t const min[] = {0, 0, 0x80, 0x800, 0x10000};
+	if (c < min[n] || (c >= 0xd800 && c <= 0xdfff) || c > 0x10ffff) return 0;
+	*out = c;
+	return n;
+}
+
+static size_t utf8_encode(uint32_t c, char *out) {
+	if (c < 0x80) {
+		out[0] = (char) c;
+		return 1;
+	}
+	if (c < 0x800) {
+		out[0] = (char) (0xc0 | (c >> 6));
+		out[1] = (char) (0x80 | (c & 0x3f));
+		return 2;
+	}
+	if (c < 0x10000) {
+		out[0] = (char) (0xe0 | (c >> 12));
+		out[1] = (char) (0x80 | ((c >> 6) & 0x3f));
+		out[2] = (char) (0x80 | (c & 0x3f));
+		return 3;
+	}
+	out[0] = (char) (0xf0 | (c >> 18));
+	out[1] = (char) (0x80 | ((c >> 12) & 0x3f));
+	out[2] = (char) (0x80 | ((c >> 6) & 0x3f));
+	out[3] = (char) (0x80 | (c & 0x3f));
+	return 4;
+}
+
+/*
+ * reads one field of [*p, end) into out (terminated, at most FIELD_CAP - 1 characters)
+ * *p is left at the separator or at end
+ * returns 1 on success, 0 on failure
+ */
+static int read_field(char const **p, char const *end, char sep, wchar_t *out, size_t *out_len) {
+	unsigned char const *s = (unsigned char const *) *p, *e = (unsigned char const *) end;
+	int quoted = sep == ',' && s < e && *s == '"';
+	size_t len = 0;
+	if (quoted) s++;
+	for (;;) {
+		if (s == e) {
+			if (quoted) return 0; // no closing quote
+			break;
+		}
+		if (quoted && *s == '"') {
+			if (s + 1 < e && s[1] == '"') { s++; }
+			else {
+				s++;
+				if (s != e && *s != (unsigned char) sep) return 0;
+				break;
+			}
+		}
+		else if (!quoted && *s == (unsigned char) sep) {
+			break;
+		}
+		uint32_t c;
+		size_t n = utf8_decode(s, e, &c);
+		if (n == 0 || c > WCHAR_MAX || len == FIELD_CAP - 1) return 0;
+		out[len++] = (wchar_t) c;
+		s += n;
+	}
+	out[len] = L'\0';
+	*out_len = len;
+	*p = (char const *) s;
+	return 1;
+}
+
+/*
+ * parses line [p, end) without its line break into row
+ * returns NULL on success, error message otherwise
+ */
+#define PARSE_FIELD(row, name, tag, kind, len, charset) \
+	case tag: ok = parse_##name(field, n, SCHEMA_REF_##kind((row)->name)); break;
+
+static wchar_t const *parse_row(char const *p, char const *end, char sep, dbrow_t *row) {
+	wchar_t field[FIELD_CAP];
+	size_t n;
+	memset(row, 0, sizeof(dbrow_t));
+	for (size_t f = 0; f < TABLE_NCOLUMNS; f++) {
+		if (f > 0) {
+			if (p == end) return L"Too few fields";
+			p++; // separator
+		}
+		// blank id is filled in when the chunks are joined
+		wchar_t const *error = f == TC_ID ? L"id: Uint or blank expected" : get_column_error((column_t) f);
+		if (!read_field(&p, end, sep, field, &n)) return error;
+		int ok = 0;
+		if (f == TC_ID && n == 0) {
+			ok = 1;
+		}
+		else {
+			switch ((column_t) f) {
+			TABLE_SCHEMA(PARSE_FIELD, row)
+			}
+		}
+		if (!ok) return error;
+	}
+	return p == end ? NULL : L"Too many fields";
+}
+
+static int is_header(char const *p, char const *end, char sep) {
+	return end - p >= 3 && p[0] == 'i' && p[1] == 'd' && p[2] == sep;
+}
+
+static void import_worker(void *arg) {
+	import_job_t *job = arg;
+	char const *p = job->begin;
+	while (p < job->end) {
+		char const *eol = memchr(p, '\n', (size_t) (job->end - p));
+		char const *next = eol != NULL ? eol + 1 : job->end;
+		if (eol == NULL) eol = job->end;
+		if (eol > p && eol[-1] == '\r') eol--;
+		job->lines++;
+		if (eol == p || (job->first && job->lines == 1 && is_header(p, eol, job->sep))) {
+			p = next;
+			continue;
+		}
+		if (job->len == job->cap) {
+			size_t cap = job->cap < 1024 ? 1024 : job->cap * 2;
+			dbrow_t *grown = realloc(job->rows, cap * sizeof(dbrow_t));
+			if (grown == NULL) {
+				job->error = L"Out of memory";
+				return;
+			}
+			job->rows = grown;
+			job->cap = cap;
+		}
+		job->error = parse_row(p, eol, job->sep, &job->rows[job->len]);
+		if (job->error != NULL) return;
+		job->len++;
+		p = next;
+	}
+}
+
+// reads all of fin, returns NULL on failure
+static char *read_all(FILE *fin, size_t *out_len) {
+	size_t len = 0, cap = 1 << 16;
+	char *buf = malloc(cap);
+	if (buf == NULL) return NULL;
+	for (;;) {
+		len += fread(buf + len, 1, cap - len, fin);
+		if (len < cap) break;
+		char *grown = cap * 2 > cap ? realloc(buf, cap * 2) : NULL;
+		if (grown == NULL) goto no_memory;
+		buf = grown;
+		cap *= 2;
+	}
+	if (ferror(fin)) goto no_memory;
+	*out_len = len;
+	return buf;
+no_memory:
+	free(buf);
+	return NULL;
+}
+
+/*
+ * rows are kept in ascending id order, an input in any other order is sorted by id
+ * returns 1 on success, 0 on duplicate ids or out of memory (reported to ferr)
+ */
+static int append_sorted(table_t *table, import_job_t const *jobs, size_t njobs, size_t total, FILE *ferr) {
+	dbrow_t *rows = malloc(total * sizeof(dbrow_t));
+	if (rows == NULL) {
+		afprintf(ferr, L"Out of memory\n");
+		return 0;
+	}
+	size_t n = 0;
+	for (size_t t = 0; t < njobs; t++) {
+		memcpy(rows + n, jobs[t].rows, jobs[t].len * sizeof(dbrow_t));
+		n += jobs[t].len;
+	}
+	table_sort_t by_id = {.column = TC_ID, .direction = S_ASC};
+	int ok = table_sort_rows(rows, n, by_id);
+	for (size_t i = 1; ok && i < n; i++) {
+		if (rows[i].id == rows[i - 1].id) {
+			afprintf(ferr, L"Duplicate id %zu\n", rows[i].id);
+			ok = 0;
+		}
+	}
+	if (ok && !table_append_batch(table, rows, n)) {
+		afprintf(ferr, L"Out of memory\n");
+		ok = 0;
+	}
+	free(rows);
+	return ok;
+}
+
+int csv_import(FILE *fin, FILE *ferr, char sep, size_t threads, table_t **out_table) {
+	if (fin == NULL || out_table == NULL || (sep != ',' && sep != '\t')) return 0;
+	STATS_START(stats_t0);
+	size_t size;
+	char *data = read_all(fin, &size);
+	if (data == NULL) {
+		afprintf(ferr, L"Cannot read input\n");
+		return 0;
+	}
+	char const *begin = data, *end = data + size;
+	if (size >= 3 && memcmp(begin, "\xef\xbb\xbf", 3) == 0) begin += 3;
+	if (threads == 0) threads = thread_count_hint();
+	if (threads > (size_t) (end - begin) / MIN_CHUNK_BYTES + 1) threads = (size_t) (end - begin) / MIN_CHUNK_BYTES + 1;
+	int ok = 0;
+	table_t *table = NULL;
+	import_job_t *jobs = calloc(threads, sizeof(import_job_t));
+	if (jobs == NULL) goto no_jobs;
+	// chunk boundaries move forward to the next line start
+	char const *from = begin;
+	for (size_t t = 0; t < threads; t++) {
+		char const *to = t + 1 == threads ? end : begin + (size_t) (end - begin) / threads * (t + 1);
+		if (to < from) to = from;
+		char const *eol = to < end ? memchr(to, '\n', (size_t) (end - to)) : NULL;
+		if (t + 1 < threads) to = eol != NULL ? eol + 1 : end;
+		jobs[t] = (import_job_t) {.begin = from, .end = to, .sep = sep, .first = t == 0};
+		from = to;
+	}
+	thread_run(import_worker, jobs, sizeof(import_job_t), threads);
+	size_t total = 0, lines = 0;
+	for (size_t t = 0; t < threads; t++) {
+		if (jobs[t].error != NULL) {
+			afprintf(ferr, L"Line %zu: "WSTR_FMT"\n", lines + jobs[t].lines, jobs[t].error);
+			goto bad_input;
+		}
+		lines += jobs[t].lines;
+		total += jobs[t].len;
+	}
+	table = table_new(total > 0 ? total : 1);
+	if (table == NULL) goto bad_input;
+	size_t next_id = 1;
+	for (size_t t = 0; t < threads; t++) {
+		for (size_t i = 0; i < jobs[t].len; i++) {
+			if (jobs[t].rows[i].id >= next_id) next_id = jobs[t].rows[i].id + 1;
+		}
+	}
+	// blank ids are numbered in input order after the largest given one
+	int ascending = 1;
+	dbrow_t const *prev = NULL;
+	for (size_t t = 0; t < threads; t++) {
+		for (size_t i = 0; i < jobs[t].len; i++) {
+			if (jobs[t].rows[i].id == 0) jobs[t].rows[i].id = next_id++;
+		}
+		if (ascending) ascending = table_ids_ascend(prev, jobs[t].rows, jobs[t].len);
+		if (jobs[t].len > 0) prev = &jobs[t].rows[jobs[t].len - 1];
+	}
+	int appended = 1;
+	if (ascending) {
+		for (size_t t = 0; appended && t < threads; t++) {
+			appended = table_append_batch(table, jobs[t].rows, jobs[t].len);
+		}
+		if (!appended) afprintf(ferr, L"Out of memory\n");
+	}
+	else {
+		appended = append_sorted(table, jobs, threads, total, ferr);
+	}
+	if (!appended) {
+		table_free(table);
+		goto bad_input;
+	}
+	table->next_id = next_id;
+	*out_table = table;
+	ok = 1;
+	STATS_END(ST_LOAD, stats_t0, total, size, 0);
+bad_input:
+	for (size_t t = 0; t < threads; t++) free(jobs[t].rows);
+	free(jobs);
+no_jobs:
+	free(data);
+	return ok;
+}
+
+static void put_str(export_job_t *job, wchar_t const *s, size_t cap) {
+	size_t len = 0;
+	int quote = 0;
+	while (len < cap && s[len] != L'\0') {
+		if (job->sep == ',' && (s[len] == L',' || s[len] == L'"')) quote = 1;
+		len++;
+	}
+	if (quote) job->buf[job->len++] = '"';
+	for (size_t i = 0; i < len; i++) {
+		if (quote && s[i] == L'"') job->buf[job->len++] = '"';
+		job->len += utf8_encode((uint32_t) s[i], job->buf + job->len);
+	}
+	if (quote) job->buf[job->len++] = '"';
+}
+
+#define PUT_UINT(v, maxlen) \
+	job->len += (size_t) snprintf(job->buf + job->len, job->cap - job->len, "%zu", (size_t) (v));
+#define PUT_INT(v, maxlen) \
+	job->len += (size_t) snprintf(job->buf + job->len, job->cap - job->len, "%lld", (long long) (v));
+#define PUT_FLOAT(v, maxlen) \
+	job->len += (size_t) snprintf(job->buf + job->len, job->cap - job->len, "%f", (double) (v));
+#define PUT_BOOL(v, maxlen) job->buf[job->len++] = (v) ? '1' : '0';
+#define PUT_STR(v, maxlen) put_str(job, (v), (maxlen) + 1);
+#define PUT_FIELD(row, name, tag, kind, maxlen, charset) PUT_##kind((row)->name, maxlen)
+#define PUT_NEXT_FIELD(row, name, tag, kind, maxlen, charset) \
+	job->buf[job->len++] = job->sep; \
+	PUT_##kind((row)->name, maxlen)
+
+static void export_worker(void *arg) {
+	export_job_t *job = arg;
+	job->len = 0;
+	for (size_t i = 0; i < job->n; i++) {
+		if (job->cap - job->len < MAX_ROW_BYTES) {
+			size_t cap = job->cap * 2 > job->len + MAX_ROW_BYTES ? job->cap * 2 : job->len + MAX_ROW_BYTES;
+			char *grown = realloc(job->buf, cap);
+			if (grown == NULL) {
+				job->ok = 0;
+				return;
+			}
+			job->buf = grown;
+			job->cap = cap;
+		}
+		dbrow_t const *row = &job->rows[i];
+		TABLE_SCHEMA_ID(PUT_FIELD, row)
+		TABLE_SCHEMA_DATA(PUT_NEXT_FIELD, row)
+		job->buf[job->len++] = '\n';
+	}
+	job->ok = 1;
+}
+
+#define HEADER_FIRST(a, name, tag, kind, len, charset) #name
+#define HEADER_NEXT(a, name, tag, kind, len, charset) "," #name
+#define HEADER TABLE_SCHEMA_ID(HEADER_FIRST, _) TABLE_SCHEMA_DATA(HEADER_NEXT, _) "\n"
+
+int csv_export_header(FILE *fout, char sep) {
+	if (fout == NULL || (sep != ',' && sep != '\t')) return 0;
+	char header[] = HEADER;
+	for (size_t i = 0; header[i] != '\0'; i++) {
+		if (header[i] == ',') header[i] = sep;
+	}
+	return fputs(header, fout) != EOF;
+}
+
+// adds bytes written to *bytes
+static int export_rows(FILE *fout, dbrow_t const *rows, size_t len, char sep, size_t threads, size_t *bytes) {
+	if (threads == 0) threads = thread_count_hint();
+	if (threads > len / EXPORT_RUN_ROWS + 1) threads = len / EXPORT_RUN_ROWS + 1;
+	export_job_t *jobs = calloc(threads, sizeof(export_job_t));
+	if (jobs == NULL) return 0;
+	int ok = 1;
+	// each round formats threads * EXPORT_RUN_ROWS rows, buffers are reused
+	for (size_t pos = 0; ok && pos < len;) {
+		size_t n = 0;
+		for (; n < threads && pos < len; n++) {
+			jobs[n].rows = rows + pos;
+			jobs[n].n = len - pos < EXPORT_RUN_ROWS ? len - pos : EXPORT_RUN_ROWS;
+			jobs[n].sep = sep;
+			pos += jobs[n].n;
+		}
+		thread_run(export_worker, jobs, sizeof(export_job_t), n);
+		for (size_t t = 0; ok && t < n; t++) {
+			ok = jobs[t].ok && fwrite(jobs[t].buf, 1, jobs[t].len, fout) == jobs[t].len;
+			*bytes += jobs[t].len;
+		}
+	}
+	for (size_t t = 0; t < threads; t++) free(jobs[t].buf);
+	free(jobs);
+	return ok;
+}
+
+int csv_export_rows(FILE *fout, dbrow_t const *rows, size_t n, char sep, size_t threads) {
+	size_t bytes = 0;
+	if (fout == NULL || (rows == NULL && n > 0) || (sep != ',' && sep != '\t')) return 0;
+	return export_rows(fout, rows, n, sep, threads, &bytes);
+}
+
+int csv_export(FILE *fout, table_t const *table, char sep, size_t threads) {
+	if (fout == NULL || table == NULL || (sep != ',' && sep != '\t')) return 0;
+	STATS_START(stats_t0);
+	if (!csv_export_header(fout, sep)) return 0;
+	size_t len = TABLE_ROWS_LEN(table), bytes = sizeof(HEADER) - 1;
+	int ok = export_rows(fout, table->rows, len, sep, threads, &bytes) && fflush(fout) == 0;
+	STATS_END(ST_PRINT, stats_t0, len, 0, bytes);
+	return ok;
+}
@@ -0,0 +1,106 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dump.h"
+#include "parse.h"
+#include "get.h"
+#include "stats.h"
+
+FILE *wide_fopen(wchar_t const *path, wchar_t const *mode) {
+#ifdef _MSC_VER
+	return _wfopen(path, mode);
+#else
+	// usually there is some character limits in the os/fs
+	// if that's not the case - feel free to redefine MAX_FILE_PATH
+	// or even add heap-allocated temporary strings instead of mbname, mbmode
+	char mbpath[MAX_FILE_PATH];
+	char mbmode[MAX_FILE_PATH];
+	mbstate_t state = {0};
+	size_t len = 1 + wcsrtombs(NULL, &path, 0, &state);
+	if (len >= MAX_FILE_PATH) return NULL;
+	if (wcsrtombs(mbpath, &path, len, &state) == (size_t) -1) return NULL;
+	state = (mbstate_t) {0};
+	len = 1 + wcsrtombs(NULL, &mode, 0, &state);
+	if (len >= MAX_FILE_PATH) return NULL;
+	if (wcsrtombs(mbmode, &mode, len, &state) == (size_t) -1) return NULL;
+	FILE *fd = fopen(mbpath, mbmode);
+	// binary streams stay byte-oriented
+	if (fd != NULL && strchr(mbmode, 'b') == NULL) fwide(fd, 1);
+	return fd;
+#endif
+}
+
+#define ADD_FIELD(row, name, tag, kind, len, charset) \
+	if (get_##name(fin, fout, ferr, line, NULL, NULL, interactive, SCHEMA_REF_##kind(row.name)) == 0) { \
+		goto add_cancel; \
+	}
+
+int add_row(FILE *fin, FILE *fout, FILE *ferr, table_t *table, wchar_t *line, int interactive) {
+	size_t id;
+	if (interactive) { id = table->next_id++; }
+	else if (get_id(fin, fout, ferr, line, NULL, NULL, interactive, &id) == 0) { goto add_cancel; }
+	dbrow_t row = {.id = id};
+	TABLE_SCHEMA_DATA(ADD_FIELD, row)
+	table_append(table, row);
+	return 1;
+add_cancel:
+	afprintf(fout, L"Cancelled\n");
+	return 0;
+}
+
+#ifdef WITH_STATS
+// bytes moved through a seekable stream since `from`, 0 for pipes and terminals
+static uint64_t stream_delta(FILE *stream, long from) {
+	long to = stream != NULL ? ftell(stream) : -1;
+	return from >= 0 && to >= from ? (uint64_t) (to - from) : 0;
+}
+#endif
+
+int print_table(FILE *fout, FILE *ferr, table_t const *table, int dump) {
+	wchar_t const *fmt = dump ? ROW_DUMP_FORMAT : ROW_HUMAN_FORMAT;
+	if (table == NULL || table->rows == NULL || table->len == 0) {
+		afprintf(ferr, L"No table\n");
+		return 0;
+	}
+	STATS_START(start);
+#ifdef WITH_STATS
+	long pos = fout != NULL ? ftell(fout) : -1;
+#endif
+	if (dump) {
+		afprintf(fout, L"%zu\n%zu\n", table->len, table->next_id);
+	}
+	else {
+		afprintf(fout, ROW_HEADER);
+	}
+	for (size_t i = 0; i < table->len; i++) {
+		dbrow_t row = table->rows[i];
+		afprintf(fout, fmt, ROW_ARG(row));
+	}
+	STATS_END(ST_PRINT, start, table->len, 0, stream_delta(fout, pos));
+	return 1;
+}
+
+int load_table(FILE *fin, FILE *ferr, table_t **out_table, wchar_t *line) {
+	if (fin == NULL || out_table == NULL) return 0;
+	STATS_START(start);
+#ifdef WITH_STATS
+	long pos = ftell(fin);
+#endif
+	size_t table_len = 0, table_next_id = 0;
+	fgetws(line, MAX_LINE_SIZE, fin);
+	wparse_uint(line, &table_len);
+	fgetws(line, MAX_LINE_SIZE, fin);
+	wparse_uint(line, &table_next_id);
+	table_t *table = table_new(table_len);
+	table->next_id = table_next_id;
+	for (size_t i = 0; i < table_len; i++) {
+		if (add_row(fin, NULL, ferr, table, line, 0) == 0) {
+			table_free(table);
+			return 0;
+		}
+	}
+	*out_table = table;
+	STATS_END(ST_LOAD, start, table_len, stream_delta(fin, pos), 0);
+	return 1;
+}
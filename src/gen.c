@@ -0,0 +1,134 @@
+#include <math.h>
+#include <string.h>
+#include <wchar.h>
+
+#include "gen.h"
+#include "defs.h"
+
+static uint64_t splitmix64(uint64_t *state) {
+	uint64_t z = (*state += 0x9E3779B97F4A7C15u);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9u;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBu;
+	return z ^ (z >> 31);
+}
+
+// [0, 1)
+static double unit(gen_t *gen) {
+	return (gen_next(gen) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// [0, 1) shaped by dist
+static double shaped(gen_t *gen, gen_dist_t dist) {
+	switch (dist) {
+	default:
+	case GD_UNIFORM: return unit(gen);
+	case GD_NORMAL: {
+		// Box-Muller, mean 0.5, sd 1/6, clamped
+		double u1 = unit(gen), u2 = unit(gen);
+		double z = sqrt(-2.0 * log(1.0 - u1)) * cos(6.283185307179586 * u2);
+		double v = 0.5 + z / 6.0;
+		return v < 0.0 ? 0.0 : v >= 1.0 ? 0.9999999999 : v;
+	}
+	case GD_SKEWED: {
+		// most of the mass near 0
+		double u = unit(gen);
+		return u * u * u;
+	}
+	}
+}
+
+static wchar_t const c3_alph[] = DIGITS ALPH_EN ALPH_RU;
+static wchar_t const *const c5_words[] = {
+	L"alpha", L"beta", L"gamma", L"delta", L"omega", L"станок", L"деталь", L"заказ",
+	L"склад", L"цех", L"order", L"item", L"part", L"ready", L"готов", L"брак",
+};
+
+// k-th distinct c3 value
+static void c3_value(uint64_t k, wchar_t *out) {
+	uint64_t st = k;
+	size_t alen = sizeof(c3_alph) / sizeof(*c3_alph) - 1;
+	size_t len = 4 + splitmix64(&st) % 13; // 4..16
+	for (size_t i = 0; i < len; i++) out[i] = c3_alph[splitmix64(&st) % alen];
+	out[len] = L'\0';
+}
+
+// k-th distinct c5 value
+static void c5_value(uint64_t k, wchar_t *out) {
+	uint64_t st = k ^ 0x5555555555555555u;
+	size_t nwords = sizeof(c5_words) / sizeof(*c5_words);
+	size_t len = 0;
+	size_t want = 1 + splitmix64(&st) % 4;
+	for (size_t w = 0; w < want; w++) {
+		wchar_t const *word = c5_words[splitmix64(&st) % nwords];
+		size_t wl = wcslen(word);
+		if (len + (len > 0) + wl + 4 > 32) break;
+		if (len > 0) out[len++] = L' ';
+		wmemcpy(out + len, word, wl);
+		len += wl;
+	}
+	// numeric suffix keeps distinct k distinct in most cases
+	unsigned suffix = (unsigned) (k % 1000);
+	out[len++] = L'0' + suffix / 100;
+	out[len++] = L'0' + suffix / 10 % 10;
+	out[len++] = L'0' + suffix % 10;
+	out[len] = L'\0';
+}
+
+gen_params_t gen_default_params(void) {
+	return (gen_params_t) {
+		.c3_card = 1000,
+		.c5_card = 10000,
+		.c1_dist = GD_UNIFORM,
+		.c2_dist = GD_UNIFORM,
+		.c1_min = -1000000,
+		.c1_max = 1000000,
+		.c2_min = 0.0,
+		.c2_max = 1000.0,
+	};
+}
+
+void gen_init(gen_t *gen, gen_params_t params, uint64_t seed) {
+	gen->state = seed;
+	gen->params = params;
+}
+
+uint64_t gen_next(gen_t *gen) {
+	return splitmix64(&gen->state);
+}
+
+// every column has a generator below, a new column needs one as well
+_Static_assert(TABLE_NCOLUMNS == 6, "gen_row fills id and c1..c5 only");
+_Static_assert(sizeof(((dbrow_t *) 0)->c3) >= 17 * sizeof(wchar_t)
+	&& sizeof(((dbrow_t *) 0)->c5) >= 33 * sizeof(wchar_t), "c3_value and c5_value write up to 16 and 32 characters");
+
+void gen_row(gen_t *gen, size_t id, dbrow_t *out_row) {
+	gen_params_t const *p = &gen->params;
+	dbrow_t row = {.id = id};
+	double range1 = (double) p->c1_max - (double) p->c1_min;
+	row.c1 = p->c1_min + (int64_t) (shaped(gen, p->c1_dist) * range1);
+	row.c2 = p->c2_min + shaped(gen, p->c2_dist) * (p->c2_max - p->c2_min);
+	uint64_t k3 = gen_next(gen);
+	c3_value(p->c3_card ? k3 % p->c3_card : k3, row.c3);
+	row.c4 = gen_next(gen) & 1;
+	uint64_t k5 = gen_next(gen);
+	c5_value(p->c5_card ? k5 % p->c5_card : k5, row.c5);
+	*out_row = row;
+}
+
+int gen_parse_dist(char const *name, gen_dist_t *out_dist) {
+	if (name == NULL || out_dist == NULL) return 0;
+	if (strcmp(name, "uniform") == 0) { *out_dist = GD_UNIFORM; }
+	else if (strcmp(name, "normal") == 0) { *out_dist = GD_NORMAL; }
+	else if (strcmp(name, "skewed") == 0) { *out_dist = GD_SKEWED; }
+	else { return 0; }
+	return 1;
+}
+
+char const *gen_dist_name(gen_dist_t dist) {
+	switch (dist) {
+	default: return "?";
+	case GD_UNIFORM: return "uniform";
+	case GD_NORMAL: return "normal";
+	case GD_SKEWED: return "skewed";
+	}
+}
@@ -82,16 +82,7 @@ int get_bool(FILE *fin, FILE *fout, FILE *ferr, wchar_t *line, wchar_t const *pr
 	do {
 		if (prompt != NULL) afprintf(fout, WSTR_FMT, prompt);
 		fgetws(line, MAX_LINE_SIZE, fin);
-		if (PROMPT(L"") || PROMPT(L"0") || PROMPT(L"F") || PROMPT(L"f")
-			|| PROMPT(L"OFF") || PROMPT(L"off")
-			|| PROMPT(L"FALSE") || PROMPT(L"false")) {
-			*out_result = 0;
-			break;
-		}
-		else if (PROMPT(L"1") || PROMPT(L"T") || PROMPT(L"t")
-			|| PROMPT(L"ON") || PROMPT(L"on")
-			|| PROMPT(L"TRUE") || PROMPT(L"true")) {
-			*out_result = 1;
+		if (wparse_bool(line, out_result)) {
 			break;
 		}
 		else if (interactive) {
@@ -118,13 +109,9 @@ int get_str(FILE *fin, FILE *fout, FILE *ferr, wchar_t *line, wchar_t const *pro
 	do {
 		afprintf(fout, WSTR_FMT, prompt);
 		fgetws(line, MAX_LINE_SIZE, fin);
-		int good = 1;
-		for (size_t i = 0; i < MAX_LINE_SIZE && line[i] != L'\0' && line[i] != L'\n'; i++) {
-			if (i >= maxlen || wcschr(whitelist, line[i]) == NULL) {
-				good = 0;
-				break;
-			}
-		}
+		size_t len = 0;
+		while (len < MAX_LINE_SIZE && line[len] != L'\0' && line[len] != L'\n') len++;
+		int good = check_str(line, len, whitelist, maxlen);
 		if (good) {
 			size_t end = 0;
 			while (end < MAX_LINE_SIZE - 1 && end < maxlen && line[end] != L'\0' && line[end] != L'\n') end++;
@@ -147,51 +134,121 @@ int get_str(FILE *fin, FILE *fout, FILE *ferr, wchar_t *line, wchar_t const *pro
 	return 0;
 }
 
-int get_id(FILE *fin, FILE *fout, FILE *ferr, wchar_t *line, wchar_t const *prompt,
-	wchar_t const *onerror,
-	int interactive, size_t *out_result) {
-	return get_uint(fin, fout, ferr, line, prompt != NULL ? onerror : L"id[uint]: ",
-			onerror != NULL ? onerror : L"id: Uint expected\n", interactive,
-			out_result);
+int check_str(wchar_t const *str, size_t len, wchar_t const *whitelist, size_t maxlen) {
+	if (str == NULL || len > maxlen) return 0;
+	for (size_t i = 0; i < len; i++) {
+		if (str[i] == L'\0' || wcschr(whitelist, str[i]) == NULL) return 0;
+	}
+	return 1;
 }
 
-int get_c1(FILE *fin, FILE *fout, FILE *ferr, wchar_t *line, wchar_t const *prompt,
-	wchar_t const *onerror,
-	int interactive, int64_t *out_result) {
-	return get_int(fin, fout, ferr, line, prompt != NULL ? prompt : L"c1[int]: ",
-			onerror != NULL ? onerror : L"c1: Int expected\n", interactive, out_result);
+// defaults of the per-column functions, by column kind
+#define GET_PROMPT_UINT(name, len) SCHEMA_WSTR(name) L"[uint]: "
+#define GET_PROMPT_INT(name, len) SCHEMA_WSTR(name) L"[int]: "
+#define GET_PROMPT_FLOAT(name, len) SCHEMA_WSTR(name) L"[float]: "
+#define GET_PROMPT_BOOL(name, len) SCHEMA_WSTR(name) L"[bool]: "
+#define GET_PROMPT_STR(name, len) SCHEMA_WSTR(name) L"[wchar_t " SCHEMA_WSTR(len) L"]: "
+
+#define GET_ERROR_UINT(name, len, charset) SCHEMA_WSTR(name) L": Uint expected"
+#define GET_ERROR_INT(name, len, charset) SCHEMA_WSTR(name) L": Int expected"
+#define GET_ERROR_FLOAT(name, len, charset) SCHEMA_WSTR(name) L": Float expected"
+#define GET_ERROR_BOOL(name, len, charset) SCHEMA_WSTR(name) L": Valid options are: " \
+	L"<blank = 0> 0 1 T[RUE] F[ALSE] t[rue] f[alse] ON OFF on off"
+#define GET_ERROR_STR(name, len, charset) SCHEMA_WSTR(name) L": Max length: " SCHEMA_WSTR(len) \
+	L"; Valid chars are " charset##_CHARS_HELP
+
+#define GET_READ_UINT(len, charset) get_uint(fin, fout, ferr, line, prompt, onerror, interactive, out_result)
+#define GET_READ_INT(len, charset) get_int(fin, fout, ferr, line, prompt, onerror, interactive, out_result)
+#define GET_READ_FLOAT(len, charset) get_float(fin, fout, ferr, line, prompt, onerror, interactive, out_result)
+#define GET_READ_BOOL(len, charset) get_bool(fin, fout, ferr, line, prompt, onerror, interactive, out_result)
+#define GET_READ_STR(len, charset) get_str(fin, fout, ferr, line, prompt, onerror, interactive, \
+	charset##_CHARS, len, out_result)
+
+#define GET_PARSE_UINT(len, charset) wparse_uint(str, out_result)
+#define GET_PARSE_INT(len, charset) wparse_int(str, out_result)
+#define GET_PARSE_FLOAT(len, charset) wparse_float(str, out_result)
+#define GET_PARSE_BOOL(len, charset) wparse_bool(str, out_result)
+#define GET_PARSE_STR(len, charset) parse_str(str, n, charset##_CHARS, len, out_result)
+
+#define GET_CHECK_UINT(name, len, charset)
+#define GET_CHECK_INT(name, len, charset)
+#define GET_CHECK_FLOAT(name, len, charset)
+#define GET_CHECK_BOOL(name, len, charset)
+#define GET_CHECK_STR(name, len, charset) \
+	int check_##name(wchar_t const *str, size_t n) { \
+		return check_str(str, n, charset##_CHARS, len); \
+	}
+
+static int parse_str(wchar_t const *str, size_t n, wchar_t const *whitelist, size_t maxlen,
+	wchar_t *out_result) {
+	if (!check_str(str, n, whitelist, maxlen)) return 0;
+	wmemcpy(out_result, str, n);
+	out_result[n] = L'\0';
+	return 1;
 }
 
-int get_c2(FILE *fin, FILE *fout, FILE *ferr, wchar_t *line, wchar_t const *prompt,
-	wchar_t const *onerror,
-	int interactive, double *out_result) {
-	return get_float(fin, fout, ferr, line, prompt != NULL ? prompt : L"c2[float]: ",
-			onerror != NULL ? onerror : L"c2: Float expected\n", interactive,
-			out_result);
+#define GET_DEFINE(a, name, tag, kind, len, charset) \
+	int get_##name(FILE *fin, FILE *fout, FILE *ferr, wchar_t *line, wchar_t const *prompt, \
+		wchar_t const *onerror, int interactive, SCHEMA_CTYPE_##kind *out_result) { \
+		if (prompt == NULL) prompt = GET_PROMPT_##kind(name, len); \
+		if (onerror == NULL) onerror = GET_ERROR_##kind(name, len, charset) L"\n"; \
+		return GET_READ_##kind(len, charset); \
+	} \
+	int parse_##name(wchar_t *str, size_t n, SCHEMA_CTYPE_##kind *out_result) { \
+		(void) n; \
+		return GET_PARSE_##kind(len, charset); \
+	} \
+	GET_CHECK_##kind(name, len, charset)
+
+TABLE_SCHEMA(GET_DEFINE, _)
+
+#define GET_ERROR_CASE(a, name, tag, kind, len, charset) case tag: return GET_ERROR_##kind(name, len, charset);
+
+wchar_t const *get_column_error(column_t column) {
+	switch (column) {
+	default: return NULL;
+	TABLE_SCHEMA(GET_ERROR_CASE, _)
+	}
 }
 
-int get_c3(FILE *fin, FILE *fout, FILE *ferr, wchar_t *line, wchar_t const *prompt,
-	wchar_t const *onerror,
-	int interactive, wchar_t *out_result) {
-	return get_str(fin, fout, ferr, line, prompt != NULL ? prompt : L"c3[wchar_t 16]: ",
-			onerror != NULL ? onerror : L"c3: Max length: 16; Valid chars are 0-9 a-z A-Z а-я А-Я\n",
-			interactive,
-			DIGITS ALPH_EN ALPH_RU, 16, out_result);
+// a bool read from the wire may hold any byte, it is looked at as bytes first
+_Static_assert(sizeof(bool) == 1, "check_bool expects one-byte bool");
+
+static int check_bool(bool const *value) {
+	unsigned char byte;
+	memcpy(&byte, value, 1);
+	return byte <= 1;
 }
 
-int get_c4(FILE *fin, FILE *fout, FILE *ferr, wchar_t *line, wchar_t const *prompt,
-	wchar_t const *onerror,
-	int interactive, bool *out_result) {
-	return get_bool(fin, fout, ferr, line, prompt != NULL ? prompt : L"c4[bool]: ",
-			onerror != NULL ? onerror : L"c4: Valid options are: "
-			L"<blank = 0> 0 1 T[RUE] F[ALSE] t[rue] f[alse] ON OFF on off\n", interactive, out_result);
+static int check_field(wchar_t const *str, size_t cap, int (*check)(wchar_t const *, size_t)) {
+	wchar_t const *end = wmemchr(str, L'\0', cap);
+	return end != NULL && check(str, (size_t) (end - str));
 }
 
-int get_c5(FILE *fin, FILE *fout, FILE *ferr, wchar_t *line, wchar_t const *prompt,
-	wchar_t const *onerror,
-	int interactive, wchar_t *out_result) {
-	return get_str(fin, fout, ferr, line, prompt != NULL ? prompt : L"c5[wchar_t 32]: ",
-			onerror != NULL ? onerror : L"c5: Max length: 31; Valid chars are 0-9 a-z A-Z а-я А-Я\\s\n",
-			interactive,
-			L" " PUNCTS DIGITS ALPH_EN ALPH_RU, 32, out_result);
+#define VALUE_OK_UINT(value, name, len) 1
+#define VALUE_OK_INT(value, name, len) 1
+#define VALUE_OK_FLOAT(value, name, len) 1
+#define VALUE_OK_BOOL(value, name, len) check_bool(&(value))
+#define VALUE_OK_STR(value, name, len) check_field((value), (len) + 1, check_##name)
+
+#define CHECK_ROW_FIELD(row, name, tag, kind, len, charset) \
+	if (!VALUE_OK_##kind((row)->name, name, len)) return 0;
+
+int check_row(dbrow_t const *row) {
+	if (row == NULL) return 0;
+	TABLE_SCHEMA(CHECK_ROW_FIELD, row)
+	return 1;
+}
+
+#define CHECK_OPERAND_CASE(spec, name, tag, kind, len, charset) \
+	case tag: \
+		return VALUE_OK_##kind((spec)->data1.name, name, len) \
+			&& ((spec)->condition != C_BTW || VALUE_OK_##kind((spec)->data2.name, name, len));
+
+int check_findspec(table_find_t const *findspec) {
+	if (!table_find_valid(findspec)) return 0;
+	switch (findspec->column) {
+	default: return 0;
+	TABLE_SCHEMA(CHECK_OPERAND_CASE, findspec)
+	}
 }
@@ -0,0 +1,24 @@
+#include "hash.h"
+
+uint64_t hash_u64(uint64_t x) {
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdull;
+	x ^= x >> 33;
+	x *= 0xc4ceb9fe1a85ec53ull;
+	x ^= x >> 33;
+	return x;
+}
+
+uint64_t hash_wcs(wchar_t const *s, size_t cap) {
+	uint64_t h = 0xcbf29ce484222325ull;
+	for (size_t i = 0; i < cap && s[i] != L'\0'; i++) {
+		h ^= (uint64_t) (uint32_t) s[i];
+		h *= 0x100000001b3ull;
+	}
+	return hash_u64(h);
+}
+
+int hash_cmp_u64(void const *a, void const *b) {
+	uint64_t x = *(uint64_t const *) a, y = *(uint64_t const *) b;
+	return (x > y) - (x < y);
+}
@@ -11,52 +11,24 @@
 #include "parse.h"
 #include "get.h"
 #include "defs.h"
-
-FILE *wide_fopen(wchar_t const *path, wchar_t const *mode) {
-#ifdef _MSC_VER
-	return _wfopen(path, mode);
-#else
-	// usually there is some character limits in the os/fs
-	// if that's not the case - feel free to redefine MAX_FILE_PATH
-	// or even add heap-allocated temporary strings instead of mbname, mbmode
-	char mbpath[MAX_FILE_PATH];
-	char mbmode[MAX_FILE_PATH];
-	mbstate_t state = {0};
-	size_t len = 1 + wcsrtombs(NULL, &path, 0, &state);
-	if (len >= MAX_FILE_PATH) return NULL;
-	if (wcsrtombs(mbpath, &path, len, &state) == (size_t) -1) return NULL;
-	state = (mbstate_t) {0};
-	len = 1 + wcsrtombs(NULL, &mode, 0, &state);
-	if (len >= MAX_FILE_PATH) return NULL;
-	if (wcsrtombs(mbmode, &mode, len, &state) == (size_t) -1) return NULL;
-	FILE *fd = fopen(mbpath, mbmode);
-	if (fd != NULL) fwide(fd, 1);
-	return fd;
-#endif
-}
-
-/*
- * returns 1 on success, 0 on failure
- * retries `interactive` times with each field
- * gets id automatically if interactive
- */
-int add_row(FILE *fin, FILE *fout, FILE *ferr, table_t *table, wchar_t *line, int interactive) {
-	size_t id;
-	if (interactive) { id = table->next_id; }
-	else if (get_id(fin, fout, ferr, line, NULL, NULL, interactive, &id) == 0) { goto add_cancel; }
-	dbrow_t row = {.id = id};
-	if (get_c1(fin, fout, ferr, line, NULL, NULL, interactive, &row.c1) == 0) { goto add_cancel; }
-	if (get_c2(fin, fout, ferr, line, NULL, NULL, interactive, &row.c2) == 0) { goto add_cancel; }
-	if (get_c3(fin, fout, ferr, line, NULL, NULL, interactive, row.c3) == 0) { goto add_cancel; }
-	if (get_c4(fin, fout, ferr, line, NULL, NULL, interactive, &row.c4) == 0) { goto add_cancel; }
-	if (get_c5(fin, fout, ferr, line, NULL, NULL, interactive, row.c5) == 0) { goto add_cancel; }
-	table_append(table, row);
-	if (interactive) { table->next_id++; }
-	return 1;
-add_cancel:
-	afprintf(fout, L"Cancelled\n");
-	return 0;
-}
+#include "dump.h"
+#include "stats.h"
+#include "server.h"
+#include "table_map.h"
+#include "table_pack.h"
+#include "table_cache.h"
+#include "table_view.h"
+#include "table_trgm.h"
+#include "csv.h"
+#include "table_cursor.h"
+#include "gen.h"
+#include "clock.h"
+#include "catalog.h"
+#include "table_join.h"
+#include "table_plan.h"
+#include "table_sketch.h"
+#include "table_agg.h"
+#include "table_extsort.h"
 
 int delete_row(FILE *fin, FILE *fout, FILE *ferr, table_t *table, wchar_t *line, int interactive) {
 	if (table == NULL || table->rows == NULL) {
@@ -80,69 +52,24 @@ int delete_row(FILE *fin, FILE *fout, FILE *ferr, table_t *table, wchar_t *line,
 	return 1;
 }
 
-#ifdef _MSC_VER
-#define ROW_HUMAN_FORMAT L"%zd\t%lld\t%f\t'"WSTR_FMT"'\t%d\t'"WSTR_FMT"'\n"
-#define ROW_DUMP_FORMAT L"%zd\n%lld\n%f\n"WSTR_FMT"\n%d\n"WSTR_FMT"\n"
-#else
-#define ROW_HUMAN_FORMAT L"%zu\t%zd\t%f\t'"WSTR_FMT"'\t%d\t'"WSTR_FMT"'\n"
-#define ROW_DUMP_FORMAT L"%zu\n%zd\n%f\n"WSTR_FMT"\n%d\n"WSTR_FMT"\n"
-#endif
-#define ROW_HEADER L"id\tc1\tc2\tc3\tc4\tc5\n"
-
-int print_table(FILE *fout, FILE *ferr, table_t const *table, int dump) {
-	wchar_t const *fmt = dump ? ROW_DUMP_FORMAT : ROW_HUMAN_FORMAT;
+int print_matching_rows(FILE *fout, FILE *ferr, table_t *table, table_find_t findspec) {
 	if (table == NULL || table->rows == NULL || table->len == 0) {
 		afprintf(ferr, L"No table\n");
 		return 0;
 	}
-	if (dump) {
-		afprintf(fout, L"%zu\n%zu\n", table->len, table->next_id);
-	}
-	else {
-		afprintf(fout, ROW_HEADER);
-	}
-	for (size_t i = 0; i < table->len; i++) {
-		dbrow_t row = table->rows[i];
-		afprintf(fout, fmt, ROW_ARG(row));
-	}
-	return 1;
-}
-
-int print_matching_rows(FILE *fout, FILE *ferr, table_t const *table, table_find_t findspec) {
-	if (table == NULL || table->rows == NULL || table->len == 0) {
-		afprintf(ferr, L"No table\n");
+	size_t const *idx;
+	size_t n;
+	if (!table_cached_find(table, findspec, &idx, &n)) {
+		afprintf(ferr, L"Cannot search table\n");
 		return 0;
 	}
 	afprintf(fout, ROW_HEADER);
-	size_t rowidx;
-	int hasNext = table_find_first(table, findspec, &rowidx);
-	while (hasNext) {
-		afprintf(fout, ROW_HUMAN_FORMAT, ROW_ARG(table->rows[rowidx]));
-		findspec.start_pos = rowidx + 1;
-		hasNext = table_find_first(table, findspec, &rowidx);
+	for (size_t i = 0; i < n; i++) {
+		afprintf(fout, ROW_HUMAN_FORMAT, ROW_ARG(table->rows[idx[i]]));
 	}
 	return 1;
 }
 
-int load_table(FILE *fin, FILE *ferr, table_t **out_table, wchar_t *line) {
-	if (fin == NULL || out_table == NULL) return 0;
-	size_t table_len = 0, table_next_id = 0;
-	fgetws(line, MAX_LINE_SIZE, fin);
-	wparse_uint(line, &table_len);
-	fgetws(line, MAX_LINE_SIZE, fin);
-	wparse_uint(line, &table_next_id);
-	table_t *table = table_new(table_len);
-	table->next_id = table_next_id;
-	for (size_t i = 0; i < table_len; i++) {
-		if (add_row(fin, NULL, ferr, table, line, 0) == 0) {
-			table_free(table);
-			return 0;
-		}
-	}
-	*out_table = table;
-	return 1;
-}
-
 int print_menu(FILE *fout) {
 	afprintf(fout,
 		L"STANKIN static database operator\n"
@@ -150,12 +77,38 @@ int print_menu(FILE *fout) {
 		L"        help\t\tPrint this message\n"
 		L"        quit\texit\tExit\n"
 		L"        fill\t\tFill table with data\n"
+		L"        gen N [seed]\t\tAppend N random rows\n"
 		L"        add\t\tAppend row to table\n"
 		L"        where\tsearch\tSearch for specific values\n"
 		L"        order\tsort\tSort rows by criterion\n"
 		L"        print\t\tPrint table\n"
+		L"        page\t\tPrint one page of rows, optionally filtered and sorted\n"
 		L"        save\texport\tSave table to file\n"
 		L"        load\timport\tLoad table from file\n"
+		L"        load NAME PATH\t\tLoad table from file into named table\n"
+		L"        use NAME\t\tSwitch to named table (a new name starts empty), current is 'main'\n"
+		L"        tables\t\tList named tables\n"
+		L"        join\t\tJoin current table with a named one on equal keys\n"
+		L"        pack\t\tSave table to compressed binary file\n"
+		L"        unpack\t\tLoad table from compressed binary file\n"
+		L"        export csv\t\tSave table as csv (export tsv for tab-separated)\n"
+		L"        import csv\t\tLoad table from csv (import tsv for tab-separated)\n"
+		L"        export sorted\t\tSave sorted table as csv, tsv or packed file within a memory budget\n"
+		L"        view\t\tKeep table sorted by column (order uses it without sorting)\n"
+		L"        unview\t\tDrop sorted view\n"
+		L"        views\t\tList sorted views\n"
+		L"        index\t\tBuild trigram index for contains/prefix search on a string column\n"
+		L"        unindex\t\tDrop trigram index\n"
+		L"        map\t\tOpen file-backed table (a new file gets a copy of current table)\n"
+		L"        analyze\t\tCollect column statistics for the planner\n"
+		L"        explain\t\tShow how a search would run\n"
+		L"        distinct\t\tApproximate number of distinct values of c1, c3 or c5\n"
+		L"        estimate\t\tApproximate number of rows matching a condition\n"
+		L"        agg\t\tKeep count/sum/min/max of c1 and c2 grouped by a column, optionally filtered\n"
+		L"        unagg\t\tDrop aggregate\n"
+		L"        aggs\t\tPrint aggregates\n"
+		L"        stats\t\tPrint operation counters and latencies\n"
+		L"        stats reset\t\tClear operation counters\n"
 		L"========\n"
 	);
 	return 1;
@@ -183,24 +136,54 @@ void fill_table(FILE *fin, FILE *fout, FILE *ferr, wchar_t *line, int retries, t
 	*table = newtable;
 }
 
-void filter_table(FILE *fin, FILE *fout, FILE *ferr, table_t const *table, wchar_t *line,
-	int retries) {
+#define PROMPT_SIZE 256
+
+/*
+ * writes "<what> num[uint ..., other for exit]: " to buf of PROMPT_SIZE,
+ * listing the columns usable accepts, or the range of all of them if usable is NULL
+ * returns buf
+ */
+wchar_t const *column_prompt(wchar_t *buf, wchar_t const *what, int (*usable)(column_t)) {
+	int n = swprintf(buf, PROMPT_SIZE, WSTR_FMT L" num[uint", what);
+	if (n >= 0 && usable == NULL) n += swprintf(buf + n, PROMPT_SIZE - n, L" 0-%zu", (size_t) TABLE_NCOLUMNS - 1);
+	for (size_t c = 0; n >= 0 && usable != NULL && c < TABLE_NCOLUMNS; c++) {
+		if (!usable((column_t) c)) continue;
+		int k = swprintf(buf + n, PROMPT_SIZE - n, L" %zu", c);
+		n = k < 0 ? k : n + k;
+	}
+	if (n < 0 || swprintf(buf + n, PROMPT_SIZE - n, L", other for exit]: ") < 0) {
+		swprintf(buf, PROMPT_SIZE, WSTR_FMT L" num[uint]: ", what);
+	}
+	return buf;
+}
+
+/*
+ * returns 1 on success, 0 if cancelled
+ */
+int get_findspec(FILE *fin, FILE *fout, FILE *ferr, wchar_t *line, int retries, table_find_t *out_spec) {
 	table_find_t findspec = {0};
 	size_t colnum;
-	get_uint(fin, fout, ferr, line,
-		L"Column num[uint 0-5, other for exit]: ", L"Uint expected", retries, &colnum);
-	if (colnum > TC_C5) {
+	wchar_t prompt[PROMPT_SIZE];
+	get_uint(fin, fout, ferr, line, column_prompt(prompt, L"Column", NULL), L"Uint expected", retries, &colnum);
+	if (colnum >= TABLE_NCOLUMNS) {
 		afprintf(fout, L"Cancelled\n");
-		return;
+		return 0;
 	}
 	else {
 		findspec.column = TC_ID + colnum;
 	}
 	int rt = retries;
-	switch (findspec.column) {
-	case TC_ID:
-	case TC_C1:
-	case TC_C2:
+	// conditions and operands depend on the column kind, see schema.h
+	enum { FK_NUM, FK_STR, FK_BOOL };
+#define FT_KIND_UINT FK_NUM
+#define FT_KIND_INT FK_NUM
+#define FT_KIND_FLOAT FK_NUM
+#define FT_KIND_STR FK_STR
+#define FT_KIND_BOOL FK_BOOL
+#define FT_KIND(a, name, tag, kind, len, charset) [tag] = FT_KIND_##kind,
+	static int const kinds[TABLE_NCOLUMNS] = { TABLE_SCHEMA(FT_KIND, _) };
+	switch (kinds[findspec.column]) {
+	case FK_NUM:
 		// any of eq, neq, gt, ge, lt, le, btw
 		do {
 			afprintf(fout, L"Compare method[= ! > >= < <= <>] [default =]: ");
@@ -215,11 +198,28 @@ void filter_table(FILE *fin, FILE *fout, FILE *ferr, table_t const *table, wchar
 			else { afprintf(ferr, L"Compare: = ! > >= < <= <> expected\n"); }
 		}
 		while (rt--);
-		if (rt == 0) { afprintf(ferr, L"Max retries exceeded\n"); return; }
+		if (rt == 0) { afprintf(ferr, L"Max retries exceeded\n"); return 0; }
 		break;
-	case TC_C3:
-	case TC_C4:
-	case TC_C5:
+	case FK_STR:
+		// any of eq, neq, gt, ge, lt, le, btw (in collation order), contains, prefix
+		do {
+			afprintf(fout, L"Compare method[= ! > >= < <= <> ~ ^] [default =]: ");
+			fgetws(line, MAX_LINE_SIZE, fin);
+			if (PROMPT(L"") || PROMPT(L"=") || PROMPT(L"eq")) { findspec.condition = C_EQ; break; }
+			else if (PROMPT(L"!") || PROMPT(L"neq")) { findspec.condition = C_NEQ; break; }
+			else if (PROMPT(L">") || PROMPT(L"gt")) { findspec.condition = C_GT; break; }
+			else if (PROMPT(L">=") || PROMPT(L"ge")) { findspec.condition = C_GE; break; }
+			else if (PROMPT(L"<") || PROMPT(L"lt")) { findspec.condition = C_LT; break; }
+			else if (PROMPT(L"<=") || PROMPT(L"le")) { findspec.condition = C_LE; break; }
+			else if (PROMPT(L"<>") || PROMPT(L"btw")) { findspec.condition = C_BTW; break; }
+			else if (PROMPT(L"~") || PROMPT(L"contains")) { findspec.condition = C_CONTAINS; break; }
+			else if (PROMPT(L"^") || PROMPT(L"prefix")) { findspec.condition = C_PREFIX; break; }
+			else { afprintf(ferr, L"Compare: = ! > >= < <= <> ~ ^ expected\n"); }
+		}
+		while (rt--);
+		if (rt == 0) { afprintf(ferr, L"Max retries exceeded\n"); return 0; }
+		break;
+	case FK_BOOL:
 		// any of eq, neq
 		do {
 			afprintf(fout, L"Compare method: [= !] [default =]: ");
@@ -229,67 +229,405 @@ void filter_table(FILE *fin, FILE *fout, FILE *ferr, table_t const *table, wchar
 			else { afprintf(ferr, L"Compare: = ! expected\n"); }
 		}
 		while (rt--);
-		if (rt == 0) { afprintf(ferr, L"Max retries exceeded\n"); return; }
+		if (rt == 0) { afprintf(ferr, L"Max retries exceeded\n"); return 0; }
 		break;
 	}
-#define FT_GET_(enumv, col, type, amp) case enumv: \
-		get_##col(fin, fout, ferr, line, L ## #col L": first operand[" L ## #type L"]: ", NULL, retries, amp findspec.data1.col);
-#define FT_GET1(...) FT_GET_(__VA_ARGS__); break;
-#define FT_GET2(enumv, col, type, amp) FT_GET_(enumv, col, type, amp); \
-	if (findspec.condition == C_BTW) \
-		get_##col(fin, fout, ferr, line, L ## #col L": second operand[" L ## #type L"]: ", NULL, retries, amp findspec.data2.col); \
-	break;
+#define FT_TYPE_UINT L"uint"
+#define FT_TYPE_INT L"int"
+#define FT_TYPE_FLOAT L"float"
+#define FT_TYPE_BOOL L"bool"
+#define FT_TYPE_STR L"wchar_t"
+#define FT_GET(a, name, tag, kind, len, charset) case tag: \
+		get_##name(fin, fout, ferr, line, SCHEMA_WSTR(name) L": first operand[" FT_TYPE_##kind L"]: ", NULL, \
+			retries, SCHEMA_REF_##kind(findspec.data1.name)); \
+		if (findspec.condition == C_BTW) \
+			get_##name(fin, fout, ferr, line, SCHEMA_WSTR(name) L": second operand[" FT_TYPE_##kind L"]: ", NULL, \
+				retries, SCHEMA_REF_##kind(findspec.data2.name)); \
+		break;
 	switch (findspec.column) {
-		FT_GET2(TC_ID, id, uint, &);
-		FT_GET2(TC_C1, c1, uint, &);
-		FT_GET2(TC_C2, c2, uint, &);
-		FT_GET1(TC_C3, c3, uint,);
-		FT_GET1(TC_C4, c4, uint, &);
-		FT_GET1(TC_C5, c5, uint,);
-	}
-#undef FT_GET_
-#undef FT_GET1
-#undef FT_GET2
-	print_matching_rows(fout, ferr, table, findspec);
+		TABLE_SCHEMA(FT_GET, _)
+	}
+#undef FT_GET
+#undef FT_KIND
+	*out_spec = findspec;
+	return 1;
 }
 
-void sort_table(FILE *fin, FILE *fout, FILE *ferr, table_t const *table, wchar_t *line,
+void filter_table(FILE *fin, FILE *fout, FILE *ferr, table_t *table, wchar_t *line,
 	int retries) {
-	if (table == NULL) {
-		afprintf(ferr, L"No table\n");
-		return;
-	}
+	table_find_t findspec;
+	if (!get_findspec(fin, fout, ferr, line, retries, &findspec)) return;
+	print_matching_rows(fout, ferr, table, findspec);
+}
+
+/*
+ * returns 1 on success, 0 if cancelled
+ */
+int get_sortspec(FILE *fin, FILE *fout, FILE *ferr, wchar_t *line, int retries, table_sort_t *out_spec) {
 	table_sort_t sortspec = {0};
 	size_t colnum;
-	get_uint(fin, fout, ferr, line,
-		L"Column num[uint 0-5, other for exit]: ", L"Uint expected", retries, &colnum);
-	switch (colnum) {
-	default: afprintf(fout, L"Cancelled\n"); return;
-	case 0: sortspec.column = TC_ID; break;
-	case 1: sortspec.column = TC_C1; break;
-	case 2: sortspec.column = TC_C2; break;
-	case 3: sortspec.column = TC_C3; break;
-	case 4: sortspec.column = TC_C4; break;
-	case 5: sortspec.column = TC_C5; break;
+	wchar_t prompt[PROMPT_SIZE];
+	get_uint(fin, fout, ferr, line, column_prompt(prompt, L"Column", NULL), L"Uint expected", retries, &colnum);
+	if (colnum >= TABLE_NCOLUMNS) {
+		afprintf(fout, L"Cancelled\n");
+		return 0;
 	}
+	sortspec.column = TC_ID + colnum;
 	int rt = retries;
 	do {
 		afprintf(fout, L"Order[asc + desc -]: ");
 		fgetws(line, MAX_LINE_SIZE, fin);
-		if (line[0] == L'\n') { afprintf(fout, L"Cancelled\n"); return; }
+		if (line[0] == L'\n') { afprintf(fout, L"Cancelled\n"); return 0; }
 		else if (PROMPT(L"asc") || PROMPT(L"ASC") || PROMPT(L"+")) { sortspec.direction = S_ASC; break; }
 		else if (PROMPT(L"desc") || PROMPT(L"DESC") || PROMPT(L"-")) { sortspec.direction = S_DESC; break; }
 		else { afprintf(ferr, L"Order: asc + desc - expected\n"); }
 	}
 	while (rt--);
-	if (rt == 0) { afprintf(ferr, L"Max retries exceeded\n"); return; }
-	dbrow_t *sorted;
-	table_sort(table, sortspec, &sorted);
+	if (rt == 0) { afprintf(ferr, L"Max retries exceeded\n"); return 0; }
+	*out_spec = sortspec;
+	return 1;
+}
+
+void sort_table(FILE *fin, FILE *fout, FILE *ferr, table_t *table, wchar_t *line,
+	int retries) {
+	if (table == NULL) {
+		afprintf(ferr, L"No table\n");
+		return;
+	}
+	table_sort_t sortspec;
+	if (!get_sortspec(fin, fout, ferr, line, retries, &sortspec)) return;
+	table_view_iter_t iter;
+	if (table_view_begin(table, sortspec, &iter)) {
+		afprintf(fout, ROW_HEADER);
+		for (dbrow_t const *row; (row = table_view_next(&iter)) != NULL;) {
+			afprintf(fout, ROW_HUMAN_FORMAT, ROW_ARG((*row)));
+		}
+		return;
+	}
+	dbrow_t const *sorted;
+	if (!table_cached_sort(table, sortspec, &sorted)) {
+		afprintf(ferr, L"Cannot sort table\n");
+		return;
+	}
 	afprintf(fout, ROW_HEADER);
 	for (size_t i = 0, len = table->len; i < len; i++) {
 		afprintf(fout, ROW_HUMAN_FORMAT, ROW_ARG(sorted[i]));
 	}
-	free(sorted);
+}
+
+// rows generated per table_append_batch call
+#define GEN_BATCH_ROWS 65536
+
+/*
+ * appends generated rows, `gen N [seed]` on one line or asks for N and seed
+ */
+void gen_table(FILE *fin, FILE *fout, FILE *ferr, table_t **table, wchar_t *line, int retries) {
+	size_t nrows = 0, seed = 42;
+	if (line[3] == L' ') {
+		wchar_t *seed_arg = wcschr(line + 4, L' ');
+		if (!wparse_uint(line + 4, &nrows) || (seed_arg != NULL && !wparse_uint(seed_arg + 1, &seed))) {
+			afprintf(ferr, L"usage: gen N [seed]\n");
+			return;
+		}
+	}
+	else {
+		if (!get_uint(fin, fout, ferr, line, L"Row count: ", L"Row count: Uint expected\n", retries, &nrows)) return;
+		if (!get_uint(fin, fout, ferr, line, L"Seed[uint, blank = 42]: ", L"Seed: Uint expected\n", retries, &seed)) return;
+		if (line[0] == L'\n') seed = 42;
+	}
+	if (nrows == 0) {
+		afprintf(ferr, L"Row count should be > 0\n");
+		return;
+	}
+	if (*table == NULL) *table = table_new(nrows);
+	table_t *t = *table;
+	if (t == NULL || t->len + nrows < t->len || !table_reserve(t, t->len + nrows)) {
+		afprintf(ferr, L"Cannot allocate %zu rows\n", nrows);
+		return;
+	}
+	size_t batch = nrows < GEN_BATCH_ROWS ? nrows : GEN_BATCH_ROWS;
+	dbrow_t *rows = malloc(batch * sizeof(dbrow_t));
+	if (rows == NULL) {
+		afprintf(ferr, L"Cannot allocate %zu rows\n", nrows);
+		return;
+	}
+	gen_t gen;
+	gen_init(&gen, gen_default_params(), seed);
+	uint64_t start = clock_ns();
+	size_t done = 0;
+	while (done < nrows) {
+		size_t n = nrows - done < batch ? nrows - done : batch;
+		for (size_t i = 0; i < n; i++) gen_row(&gen, t->next_id++, &rows[i]);
+		if (!table_append_batch(t, rows, n)) break;
+		done += n;
+	}
+	free(rows);
+	double ms = (double) (clock_ns() - start) / 1e6;
+	if (done < nrows) { afprintf(ferr, L"Cannot append rows, generated %zu\n", done); }
+	else { afprintf(fout, L"Generated %zu rows in %.1f ms\n", done, ms); }
+}
+
+/*
+ * returns 1 if answered yes
+ */
+int get_yes(FILE *fin, FILE *fout, wchar_t *line, wchar_t const *prompt) {
+	afprintf(fout, WSTR_FMT, prompt);
+	fgetws(line, MAX_LINE_SIZE, fin);
+	return PROMPT(L"y") || PROMPT(L"Y") || PROMPT(L"yes");
+}
+
+void page_table(FILE *fin, FILE *fout, FILE *ferr, table_t *table, wchar_t *line, int retries) {
+	if (table == NULL) {
+		afprintf(ferr, L"No table\n");
+		return;
+	}
+	size_t size, page;
+	if (!get_uint(fin, fout, ferr, line, L"Page size[uint, blank = 100]: ", L"Uint expected\n", retries, &size)) return;
+	if (!get_uint(fin, fout, ferr, line, L"Page[uint from 1, blank = 1]: ", L"Uint expected\n", retries, &page)) return;
+	if (size == 0) size = 100;
+	if (page == 0) page = 1;
+	table_find_t findspec;
+	table_sort_t sortspec;
+	int filtered = get_yes(fin, fout, line, L"Filter[y/N]: ");
+	if (filtered && !get_findspec(fin, fout, ferr, line, retries, &findspec)) return;
+	int sorted = get_yes(fin, fout, line, L"Sort[y/N]: ");
+	if (sorted && !get_sortspec(fin, fout, ferr, line, retries, &sortspec)) return;
+	size_t offset = page - 1 > SIZE_MAX / size ? SIZE_MAX : (page - 1) * size;
+	table_cursor_t cur;
+	if (!table_cursor_open(&cur, table, filtered ? &findspec : NULL, sorted ? &sortspec : NULL, offset, size)) {
+		afprintf(ferr, L"Cannot read table\n");
+		return;
+	}
+	size_t n = 0;
+	afprintf(fout, ROW_HEADER);
+	for (dbrow_t const *row; (row = table_cursor_next(&cur)) != NULL; n++) {
+		afprintf(fout, ROW_HUMAN_FORMAT, ROW_ARG((*row)));
+	}
+	table_cursor_close(&cur);
+	afprintf(fout, L"Page %zu: %zu rows\n", page, n);
+}
+
+void view_table(FILE *fin, FILE *fout, FILE *ferr, table_t *table, wchar_t *line, int retries,
+	int drop) {
+	if (table == NULL) {
+		afprintf(ferr, L"No table\n");
+		return;
+	}
+	table_sort_t sortspec;
+	if (!get_sortspec(fin, fout, ferr, line, retries, &sortspec)) return;
+	wchar_t const *dir = sortspec.direction == S_DESC ? L"desc" : L"asc";
+	if (drop) {
+		if (table_view_drop(table, sortspec)) {
+			afprintf(fout, L"Dropped view on column %d "WSTR_FMT"\n", sortspec.column, dir);
+		}
+		else {
+			afprintf(ferr, L"No view on column %d "WSTR_FMT"\n", sortspec.column, dir);
+		}
+	}
+	else if (table_view_add(table, sortspec)) {
+		afprintf(fout, L"Registered view on column %d "WSTR_FMT"\n", sortspec.column, dir);
+	}
+	else {
+		afprintf(ferr, L"Cannot build view\n");
+	}
+}
+
+void index_table(FILE *fin, FILE *fout, FILE *ferr, table_t *table, wchar_t *line, int retries,
+	int drop) {
+	if (table == NULL) {
+		afprintf(ferr, L"No table\n");
+		return;
+	}
+	size_t colnum;
+	wchar_t prompt[PROMPT_SIZE];
+	get_uint(fin, fout, ferr, line, column_prompt(prompt, L"Column", table_trgm_column), L"Uint expected", retries,
+		&colnum);
+	if (colnum >= TABLE_NCOLUMNS || !table_trgm_column((column_t) colnum)) {
+		afprintf(fout, L"Cancelled\n");
+		return;
+	}
+	if (drop) {
+		if (table_trgm_drop(table, (column_t) colnum)) { afprintf(fout, L"Dropped index on c%zu\n", colnum); }
+		else { afprintf(ferr, L"No index on c%zu\n", colnum); }
+	}
+	else if (table_trgm_add(table, (column_t) colnum)) {
+		afprintf(fout, L"Built trigram index on c%zu\n", colnum);
+	}
+	else {
+		afprintf(ferr, L"Cannot build index\n");
+	}
+}
+
+int print_views(FILE *fout, table_t const *table) {
+	table_sort_t specs[2 * TABLE_NCOLUMNS];
+	size_t n = table_view_list(table, specs, sizeof(specs) / sizeof(*specs));
+	if (n == 0) afprintf(fout, L"No views\n");
+	for (size_t i = 0; i < n; i++) {
+		afprintf(fout, L"column %d "WSTR_FMT"\n", specs[i].column, specs[i].direction == S_DESC ? L"desc" : L"asc");
+	}
+	return 1;
+}
+
+#define STATS_COLUMN(cs, name, tag, kind, len, charset) \
+	afprintf(fout, SCHEMA_WSTR(name) L"\t~%.0f\t" ROW_FMT_##kind L"\t" ROW_FMT_##kind L"\n", \
+		cs[tag].distinct, cs[tag].min.name, cs[tag].max.name); \
+	if (cs[tag].nbounds > 0) { \
+		afprintf(fout, L"\thistogram:"); \
+		for (size_t b = 0; b < cs[tag].nbounds; b++) afprintf(fout, L" %g", cs[tag].bounds[b]); \
+		afprintf(fout, L"\n"); \
+	}
+
+void analyze_table(FILE *fout, FILE *ferr, table_t *table) {
+	if (table == NULL) {
+		afprintf(ferr, L"No table\n");
+		return;
+	}
+	if (!table_analyze(table)) {
+		afprintf(ferr, L"Cannot analyze table\n");
+		return;
+	}
+	table_stats_t const *stats = table_stats(table);
+	afprintf(fout, L"%zu rows, %zu sampled\n", stats->rows, stats->sampled);
+	afprintf(fout, L"column\tdistinct\tmin\tmax\n");
+	TABLE_SCHEMA(STATS_COLUMN, stats->columns)
+}
+
+void explain_find(FILE *fin, FILE *fout, FILE *ferr, table_t const *table, wchar_t *line, int retries) {
+	if (table == NULL) {
+		afprintf(ferr, L"No table\n");
+		return;
+	}
+	table_find_t findspec;
+	table_plan_t plan;
+	if (!get_findspec(fin, fout, ferr, line, retries, &findspec)) return;
+	if (!table_plan(table, &findspec, &plan)) {
+		afprintf(ferr, L"Bad condition for this column\n");
+		return;
+	}
+	afprintf(fout, L"Path: "WSTR_FMT, table_path_name(plan.path));
+	if (plan.path == TP_PARALLEL) afprintf(fout, L" (%zu threads)", plan.threads);
+	afprintf(fout, L"\nSelectivity: %.6f ("WSTR_FMT")\n", plan.selectivity, plan.analyzed ? L"statistics" : L"default");
+	afprintf(fout, L"Rows: ~%.0f\nCost: ~%.0f rows to the first match (scan ~%.0f)\n", plan.rows, plan.cost,
+		plan.scan_cost);
+	table_stats_t const *stats = table_stats(table);
+	if (stats == NULL) {
+		afprintf(fout, L"No statistics, run analyze\n");
+	}
+	else if (stats->version != table->version) {
+		afprintf(fout, L"Statistics are older than the table (%zu rows then, %zu now)\n", stats->rows, table->len);
+	}
+}
+
+void distinct_table(FILE *fin, FILE *fout, FILE *ferr, table_t *table, wchar_t *line, int retries) {
+	if (table == NULL) {
+		afprintf(ferr, L"No table\n");
+		return;
+	}
+	size_t colnum;
+	wchar_t prompt[PROMPT_SIZE];
+	get_uint(fin, fout, ferr, line, column_prompt(prompt, L"Column", table_sketch_column), L"Uint expected", retries,
+		&colnum);
+	if (colnum >= TABLE_NCOLUMNS || !table_sketch_column((column_t) colnum)) {
+		afprintf(fout, L"Cancelled\n");
+		return;
+	}
+	table_distinct_t d;
+	uint64_t start = clock_ns();
+	if (!table_distinct(table, (column_t) colnum, &d)) {
+		afprintf(ferr, L"Cannot build sketch\n");
+		return;
+	}
+	double ms = (double) (clock_ns() - start) / 1e6;
+	afprintf(fout, L"c%zu: ~%.0f distinct (95%%: +-%.1f%%, hyperloglog) in %.3f ms\n", colnum, d.distinct,
+		200 * d.error, ms);
+}
+
+void estimate_find(FILE *fin, FILE *fout, FILE *ferr, table_t const *table, wchar_t *line, int retries) {
+	if (table == NULL) {
+		afprintf(ferr, L"No table\n");
+		return;
+	}
+	table_find_t findspec;
+	table_estimate_t est;
+	if (!get_findspec(fin, fout, ferr, line, retries, &findspec)) return;
+	uint64_t start = clock_ns();
+	// same table version, same sample
+	if (!table_estimate(table, &findspec, 0, table->version, &est)) {
+		afprintf(ferr, L"Bad condition for this column\n");
+		return;
+	}
+	double ms = (double) (clock_ns() - start) / 1e6;
+	if (est.exact) {
+		afprintf(fout, L"%.0f rows (exact, all %zu rows checked) in %.3f ms\n", est.count, est.rows, ms);
+	}
+	else {
+		afprintf(fout, L"~%.0f rows (95%%: %.0f .. %.0f), %zu of %zu sampled rows matched in %.3f ms\n",
+			est.count, est.low, est.high, est.matched, est.sampled, ms);
+	}
+}
+
+void agg_table(FILE *fin, FILE *fout, FILE *ferr, table_t *table, wchar_t *line, int retries, int drop) {
+	if (table == NULL) {
+		afprintf(ferr, L"No table\n");
+		return;
+	}
+	size_t num;
+	if (drop) {
+		get_uint(fin, fout, ferr, line, L"Aggregate id[uint]: ", L"Uint expected", retries, &num);
+		if (table_agg_drop(table, num)) { afprintf(fout, L"Dropped aggregate %zu\n", num); }
+		else { afprintf(ferr, L"No aggregate %zu\n", num); }
+		return;
+	}
+	table_agg_spec_t spec = {0};
+	wchar_t prompt[PROMPT_SIZE];
+	get_uint(fin, fout, ferr, line, column_prompt(prompt, L"Group by column", NULL), L"Uint expected", retries, &num);
+	if (num >= TABLE_NCOLUMNS) {
+		afprintf(fout, L"Cancelled\n");
+		return;
+	}
+	spec.group = (column_t) num;
+	spec.filtered = get_yes(fin, fout, line, L"Filter rows? [y/N]: ");
+	if (spec.filtered && !get_findspec(fin, fout, ferr, line, retries, &spec.filter)) return;
+	if (table_agg_add(table, spec, &num)) {
+		afprintf(fout, L"Registered aggregate %zu\n", num);
+	}
+	else {
+		afprintf(ferr, L"Cannot build aggregate\n");
+	}
+}
+
+#define AGG_KEY_CASE(g, name, tag, kind, len, charset) \
+	case tag: afprintf(fout, ROW_FMT_##kind, (g).key.name); break;
+
+int print_aggs(FILE *fout, FILE *ferr, table_t const *table) {
+	size_t ids[TABLE_AGG_MAX];
+	table_agg_spec_t specs[TABLE_AGG_MAX];
+	size_t n = table_agg_list(table, ids, specs, TABLE_AGG_MAX);
+	if (n == 0) afprintf(fout, L"No aggregates\n");
+	for (size_t i = 0; i < n; i++) {
+		size_t ngroups = 0;
+		table_agg_read(table, ids[i], NULL, 0, &ngroups);
+		table_agg_group_t *groups = malloc((ngroups > 0 ? ngroups : 1) * sizeof(table_agg_group_t));
+		if (groups == NULL) {
+			afprintf(ferr, L"Cannot allocate %zu groups\n", ngroups);
+			return 0;
+		}
+		table_agg_read(table, ids[i], groups, ngroups, &ngroups);
+		afprintf(fout, L"aggregate %zu by column %d%s, %zu groups\n", ids[i], specs[i].group,
+			specs[i].filtered ? " (filtered)" : "", ngroups);
+		afprintf(fout, L"group\tcount\tsum c1\tmin c1\tmax c1\tsum c2\tmin c2\tmax c2\n");
+		for (size_t j = 0; j < ngroups; j++) {
+			switch (specs[i].group) {
+			default: break;
+			TABLE_SCHEMA(AGG_KEY_CASE, groups[j])
+			}
+			afprintf(fout, L"\t%zu\t%lld\t%lld\t%lld\t%f\t%f\t%f\n", groups[j].count,
+				(long long) groups[j].sum_c1, (long long) groups[j].min_c1, (long long) groups[j].max_c1,
+				groups[j].sum_c2, groups[j].min_c2, groups[j].max_c2);
+		}
+		free(groups);
+	}
+	return 1;
 }
 
 void export_table(FILE *fin, FILE *fout, FILE *ferr, table_t const *table, wchar_t *line,
@@ -342,6 +680,397 @@ void import_table(FILE *fin, FILE *fout, FILE *ferr, table_t **table, wchar_t *l
 	if (fload != NULL) fclose(fload);
 }
 
+void pack_table(FILE *fin, FILE *fout, FILE *ferr, table_t const *table, wchar_t *line, int retries) {
+	FILE *fsave = NULL;
+	if (table == NULL) { afprintf(ferr, L"No table\n"); return; }
+	do {
+		afprintf(fout, L"Path: ");
+		fgetws(line, MAX_LINE_SIZE, fin);
+		if (wcslen(line) == 1) { afprintf(fout, L"Cancelled\n"); return; }
+		size_t i = 0;
+		while (line[i] != L'\n' && line[i] != L'\0' && i < MAX_LINE_SIZE) i++;
+		line[i] = L'\0';
+		fsave = wide_fopen(line, L"wb");
+		if (fsave == NULL) { afprintf(fout, L"Cannot open file '"WSTR_FMT"'\n", line); }
+		else break;
+	}
+	while (retries--);
+	if (retries == 0) { afprintf(ferr, L"Max retries exceeded\n"); return; }
+	afprintf(fout, L"Packing current table to '"WSTR_FMT"'\n", line);
+	if (table_pack(fsave, table)) {
+		afprintf(fout, L"Packed %zu rows into %ld bytes\n", table->len, ftell(fsave));
+	}
+	else {
+		afprintf(ferr, L"Cannot pack table\n");
+	}
+	fclose(fsave);
+}
+
+void unpack_table(FILE *fin, FILE *fout, FILE *ferr, table_t **table, wchar_t *line, int retries) {
+	FILE *fload = NULL;
+	do {
+		afprintf(fout, L"Path: ");
+		fgetws(line, MAX_LINE_SIZE, fin);
+		if (wcslen(line) == 1) {
+			afprintf(fout, L"Cancelled\n");
+			return;
+		}
+		size_t i = 0;
+		while (line[i] != L'\n' && line[i] != L'\0' && i < MAX_LINE_SIZE) i++;
+		line[i] = L'\0';
+		fload = wide_fopen(line, L"rb");
+		if (fload == NULL) { afprintf(fout, L"Cannot open file '"WSTR_FMT"'\n", line); }
+		else { break; }
+	}
+	while (retries--);
+	if (retries == 0) { afprintf(ferr, L"Max retries exceeded\n"); return; }
+	afprintf(fout, L"Unpacking table from '"WSTR_FMT"'\n", line);
+	table_t *unpacked;
+	if (table_unpack(fload, &unpacked, 0)) {
+		if (*table != NULL) table_free(*table);
+		*table = unpacked;
+		afprintf(fout, L"Unpacked %zu rows\n", unpacked->len);
+	}
+	else {
+		afprintf(ferr, L"Cannot unpack table (not a packed table or corrupt)\n");
+	}
+	fclose(fload);
+}
+
+void export_csv(FILE *fin, FILE *fout, FILE *ferr, table_t const *table, wchar_t *line, int retries, char sep) {
+	FILE *fsave = NULL;
+	if (table == NULL) { afprintf(ferr, L"No table\n"); return; }
+	do {
+		afprintf(fout, L"Path: ");
+		fgetws(line, MAX_LINE_SIZE, fin);
+		if (wcslen(line) == 1) { afprintf(fout, L"Cancelled\n"); return; }
+		size_t i = 0;
+		while (line[i] != L'\n' && line[i] != L'\0' && i < MAX_LINE_SIZE) i++;
+		line[i] = L'\0';
+		fsave = wide_fopen(line, L"wb");
+		if (fsave == NULL) { afprintf(fout, L"Cannot open file '"WSTR_FMT"'\n", line); }
+		else break;
+	}
+	while (retries--);
+	if (retries == 0) { afprintf(ferr, L"Max retries exceeded\n"); return; }
+	afprintf(fout, L"Exporting current table to '"WSTR_FMT"'\n", line);
+	if (csv_export(fsave, table, sep, 0)) {
+		afprintf(fout, L"Exported %zu rows\n", table->len);
+	}
+	else {
+		afprintf(ferr, L"Cannot export table\n");
+	}
+	fclose(fsave);
+}
+
+void export_sorted(FILE *fin, FILE *fout, FILE *ferr, table_t const *table, wchar_t *line, int retries) {
+	if (table == NULL) { afprintf(ferr, L"No table\n"); return; }
+	table_sort_t sortspec;
+	if (!get_sortspec(fin, fout, ferr, line, retries, &sortspec)) return;
+	char sep = 0;
+	int rt = retries;
+	do {
+		afprintf(fout, L"Format[csv tsv pack]: ");
+		fgetws(line, MAX_LINE_SIZE, fin);
+		if (line[0] == L'\n') { afprintf(fout, L"Cancelled\n"); return; }
+		else if (PROMPT(L"csv")) { sep = ','; break; }
+		else if (PROMPT(L"tsv")) { sep = '\t'; break; }
+		else if (PROMPT(L"pack")) { sep = 0; break; }
+		else { afprintf(ferr, L"Format: csv tsv pack expected\n"); }
+	}
+	while (rt--);
+	if (rt == 0) { afprintf(ferr, L"Max retries exceeded\n"); return; }
+	size_t mb;
+	if (!get_uint(fin, fout, ferr, line, L"Memory budget MB[uint, blank = 64]: ", L"Uint expected\n", retries, &mb)) return;
+	size_t budget = mb > SIZE_MAX >> 20 ? SIZE_MAX : mb << 20;
+	FILE *fsave = NULL;
+	do {
+		afprintf(fout, L"Path: ");
+		fgetws(line, MAX_LINE_SIZE, fin);
+		if (wcslen(line) == 1) { afprintf(fout, L"Cancelled\n"); return; }
+		size_t i = 0;
+		while (line[i] != L'\n' && line[i] != L'\0' && i < MAX_LINE_SIZE) i++;
+		line[i] = L'\0';
+		fsave = wide_fopen(line, L"wb");
+		if (fsave == NULL) { afprintf(fout, L"Cannot open file '"WSTR_FMT"'\n", line); }
+		else break;
+	}
+	while (retries--);
+	if (retries == 0) { afprintf(ferr, L"Max retries exceeded\n"); return; }
+	afprintf(fout, L"Exporting sorted table to '"WSTR_FMT"'\n", line);
+	uint64_t start = clock_ns();
+	int ok = sep != 0 ? table_extsort_csv(fsave, table, sortspec, budget, NULL, sep)
+		: table_extsort_pack(fsave, table, sortspec, budget, NULL);
+	if (ok) {
+		afprintf(fout, L"Exported %zu rows in %.1f ms\n", table->len, (double) (clock_ns() - start) / 1e6);
+	}
+	else {
+		afprintf(ferr, L"Cannot export table\n");
+	}
+	fclose(fsave);
+}
+
+void import_csv(FILE *fin, FILE *fout, FILE *ferr, table_t **table, wchar_t *line, int retries, char sep) {
+	FILE *fload = NULL;
+	do {
+		afprintf(fout, L"Path: ");
+		fgetws(line, MAX_LINE_SIZE, fin);
+		if (wcslen(line) == 1) {
+			afprintf(fout, L"Cancelled\n");
+			return;
+		}
+		size_t i = 0;
+		while (line[i] != L'\n' && line[i] != L'\0' && i < MAX_LINE_SIZE) i++;
+		line[i] = L'\0';
+		fload = wide_fopen(line, L"rb");
+		if (fload == NULL) { afprintf(fout, L"Cannot open file '"WSTR_FMT"'\n", line); }
+		else { break; }
+	}
+	while (retries--);
+	if (retries == 0) { afprintf(ferr, L"Max retries exceeded\n"); return; }
+	afprintf(fout, L"Importing table from '"WSTR_FMT"'\n", line);
+	table_t *imported;
+	if (csv_import(fload, ferr, sep, 0, &imported)) {
+		if (*table != NULL) table_free(*table);
+		*table = imported;
+		afprintf(fout, L"Imported %zu rows\n", imported->len);
+	}
+	else {
+		afprintf(ferr, L"Cannot import table\n");
+	}
+	fclose(fload);
+}
+
+/*
+ * replaces *table with a file-backed one
+ * a new (empty) file gets a copy of the current table
+ */
+int map_table_at(char const *path, FILE *fout, FILE *ferr, table_t **table) {
+	table_t *mapped = table_map(path, 16);
+	if (mapped == NULL) {
+		afprintf(ferr, L"Cannot map file '%s' (not a table file or mmap unavailable)\n", path);
+		return 0;
+	}
+	if (mapped->len == 0 && *table != NULL && (*table)->rows != NULL && (*table)->len > 0) {
+		if (!table_append_batch(mapped, (*table)->rows, (*table)->len)) {
+			afprintf(ferr, L"Cannot copy current table to '%s'\n", path);
+			table_free(mapped);
+			return 0;
+		}
+		mapped->next_id = (*table)->next_id;
+		table_map_sync(mapped);
+		afprintf(fout, L"Copied %zu rows to '%s'\n", mapped->len, path);
+	}
+	if (*table != NULL) table_free(*table);
+	*table = mapped;
+	afprintf(fout, L"Mapped table with %zu rows\n", mapped->len);
+	return 1;
+}
+
+void map_table(FILE *fin, FILE *fout, FILE *ferr, table_t **table, wchar_t *line, int retries) {
+	char mbpath[MAX_FILE_PATH];
+	do {
+		afprintf(fout, L"Path: ");
+		fgetws(line, MAX_LINE_SIZE, fin);
+		if (wcslen(line) == 1) {
+			afprintf(fout, L"Cancelled\n");
+			return;
+		}
+		size_t i = 0;
+		while (line[i] != L'\n' && line[i] != L'\0' && i < MAX_LINE_SIZE) i++;
+		line[i] = L'\0';
+		if (wcstombs(mbpath, line, MAX_FILE_PATH) >= MAX_FILE_PATH) {
+			afprintf(fout, L"Bad path '"WSTR_FMT"'\n", line);
+		}
+		else if (map_table_at(mbpath, fout, ferr, table)) { return; }
+	}
+	while (retries--);
+	afprintf(ferr, L"Max retries exceeded\n");
+}
+
+int load_table_from(char const *path, FILE *ferr, table_t **table, wchar_t *line) {
+	wchar_t wpath[MAX_FILE_PATH];
+	if (mbstowcs(wpath, path, MAX_FILE_PATH) >= MAX_FILE_PATH) {
+		afprintf(ferr, L"Bad path '%s'\n", path);
+		return 0;
+	}
+	FILE *fload = wide_fopen(wpath, L"r"WFOPEN_ARG);
+	if (fload == NULL) {
+		afprintf(ferr, L"Cannot open file '%s'\n", path);
+		return 0;
+	}
+	int ok = load_table(fload, ferr, table, line);
+	if (!ok) afprintf(ferr, L"Cannot load table\n");
+	fclose(fload);
+	return ok;
+}
+
+/*
+ * copies the next whitespace-delimited word of *s to out (cap includes L'\0')
+ * returns 1 if there was a word that fits, 0 otherwise
+ */
+int take_word(wchar_t const **s, wchar_t *out, size_t cap) {
+	wchar_t const *p = *s;
+	while (*p == L' ' || *p == L'\t') p++;
+	size_t len = 0;
+	while (p[len] != L'\0' && p[len] != L' ' && p[len] != L'\t' && p[len] != L'\n') len++;
+	if (len == 0 || len >= cap) return 0;
+	wmemcpy(out, p, len);
+	out[len] = L'\0';
+	*s = p + len;
+	return 1;
+}
+
+/*
+ * `load NAME PATH`, loads a dump into the named table
+ */
+void load_named(FILE *fout, FILE *ferr, catalog_t *catalog, wchar_t const *current, table_t **table,
+	wchar_t *line) {
+	wchar_t name[CATALOG_NAME_LEN + 1], path[MAX_FILE_PATH];
+	wchar_t const *args = line + wcslen(L"load");
+	if (!take_word(&args, name, CATALOG_NAME_LEN + 1) || !take_word(&args, path, MAX_FILE_PATH)) {
+		afprintf(ferr, L"usage: load NAME PATH\n");
+		return;
+	}
+	catalog_entry_t *entry = catalog_add(catalog, name);
+	if (entry == NULL) {
+		afprintf(ferr, L"Bad table name '"WSTR_FMT"'\n", name);
+		return;
+	}
+	FILE *fload = wide_fopen(path, L"r"WFOPEN_ARG);
+	if (fload == NULL) {
+		afprintf(ferr, L"Cannot open file '"WSTR_FMT"'\n", path);
+		return;
+	}
+	table_t *loaded;
+	if (load_table(fload, ferr, &loaded, line)) {
+		if (wcscmp(name, current) == 0) {
+			if (*table != NULL && *table != loaded) table_free(*table);
+			*table = loaded;
+			entry->table = loaded;
+		}
+		else {
+			catalog_replace(entry, loaded);
+		}
+		afprintf(fout, L"Loaded %zu rows into '"WSTR_FMT"'\n", loaded->len, name);
+	}
+	else {
+		afprintf(ferr, L"Cannot load table\n");
+	}
+	fclose(fload);
+}
+
+/*
+ * `use NAME`, makes the named table current, a new name gets an empty entry
+ * current is updated, it should have room for CATALOG_NAME_LEN + 1 characters
+ */
+void use_named(FILE *fout, FILE *ferr, catalog_t *catalog, wchar_t *current, table_t **table, wchar_t *line) {
+	wchar_t name[CATALOG_NAME_LEN + 1];
+	wchar_t const *args = line + wcslen(L"use");
+	if (!take_word(&args, name, CATALOG_NAME_LEN + 1)) {
+		afprintf(ferr, L"usage: use NAME\n");
+		return;
+	}
+	int exists = catalog_find(catalog, name) != NULL;
+	catalog_find(catalog, current)->table = *table;
+	catalog_entry_t *entry = catalog_add(catalog, name);
+	if (entry == NULL) {
+		afprintf(ferr, L"Bad table name '"WSTR_FMT"'\n", name);
+		return;
+	}
+	wcscpy(current, name);
+	*table = entry->table;
+	if (!exists) { afprintf(fout, L"New table '"WSTR_FMT"'\n", name); }
+	else { afprintf(fout, L"Using '"WSTR_FMT"' (%zu rows)\n", name, *table != NULL ? (*table)->len : 0); }
+}
+
+void print_tables(FILE *fout, catalog_t const *catalog, wchar_t const *current, table_t const *table) {
+	for (size_t i = 0; i < catalog->len; i++) {
+		catalog_entry_t const *entry = &catalog->entries[i];
+		int is_current = wcscmp(entry->name, current) == 0;
+		table_t const *t = is_current ? table : entry->table;
+		afprintf(fout, L"%lc "WSTR_FMT"\t%zu rows\n", is_current ? L'*' : L' ', entry->name,
+			t != NULL ? t->len : 0);
+	}
+}
+
+static void print_pair(dbrow_t const *left, dbrow_t const *right, void *arg) {
+	FILE *fout = arg;
+	afprintf(fout, ROW_JOIN_FORMAT, ROW_ARG((*left)), ROW_ARG((*right)));
+}
+
+/*
+ * returns 1 on success, 0 if cancelled
+ */
+int get_join_column(FILE *fin, FILE *fout, FILE *ferr, wchar_t *line, int retries, wchar_t const *prompt,
+	column_t *out_column) {
+	size_t colnum;
+	get_uint(fin, fout, ferr, line, prompt, L"Uint expected\n", retries, &colnum);
+	if (colnum >= TABLE_NCOLUMNS || !table_join_column((column_t) colnum)) {
+		afprintf(fout, L"Cancelled\n");
+		return 0;
+	}
+	*out_column = (column_t) colnum;
+	return 1;
+}
+
+void join_tables(FILE *fin, FILE *fout, FILE *ferr, catalog_t const *catalog, wchar_t const *current,
+	table_t *table, wchar_t *line, int retries) {
+	if (table == NULL) {
+		afprintf(ferr, L"No table\n");
+		return;
+	}
+	wchar_t name[CATALOG_NAME_LEN + 1];
+	afprintf(fout, L"Right table: ");
+	fgetws(line, MAX_LINE_SIZE, fin);
+	wchar_t const *args = line;
+	if (!take_word(&args, name, CATALOG_NAME_LEN + 1)) {
+		afprintf(fout, L"Cancelled\n");
+		return;
+	}
+	catalog_entry_t const *entry = catalog_find(catalog, name);
+	table_t const *right = wcscmp(name, current) == 0 ? table : entry != NULL ? entry->table : NULL;
+	if (right == NULL) {
+		afprintf(ferr, L"No table '"WSTR_FMT"'\n", name);
+		return;
+	}
+	column_t left_column, right_column;
+	wchar_t prompt[PROMPT_SIZE];
+	if (!get_join_column(fin, fout, ferr, line, retries, column_prompt(prompt, L"Left column", table_join_column),
+			&left_column)) return;
+	if (!get_join_column(fin, fout, ferr, line, retries, column_prompt(prompt, L"Right column", table_join_column),
+			&right_column)) return;
+	afprintf(fout, ROW_JOIN_HEADER);
+	size_t pairs;
+	if (table_join(table, left_column, right, right_column, print_pair, fout, &pairs)) {
+		afprintf(fout, L"%zu pairs\n", pairs);
+	}
+	else {
+		afprintf(ferr, L"Cannot join (columns should both be integers 0 1 or strings 3 5)\n");
+	}
+}
+
+int print_cache_stats(FILE *fout, table_t const *table) {
+	table_cache_stats_t cs;
+	table_cache_stats(table, &cs);
+	afprintf(fout, L"Query cache: %llu hits, %llu misses, %llu evictions, %zu entries, %zu bytes\n",
+		(unsigned long long) cs.hits, (unsigned long long) cs.misses,
+		(unsigned long long) cs.evictions, cs.entries, cs.bytes);
+	return 1;
+}
+
+int print_usage(FILE *ferr, char const *argv0) {
+	afprintf(ferr,
+		L"usage: %s [--no-menu] [--load DUMP | --map FILE] [--serve SOCKET [--follow PRIMARY] [--workers N]]\n"
+		L"        --no-menu\tDo not print menu on start\n"
+		L"        --load\tLoad table from dump before start\n"
+		L"        --map\tOpen file-backed table before start\n"
+		L"        --serve\tServe table over unix domain socket instead of stdin\n"
+		L"        --follow\tServe a read-only replica of the server at socket PRIMARY\n"
+		L"        --workers\tServer threads, default is one per cpu\n", argv0);
+	return 1;
+}
+
 int main(int argc, char *argv[]) {
 	setlocale(LC_ALL, "ru_RU.utf8");
 	setlocale(LC_NUMERIC, "C"); // float dots
@@ -363,7 +1092,40 @@ int main(int argc, char *argv[]) {
 #endif
 	table_t *table = NULL;
 	wchar_t line[MAX_LINE_SIZE] = {0};
-	if (!(argc > 1 && strcmp(argv[1], "--no-menu") == 0)) print_menu(fout);
+	int no_menu = 0;
+	char const *load_path = NULL, *map_path = NULL, *serve_path = NULL, *primary = NULL;
+	size_t workers = 0;
+	for (int i = 1; i < argc; i++) {
+		char const *val = i + 1 < argc ? argv[i + 1] : NULL;
+		if (strcmp(argv[i], "--no-menu") == 0) { no_menu = 1; continue; }
+		else if (val == NULL) { print_usage(ferr, argv[0]); return EXIT_FAILURE; }
+		else if (strcmp(argv[i], "--load") == 0) { load_path = val; }
+		else if (strcmp(argv[i], "--map") == 0) { map_path = val; }
+		else if (strcmp(argv[i], "--serve") == 0) { serve_path = val; }
+		else if (strcmp(argv[i], "--follow") == 0) { primary = val; }
+		else if (strcmp(argv[i], "--workers") == 0) { workers = strtoul(val, NULL, 10); }
+		else { print_usage(ferr, argv[0]); return EXIT_FAILURE; }
+		i++;
+	}
+	if (primary != NULL && serve_path == NULL) { print_usage(ferr, argv[0]); return EXIT_FAILURE; }
+	if (load_path != NULL && !load_table_from(load_path, ferr, &table, line)) return EXIT_FAILURE;
+	if (map_path != NULL && !map_table_at(map_path, NULL, ferr, &table)) return EXIT_FAILURE;
+	if (serve_path != NULL) {
+		if (table == NULL) table = table_new(16);
+		int ok = table != NULL && server_run(table, serve_path, primary, workers, ferr);
+		if (table != NULL) table_free(table);
+		return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+	// table is the current one, the catalog gets it back after every command
+	catalog_t *catalog = catalog_new();
+	wchar_t current[CATALOG_NAME_LEN + 1] = L"main";
+	if (catalog == NULL || catalog_add(catalog, current) == NULL) {
+		afprintf(ferr, L"Cannot create catalog\n");
+		catalog_free(catalog);
+		if (table != NULL) table_free(table);
+		return EXIT_FAILURE;
+	}
+	if (!no_menu) print_menu(fout);
 	int retries = 3;
 	while (1) {
 		afprintf(fout, L"> ");
@@ -392,6 +1154,12 @@ int main(int argc, char *argv[]) {
 		else if (PROMPT(L"p") || PROMPT(L"print")) {
 			print_table(fout, ferr, table, 0);
 		}
+		else if (PROMPT(L"gen") || wcsncmp(line, L"gen ", 4) == 0) {
+			gen_table(fin, fout, ferr, &table, line, retries);
+		}
+		else if (PROMPT(L"page")) {
+			page_table(fin, fout, ferr, table, line, retries);
+		}
 		else if (PROMPT(L"a") || PROMPT(L"add")) {
 			if (table == NULL) table = table_new(16);
 			add_row(fin, fout, ferr, table, line, retries);
@@ -411,6 +1179,86 @@ int main(int argc, char *argv[]) {
 		else if (PROMPT(L"l") || PROMPT(L"load") || PROMPT(L"import")) {
 			import_table(fin, fout, ferr, &table, line, retries);
 		}
+		else if (wcsncmp(line, L"load ", 5) == 0) {
+			load_named(fout, ferr, catalog, current, &table, line);
+		}
+		else if (wcsncmp(line, L"use ", 4) == 0) {
+			use_named(fout, ferr, catalog, current, &table, line);
+		}
+		else if (PROMPT(L"tables")) {
+			print_tables(fout, catalog, current, table);
+		}
+		else if (PROMPT(L"join")) {
+			join_tables(fin, fout, ferr, catalog, current, table, line, retries);
+		}
+		else if (PROMPT(L"pack")) {
+			pack_table(fin, fout, ferr, table, line, retries);
+		}
+		else if (PROMPT(L"unpack")) {
+			unpack_table(fin, fout, ferr, &table, line, retries);
+		}
+		else if (PROMPT(L"export csv")) {
+			export_csv(fin, fout, ferr, table, line, retries, ',');
+		}
+		else if (PROMPT(L"export tsv")) {
+			export_csv(fin, fout, ferr, table, line, retries, '\t');
+		}
+		else if (PROMPT(L"export sorted")) {
+			export_sorted(fin, fout, ferr, table, line, retries);
+		}
+		else if (PROMPT(L"import csv")) {
+			import_csv(fin, fout, ferr, &table, line, retries, ',');
+		}
+		else if (PROMPT(L"import tsv")) {
+			import_csv(fin, fout, ferr, &table, line, retries, '\t');
+		}
+		else if (PROMPT(L"view")) {
+			view_table(fin, fout, ferr, table, line, retries, 0);
+		}
+		else if (PROMPT(L"unview")) {
+			view_table(fin, fout, ferr, table, line, retries, 1);
+		}
+		else if (PROMPT(L"views")) {
+			print_views(fout, table);
+		}
+		else if (PROMPT(L"index")) {
+			index_table(fin, fout, ferr, table, line, retries, 0);
+		}
+		else if (PROMPT(L"unindex")) {
+			index_table(fin, fout, ferr, table, line, retries, 1);
+		}
+		else if (PROMPT(L"m") || PROMPT(L"map")) {
+			map_table(fin, fout, ferr, &table, line, retries);
+		}
+		else if (PROMPT(L"analyze")) {
+			analyze_table(fout, ferr, table);
+		}
+		else if (PROMPT(L"explain")) {
+			explain_find(fin, fout, ferr, table, line, retries);
+		}
+		else if (PROMPT(L"distinct")) {
+			distinct_table(fin, fout, ferr, table, line, retries);
+		}
+		else if (PROMPT(L"estimate")) {
+			estimate_find(fin, fout, ferr, table, line, retries);
+		}
+		else if (PROMPT(L"agg")) {
+			agg_table(fin, fout, ferr, table, line, retries, 0);
+		}
+		else if (PROMPT(L"unagg")) {
+			agg_table(fin, fout, ferr, table, line, retries, 1);
+		}
+		else if (PROMPT(L"aggs")) {
+			print_aggs(fout, ferr, table);
+		}
+		else if (PROMPT(L"stats")) {
+			stats_print(fout);
+			print_cache_stats(fout, table);
+		}
+		else if (PROMPT(L"stats reset")) {
+			stats_reset();
+			afprintf(fout, L"Stats cleared\n");
+		}
 		else if (PROMPT(L"t_i")) {
 			int64_t testi;
 			afprintf(fout, L"Int: ");
@@ -446,7 +1294,9 @@ int main(int argc, char *argv[]) {
 		else {
 			afprintf(fout, L"Unknown command: "WSTR_FMT, line);
 		}
+		catalog_find(catalog, current)->table = table;
 	}
-	if (table != NULL) table_free(table);
+	catalog_find(catalog, current)->table = table;
+	catalog_free(catalog);
 	return EXIT_SUCCESS;
 }
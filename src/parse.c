@@ -68,3 +68,25 @@ int wparse_float(wchar_t *str, double *out_result) {
 	return 1;
 }
 
+
+int wparse_bool(wchar_t *str, bool *out_result) {
+	static wchar_t const *const no[] = {L"", L"0", L"F", L"f", L"OFF", L"off", L"FALSE", L"false"};
+	static wchar_t const *const yes[] = {L"1", L"T", L"t", L"ON", L"on", L"TRUE", L"true"};
+	if (str == NULL || out_result == NULL) return 0;
+	size_t len = 0;
+	while (str[len] != L'\0' && str[len] != L'\n') len++;
+	if (str[len] == L'\n' && str[len + 1] != L'\0') return 0;
+	for (size_t i = 0; i < sizeof(no) / sizeof(no[0]); i++) {
+		if (wcslen(no[i]) == len && wcsncmp(no[i], str, len) == 0) {
+			*out_result = 0;
+			return 1;
+		}
+	}
+	for (size_t i = 0; i < sizeof(yes) / sizeof(yes[0]); i++) {
+		if (wcslen(yes[i]) == len && wcsncmp(yes[i], str, len) == 0) {
+			*out_result = 1;
+			return 1;
+		}
+	}
+	return 0;
+}
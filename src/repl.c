@@ -0,0 +1,473 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "repl.h"
+
+#ifndef _WIN32
+
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "defs.h"
+#include "clock.h"
+#include "thread.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+// bytes a follower thread copies out of the log per write
+#define SEND_CHUNK (1u << 20)
+#define RETRY_MIN_MS 10
+#define RETRY_MAX_MS 1000
+
+typedef struct {
+	repl_log_t *log;
+	thread_t thread;
+	int fd;
+	uint64_t offset; // stream offset of the next byte to send
+	int dropped; // disconnected by the log
+	int done; // thread finished, fd is closed
+	// snapshot to send first, NULL when resuming
+	table_mvcc_t *mvcc;
+	table_snap_t const *snap;
+	uint64_t snap_epoch, snap_seq;
+} repl_sub_t;
+
+struct repl_log {
+	mutex_t lock; // guards everything below
+	cond_t cond; // new changes or stop
+	uint64_t epoch;
+	uint64_t seq; // last logged change
+	// encoded messages (proto_header_t + proto_change_t + rows) from stream offset `base`
+	char *buf;
+	size_t len, cap;
+	uint64_t base;
+	repl_sub_t **subs;
+	size_t nsubs, subs_cap;
+	int stop;
+};
+
+struct repl_replica {
+	char *primary;
+	table_mvcc_t *mvcc;
+	FILE *ferr;
+	thread_t thread;
+	mutex_t lock; // guards fd and stop
+	int fd; // connection to the primary, -1 between connections
+	int stop;
+	// last applied change
+	uint64_t epoch;
+	uint64_t seq;
+};
+
+static int write_full(int fd, void const *buf, size_t n) {
+	char const *p = buf;
+	while (n > 0) {
+		ssize_t put = send(fd, p, n, MSG_NOSIGNAL);
+		if (put < 0 && errno == EINTR) continue;
+		if (put <= 0) return 0;
+		p += put;
+		n -= (size_t) put;
+	}
+	return 1;
+}
+
+static int send_change(int fd, proto_change_t change, dbrow_t const *rows) {
+	size_t bytes = change.count * sizeof(dbrow_t);
+	proto_header_t hdr = {.op = PS_OK, .len = (uint32_t) (sizeof(change) + bytes)};
+	return write_full(fd, &hdr, sizeof(hdr)) && write_full(fd, &change, sizeof(change))
+		&& (bytes == 0 || write_full(fd, rows, bytes));
+}
+
+// lock held
+static void drop(repl_sub_t *sub) {
+	if (sub->done || sub->dropped) return;
+	sub->dropped = 1;
+	// wakes the thread up from a blocked send, it closes fd itself
+	shutdown(sub->fd, SHUT_RDWR);
+}
+
+// lock held, forgets whole messages nobody needs
+static void trim(repl_log_t *log) {
+	if (log->len <= 2 * (size_t) REPL_LOG_KEEP) return;
+	uint64_t end = log->base + log->len, keep = end - REPL_LOG_KEEP;
+	for (size_t i = 0; i < log->nsubs; i++) {
+		repl_sub_t *sub = log->subs[i];
+		if (sub->done || sub->dropped) continue;
+		if (end - sub->offset > REPL_LOG_MAX) drop(sub);
+		else if (sub->offset < keep) keep = sub->offset;
+	}
+	size_t cut = 0;
+	while (cut < log->len) {
+		proto_header_t hdr;
+		memcpy(&hdr, log->buf + cut, sizeof(hdr));
+		size_t next = cut + sizeof(hdr) + hdr.len;
+		if (log->base + next > keep) break;
+		cut = next;
+	}
+	if (cut == 0) return;
+	memmove(log->buf, log->buf + cut, log->len - cut);
+	log->len -= cut;
+	log->base += cut;
+}
+
+// lock held
+static void put_change(repl_log_t *log, proto_change_t change, dbrow_t const *rows) {
+	size_t bytes = change.count * sizeof(dbrow_t);
+	size_t need = sizeof(proto_header_t) + sizeof(change) + bytes;
+	if (log->len + need > log->cap) {
+		size_t cap = log->cap * 2 > log->len + need ? log->cap * 2 : log->len + need;
+		char *grown = realloc(log->buf, cap);
+		if (grown == NULL) {
+			// followers cannot get this change, so none can resume past it
+			for (size_t i = 0; i < log->nsubs; i++) drop(log->subs[i]);
+			log->base += log->len;
+			log->len = 0;
+			log->epoch++;
+			log->seq = 0;
+			return;
+		}
+		log->buf = grown;
+		log->cap = cap;
+	}
+	proto_header_t hdr = {.op = PS_OK, .len = (uint32_t) (sizeof(change) + bytes)};
+	char *p = log->buf + log->len;
+	memcpy(p, &hdr, sizeof(hdr));
+	memcpy(p + sizeof(hdr), &change, sizeof(change));
+	if (bytes > 0) memcpy(p + sizeof(hdr) + sizeof(change), rows, bytes);
+	log->len += need;
+	trim(log);
+	cond_broadcast(&log->cond);
+}
+
+repl_log_t *repl_log_new(void) {
+	repl_log_t *log = calloc(1, sizeof(repl_log_t));
+	if (log == NULL) goto no_log;
+	if (!mutex_init(&log->lock)) goto no_lock;
+	if (!cond_init(&log->cond)) goto no_cond;
+	// a restarted primary numbers its changes from 1 again
+	log->epoch = (clock_ns() ^ ((uint64_t) getpid() << 40)) | 1;
+	return log;
+no_cond:
+	mutex_destroy(&log->lock);
+no_lock:
+	free(log);
+no_log:
+	return NULL;
+}
+
+void repl_log_free(repl_log_t *log) {
+	if (log == NULL) return;
+	mutex_lock(&log->lock);
+	log->stop = 1;
+	for (size_t i = 0; i < log->nsubs; i++) drop(log->subs[i]);
+	cond_broadcast(&log->cond);
+	mutex_unlock(&log->lock);
+	for (size_t i = 0; i < log->nsubs; i++) {
+		thread_join(log->subs[i]->thread);
+		free(log->subs[i]);
+	}
+	free(log->subs);
+	free(log->buf);
+	cond_destroy(&log->cond);
+	mutex_destroy(&log->lock);
+	free(log);
+}
+
+void repl_log_append(repl_log_t *log, dbrow_t const *rows, size_t n) {
+	if (log == NULL || n == 0) return;
+	mutex_lock(&log->lock);
+	for (size_t i = 0; i < n; i += PROTO_MAX_ROWS) {
+		size_t cnt = n - i < PROTO_MAX_ROWS ? n - i : PROTO_MAX_ROWS;
+		proto_change_t change = {.op = CH_APPEND, .count = (uint32_t) cnt, .epoch = log->epoch, .seq = ++log->seq};
+		put_change(log, change, rows + i);
+	}
+	mutex_unlock(&log->lock);
+}
+
+void repl_log_remove(repl_log_t *log, uint64_t id) {
+	if (log == NULL) return;
+	mutex_lock(&log->lock);
+	proto_change_t change = {.op = CH_REMOVE, .epoch = log->epoch, .seq = ++log->seq, .id = id};
+	put_change(log, change, NULL);
+	mutex_unlock(&log->lock);
+}
+
+static int send_snapshot(repl_sub_t *sub, dbrow_t *rows) {
+	table_snap_t const *snap = sub->snap;
+	size_t len = table_snap_len(snap);
+	proto_change_t change = {.op = CH_SNAPSHOT, .epoch = sub->snap_epoch, .seq = sub->snap_seq, .id = len};
+	if (!send_change(sub->fd, change, NULL)) return 0;
+	change.op = CH_ROWS;
+	for (size_t i = 0; i < len;) {
+		size_t n = table_snap_rows(snap, i, rows, REPL_SNAPSHOT_ROWS);
+		change.count = (uint32_t) n;
+		if (!send_change(sub->fd, change, rows)) return 0;
+		i += n;
+	}
+	change.op = CH_SYNCED;
+	change.count = 0;
+	change.id = table_snap_next_id(snap);
+	return send_change(sub->fd, change, NULL);
+}
+
+static void sub_main(void *arg) {
+	repl_sub_t *sub = arg;
+	repl_log_t *log = sub->log;
+	char *chunk = malloc(SEND_CHUNK > REPL_SNAPSHOT_ROWS * sizeof(dbrow_t) ? SEND_CHUNK
+		: REPL_SNAPSHOT_ROWS * sizeof(dbrow_t));
+	int ok = chunk != NULL;
+	if (sub->snap != NULL) {
+		ok = ok && send_snapshot(sub, (dbrow_t *) chunk);
+		table_snap_release(sub->mvcc, sub->snap);
+		sub->snap = NULL;
+	}
+	while (ok) {
+		mutex_lock(&log->lock);
+		while (!log->stop && !sub->dropped && sub->offset == log->base + log->len) {
+			cond_wait(&log->cond, &log->lock);
+		}
+		if (log->stop || sub->dropped || sub->offset < log->base) {
+			mutex_unlock(&log->lock);
+			break;
+		}
+		size_t at = (size_t) (sub->offset - log->base);
+		size_t n = log->len - at < SEND_CHUNK ? log->len - at : SEND_CHUNK;
+		memcpy(chunk, log->buf + at, n);
+		mutex_unlock(&log->lock);
+		ok = write_full(sub->fd, chunk, n);
+		mutex_lock(&log->lock);
+		sub->offset += n;
+		mutex_unlock(&log->lock);
+	}
+	free(chunk);
+	mutex_lock(&log->lock);
+	// under the lock, so drop never shuts down a reused descriptor
+	close(sub->fd);
+	sub->done = 1;
+	mutex_unlock(&log->lock);
+}
+
+// lock held, stream offset of the first change after req, 0 if the log cannot resume there
+static int resume_offset(repl_log_t const *log, proto_follow_t req, uint64_t *out_offset) {
+	if (req.epoch != log->epoch || req.seq > log->seq) return 0;
+	size_t at = 0;
+	while (at < log->len) {
+		proto_header_t hdr;
+		proto_change_t change;
+		memcpy(&hdr, log->buf + at, sizeof(hdr));
+		memcpy(&change, log->buf + at + sizeof(hdr), sizeof(change));
+		if (change.seq > req.seq) {
+			if (change.seq != req.seq + 1) return 0;
+			break;
+		}
+		at += sizeof(hdr) + hdr.len;
+	}
+	// an empty log can only resume a follower that has everything
+	if (at == log->len && req.seq != log->seq) return 0;
+	*out_offset = log->base + at;
+	return 1;
+}
+
+// lock held, joins finished threads and makes room for one more
+static int reap(repl_log_t *log) {
+	size_t kept = 0;
+	for (size_t i = 0; i < log->nsubs; i++) {
+		if (log->subs[i]->done) {
+			thread_join(log->subs[i]->thread);
+			free(log->subs[i]);
+		}
+		else {
+			log->subs[kept++] = log->subs[i];
+		}
+	}
+	log->nsubs = kept;
+	if (log->nsubs < log->subs_cap) return 1;
+	size_t cap = log->subs_cap ? log->subs_cap * 2 : 8;
+	repl_sub_t **grown = realloc(log->subs, cap * sizeof(repl_sub_t *));
+	if (grown == NULL) return 0;
+	log->subs = grown;
+	log->subs_cap = cap;
+	return 1;
+}
+
+int repl_log_follow(repl_log_t *log, table_mvcc_t *mvcc, int fd, proto_follow_t req) {
+	if (log == NULL || mvcc == NULL) goto no_sub;
+	repl_sub_t *sub = calloc(1, sizeof(repl_sub_t));
+	if (sub == NULL) goto no_sub;
+	sub->log = log;
+	sub->fd = fd;
+	mutex_lock(&log->lock);
+	if (log->stop || !reap(log)) goto no_room;
+	if (!resume_offset(log, req, &sub->offset)) {
+		// the caller holds the write lock, nothing is logged between the snapshot and offset
+		sub->mvcc = mvcc;
+		sub->snap = table_snap_acquire(mvcc);
+		sub->snap_epoch = log->epoch;
+		sub->snap_seq = log->seq;
+		sub->offset = log->base + log->len;
+	}
+	if (!thread_create(&sub->thread, sub_main, sub)) goto no_thread;
+	log->subs[log->nsubs++] = sub;
+	mutex_unlock(&log->lock);
+	return 1;
+no_thread:
+	if (sub->snap != NULL) table_snap_release(mvcc, sub->snap);
+no_room:
+	mutex_unlock(&log->lock);
+	free(sub);
+no_sub:
+	close(fd);
+	return 0;
+}
+
+static int stopping(repl_replica_t *replica) {
+	mutex_lock(&replica->lock);
+	int stop = replica->stop;
+	mutex_unlock(&replica->lock);
+	return stop;
+}
+
+// returns 0 if stopped while waiting
+static int wait_ms(repl_replica_t *replica, unsigned ms) {
+	struct timespec step = {.tv_nsec = RETRY_MIN_MS * 1000000L};
+	for (unsigned waited = 0; waited < ms; waited += RETRY_MIN_MS) {
+		if (stopping(replica)) return 0;
+		nanosleep(&step, NULL);
+	}
+	return !stopping(replica);
+}
+
+static int remove_id(table_mvcc_t *mvcc, uint64_t id) {
+	table_find_t findspec = {.column = TC_ID, .condition = C_EQ, .data1.id = id};
+	size_t pos;
+	table_snap_t const *snap = table_snap_acquire(mvcc);
+	int found = table_snap_find_first(snap, findspec, &pos);
+	table_snap_release(mvcc, snap);
+	return found && table_mvcc_remove_at(mvcc, pos);
+}
+
+/*
+ * applies changes from fd until the stream breaks
+ * returns 1 if anything was applied (the connection was useful), 0 otherwise
+ */
+static int follow(repl_replica_t *replica, int fd) {
+	proto_change_t change;
+	dbrow_t *rows = NULL, *snapshot = NULL;
+	size_t rows_cap = 0, snap_len = 0, snap_cap = 0;
+	int useful = 0, ok = 1;
+	proto_follow_t req = {.epoch = replica->epoch, .seq = replica->seq};
+	if (!client_follow(fd, req)) return 0;
+	while (ok && client_next_change(fd, &change, &rows, &rows_cap)) {
+		switch (change.op) {
+		default:
+			ok = 0;
+			break;
+		case CH_SNAPSHOT:
+			snap_len = 0;
+			if (change.id > snap_cap) {
+				free(snapshot);
+				snapshot = malloc(change.id * sizeof(dbrow_t));
+				snap_cap = snapshot != NULL ? change.id : 0;
+			}
+			ok = change.id <= snap_cap;
+			break;
+		case CH_ROWS:
+			ok = snap_len + change.count <= snap_cap;
+			if (ok) memcpy(snapshot + snap_len, rows, change.count * sizeof(dbrow_t));
+			snap_len += change.count;
+			break;
+		case CH_SYNCED:
+			ok = table_mvcc_replace(replica->mvcc, snapshot, snap_len, change.id);
+			if (!ok) break;
+			replica->epoch = change.epoch;
+			replica->seq = change.seq;
+			afprintf(replica->ferr, L"Synced %zu rows at change %llu\n", snap_len,
+				(unsigned long long) change.seq);
+			free(snapshot);
+			snapshot = NULL;
+			snap_cap = 0;
+			break;
+		case CH_APPEND:
+		case CH_REMOVE:
+			// a gap means lost changes, the next connection starts over with a snapshot
+			if (change.epoch != replica->epoch || change.seq != replica->seq + 1) ok = 0;
+			else if (change.op == CH_APPEND) ok = table_mvcc_append(replica->mvcc, rows, change.count);
+			else ok = remove_id(replica->mvcc, change.id);
+			if (ok) replica->seq = change.seq;
+			else replica->epoch = replica->seq = 0;
+			break;
+		}
+		useful = useful || ok;
+	}
+	free(snapshot);
+	free(rows);
+	return useful;
+}
+
+static void replica_main(void *arg) {
+	repl_replica_t *replica = arg;
+	unsigned retry_ms = 0;
+	while (wait_ms(replica, retry_ms)) {
+		int fd;
+		retry_ms = retry_ms == 0 ? RETRY_MIN_MS : retry_ms * 2 < RETRY_MAX_MS ? retry_ms * 2 : RETRY_MAX_MS;
+		if (!client_connect(replica->primary, &fd)) continue;
+		mutex_lock(&replica->lock);
+		int stop = replica->stop;
+		if (!stop) replica->fd = fd;
+		mutex_unlock(&replica->lock);
+		if (stop) {
+			client_close(fd);
+			break;
+		}
+		int useful = follow(replica, fd);
+		mutex_lock(&replica->lock);
+		replica->fd = -1;
+		mutex_unlock(&replica->lock);
+		client_close(fd);
+		if (useful && !stopping(replica)) {
+			afprintf(replica->ferr, L"Lost primary after change %llu\n", (unsigned long long) replica->seq);
+			retry_ms = 0;
+		}
+	}
+}
+
+repl_replica_t *repl_replica_start(char const *primary, table_mvcc_t *mvcc, FILE *ferr) {
+	if (primary == NULL || mvcc == NULL) goto no_replica;
+	repl_replica_t *replica = calloc(1, sizeof(repl_replica_t));
+	if (replica == NULL) goto no_replica;
+	replica->primary = malloc(strlen(primary) + 1);
+	if (replica->primary == NULL) goto no_path;
+	strcpy(replica->primary, primary);
+	replica->mvcc = mvcc;
+	replica->ferr = ferr;
+	replica->fd = -1;
+	if (!mutex_init(&replica->lock)) goto no_lock;
+	if (!thread_create(&replica->thread, replica_main, replica)) goto no_thread;
+	return replica;
+no_thread:
+	mutex_destroy(&replica->lock);
+no_lock:
+	free(replica->primary);
+no_path:
+	free(replica);
+no_replica:
+	return NULL;
+}
+
+void repl_replica_stop(repl_replica_t *replica) {
+	if (replica == NULL) return;
+	mutex_lock(&replica->lock);
+	replica->stop = 1;
+	if (replica->fd >= 0) shutdown(replica->fd, SHUT_RDWR);
+	mutex_unlock(&replica->lock);
+	thread_join(replica->thread);
+	mutex_destroy(&replica->lock);
+	free(replica->primary);
+	free(replica);
+}
+
+#endif
@@ -0,0 +1,523 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "server.h"
+#include "defs.h"
+
+#ifdef _WIN32
+
+int server_run(table_t *table, char const *path, char const *primary, size_t workers, FILE *ferr) {
+	(void) table;
+	(void) path;
+	(void) primary;
+	(void) workers;
+	afprintf(ferr, L"Server mode needs unix domain sockets\n");
+	return 0;
+}
+
+#else
+
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include "proto.h"
+#include "thread.h"
+#include "table_mvcc.h"
+#include "table_cursor.h"
+#include "repl.h"
+#include "table_view.h"
+#include "table_trgm.h"
+#include "table_agg.h"
+#include "table_map.h"
+#include "collate.h"
+#include "get.h"
+
+typedef struct {
+	// readers work on snapshots and never block, writers take write_lock
+	table_mvcc_t *mvcc;
+	mutex_t write_lock;
+	// exactly one of them: primaries log their writes, replicas take writes from a primary only
+	repl_log_t *log;
+	repl_replica_t *replica;
+	mutex_t queue_lock;
+	cond_t queue_cond;
+	int *queue; // connections with a pending request
+	size_t queue_cap, queue_head, queue_len;
+	int stop;
+	int wake_w; // idle connections go back to the poller through this pipe
+} server_t;
+
+typedef struct {
+	server_t *server;
+	int fd; // connection in a request, -1 when idle, under queue_lock
+	char *in;
+	size_t in_cap;
+	char *out;
+	size_t out_cap;
+	size_t *idx;
+	size_t idx_cap;
+} worker_t;
+
+static int wake_fd = -1;
+
+static void on_signal(int sig) {
+	(void) sig;
+	int stop = -1;
+	if (wake_fd >= 0) (void) !write(wake_fd, &stop, sizeof(stop));
+}
+
+static int read_full(int fd, void *buf, size_t n) {
+	char *p = buf;
+	while (n > 0) {
+		ssize_t got = read(fd, p, n);
+		if (got < 0 && errno == EINTR) continue;
+		if (got <= 0) return 0;
+		p += got;
+		n -= (size_t) got;
+	}
+	return 1;
+}
+
+static int write_full(int fd, void const *buf, size_t n) {
+	char const *p = buf;
+	while (n > 0) {
+		ssize_t put = write(fd, p, n);
+		if (put < 0 && errno == EINTR) continue;
+		if (put <= 0) return 0;
+		p += put;
+		n -= (size_t) put;
+	}
+	return 1;
+}
+
+static int reserve(char **buf, size_t *cap, size_t need) {
+	if (need <= *cap) return 1;
+	char *nbuf = realloc(*buf, need);
+	if (nbuf == NULL) return 0;
+	*buf = nbuf;
+	*cap = need;
+	return 1;
+}
+
+static int respond(int fd, uint32_t status, void const *payload, size_t len) {
+	proto_header_t hdr = {.op = status, .len = (uint32_t) len};
+	return write_full(fd, &hdr, sizeof(hdr)) && (len == 0 || write_full(fd, payload, len));
+}
+
+// worker->out = proto_rows_t + room for n rows
+static dbrow_t *rows_buffer(worker_t *w, size_t n) {
+	if (!reserve(&w->out, &w->out_cap, sizeof(proto_rows_t) + n * sizeof(dbrow_t))) return NULL;
+	return (dbrow_t *) (w->out + sizeof(proto_rows_t));
+}
+
+static int respond_rows(worker_t *w, int fd, size_t count, size_t next) {
+	proto_rows_t info = {.count = count, .next = next};
+	memcpy(w->out, &info, sizeof(info));
+	return respond(fd, PS_OK, w->out, sizeof(info) + count * sizeof(dbrow_t));
+}
+
+static size_t clamp_limit(uint64_t limit) {
+	return limit == 0 || limit > PROTO_MAX_ROWS ? PROTO_MAX_ROWS : (size_t) limit;
+}
+
+static int do_scan(worker_t *w, int fd, proto_scan_t req) {
+	size_t limit = clamp_limit(req.limit);
+	table_snap_t const *snap = table_snap_acquire(w->server->mvcc);
+	size_t len = table_snap_len(snap);
+	size_t avail = req.start < len ? len - req.start : 0;
+	size_t n = avail < limit ? avail : limit;
+	dbrow_t *rows = rows_buffer(w, n);
+	if (rows != NULL) n = table_snap_rows(snap, req.start, rows, n);
+	size_t next = req.start + n < len ? req.start + n : len;
+	table_snap_release(w->server->mvcc, snap);
+	if (rows == NULL) return respond(fd, PS_ERROR, NULL, 0);
+	return respond_rows(w, fd, n, next);
+}
+
+static int do_find(worker_t *w, int fd, proto_find_t req) {
+	if (!check_findspec(&req.spec)) return respond(fd, PS_BAD_REQUEST, NULL, 0);
+	size_t limit = clamp_limit(req.limit);
+	table_snap_t const *snap = table_snap_acquire(w->server->mvcc);
+	size_t len = table_snap_len(snap);
+	size_t cap = limit < len ? limit : len;
+	size_t n = 0, next = len;
+	if (cap > w->idx_cap) {
+		size_t *nidx = realloc(w->idx, cap * sizeof(size_t));
+		if (nidx != NULL) {
+			w->idx = nidx;
+			w->idx_cap = cap;
+		}
+	}
+	dbrow_t *rows = cap <= w->idx_cap ? rows_buffer(w, cap) : NULL;
+	if (rows != NULL) {
+		n = table_snap_find_all(snap, req.spec, w->idx, cap, &next);
+		for (size_t i = 0; i < n; i++) rows[i] = *table_snap_row(snap, w->idx[i]);
+	}
+	table_snap_release(w->server->mvcc, snap);
+	if (rows == NULL) return respond(fd, PS_ERROR, NULL, 0);
+	return respond_rows(w, fd, n, next);
+}
+
+static dbrow_t const *snap_row_at(void const *snap, size_t pos) {
+	return table_snap_row(snap, pos);
+}
+
+// the first offset + limit positions of the order are selected, the snapshot is not copied
+static int do_sort(worker_t *w, int fd, proto_sort_t req) {
+	size_t limit = clamp_limit(req.limit);
+	table_cmp_t cmp = table_sort_cmp(req.spec);
+	if (cmp == NULL) return respond(fd, PS_BAD_REQUEST, NULL, 0);
+	table_snap_t const *snap = table_snap_acquire(w->server->mvcc);
+	size_t len = table_snap_len(snap);
+	size_t offset = req.offset < len ? (size_t) req.offset : len;
+	size_t k = limit < len - offset ? offset + limit : len;
+	table_top_t top;
+	dbrow_t *rows = NULL;
+	size_t n = 0;
+	if (table_top_init(&top, k, snap, snap_row_at, cmp)) {
+		for (size_t i = 0; i < len; i++) table_top_offer(&top, i);
+		n = table_top_finish(&top) - offset;
+		rows = rows_buffer(w, n);
+		for (size_t i = 0; rows != NULL && i < n; i++) rows[i] = *table_snap_row(snap, top.pos[offset + i]);
+		free(top.pos);
+	}
+	table_snap_release(w->server->mvcc, snap);
+	if (rows == NULL) return respond(fd, PS_ERROR, NULL, 0);
+	return respond_rows(w, fd, n, offset + n);
+}
+
+/*
+ * rows come from the client as bytes: fields are checked like parsed input and explicit ids
+ * must ascend past next_id, which keeps the table in id order for do_remove
+ */
+static int do_append(worker_t *w, int fd, dbrow_t *rows, size_t n) {
+	server_t *srv = w->server;
+	for (size_t i = 0; i < n; i++) {
+		if (!check_row(&rows[i])) return respond(fd, PS_BAD_REQUEST, NULL, 0);
+	}
+	mutex_lock(&srv->write_lock);
+	table_snap_t const *snap = table_snap_acquire(srv->mvcc);
+	size_t next_id = table_snap_next_id(snap);
+	table_snap_release(srv->mvcc, snap);
+	int ordered = 1;
+	for (size_t i = 0; ordered && i < n; i++) {
+		if (rows[i].id == 0) rows[i].id = next_id++;
+		else if (rows[i].id >= next_id) next_id = rows[i].id + 1;
+		else ordered = 0;
+		collate_row(&rows[i]);
+	}
+	if (!ordered) {
+		mutex_unlock(&srv->write_lock);
+		return respond(fd, PS_BAD_REQUEST, NULL, 0);
+	}
+	int ok = table_mvcc_append(srv->mvcc, rows, n);
+	if (ok) repl_log_append(srv->log, rows, n);
+	snap = table_snap_acquire(srv->mvcc);
+	proto_count_t count = {.len = table_snap_len(snap), .next_id = table_snap_next_id(snap)};
+	table_snap_release(srv->mvcc, snap);
+	mutex_unlock(&srv->write_lock);
+	if (!ok) return respond(fd, PS_ERROR, NULL, 0);
+	return respond(fd, PS_OK, &count, sizeof(count));
+}
+
+static int do_remove(worker_t *w, int fd, uint64_t id) {
+	server_t *srv = w->server;
+	table_find_t findspec = {.column = TC_ID, .condition = C_EQ, .data1.id = id};
+	size_t pos;
+	mutex_lock(&srv->write_lock);
+	table_snap_t const *snap = table_snap_acquire(srv->mvcc);
+	int found = table_snap_find_first(snap, findspec, &pos);
+	table_snap_release(srv->mvcc, snap);
+	found = found && table_mvcc_remove_at(srv->mvcc, pos);
+	if (found) repl_log_remove(srv->log, id);
+	mutex_unlock(&srv->write_lock);
+	return respond(fd, found ? PS_OK : PS_NOT_FOUND, NULL, 0);
+}
+
+static int do_follow(worker_t *w, int fd, proto_follow_t req) {
+	server_t *srv = w->server;
+	mutex_lock(&srv->write_lock);
+	repl_log_follow(srv->log, srv->mvcc, fd, req);
+	mutex_unlock(&srv->write_lock);
+	return -1;
+}
+
+/*
+ * handles one request
+ * returns 1 if connection should be kept, 0 if it should be closed,
+ * -1 if it was handed over to replication
+ */
+static int handle_request(worker_t *w, int fd) {
+	proto_header_t hdr;
+	if (!read_full(fd, &hdr, sizeof(hdr))) return 0;
+	if (hdr.len > PROTO_MAX_PAYLOAD) {
+		respond(fd, PS_BAD_REQUEST, NULL, 0);
+		return 0;
+	}
+	if (!reserve(&w->in, &w->in_cap, hdr.len + 1)) return 0;
+	if (hdr.len > 0 && !read_full(fd, w->in, hdr.len)) return 0;
+#define EXPECT(type, var) type var; \
+	if (hdr.len != sizeof(type)) return respond(fd, PS_BAD_REQUEST, NULL, 0); \
+	memcpy(&var, w->in, sizeof(type))
+	switch (hdr.op) {
+	default:
+		return respond(fd, PS_BAD_REQUEST, NULL, 0);
+	case OP_COUNT: {
+		table_snap_t const *snap = table_snap_acquire(w->server->mvcc);
+		proto_count_t count = {.len = table_snap_len(snap), .next_id = table_snap_next_id(snap)};
+		table_snap_release(w->server->mvcc, snap);
+		return respond(fd, PS_OK, &count, sizeof(count));
+	}
+	case OP_SCAN: {
+		EXPECT(proto_scan_t, req);
+		return do_scan(w, fd, req);
+	}
+	case OP_FIND: {
+		EXPECT(proto_find_t, req);
+		return do_find(w, fd, req);
+	}
+	case OP_SORT: {
+		EXPECT(proto_sort_t, req);
+		return do_sort(w, fd, req);
+	}
+	case OP_APPEND: {
+		if (w->server->log == NULL) return respond(fd, PS_READ_ONLY, NULL, 0);
+		if (hdr.len % sizeof(dbrow_t) != 0) return respond(fd, PS_BAD_REQUEST, NULL, 0);
+		// w->in is malloc'ed, so it is suitably aligned for dbrow_t
+		return do_append(w, fd, (dbrow_t *) w->in, hdr.len / sizeof(dbrow_t));
+	}
+	case OP_REMOVE: {
+		if (w->server->log == NULL) return respond(fd, PS_READ_ONLY, NULL, 0);
+		EXPECT(uint64_t, id);
+		return do_remove(w, fd, id);
+	}
+	case OP_FOLLOW: {
+		if (w->server->log == NULL) return respond(fd, PS_BAD_REQUEST, NULL, 0);
+		EXPECT(proto_follow_t, req);
+		return do_follow(w, fd, req);
+	}
+	}
+#undef EXPECT
+}
+
+static void worker_main(void *arg) {
+	worker_t *w = arg;
+	server_t *srv = w->server;
+	while (1) {
+		mutex_lock(&srv->queue_lock);
+		while (srv->queue_len == 0 && !srv->stop) cond_wait(&srv->queue_cond, &srv->queue_lock);
+		if (srv->stop) {
+			mutex_unlock(&srv->queue_lock);
+			break;
+		}
+		int fd = srv->queue[srv->queue_head];
+		srv->queue_head = (srv->queue_head + 1) % srv->queue_cap;
+		srv->queue_len--;
+		w->fd = fd;
+		mutex_unlock(&srv->queue_lock);
+		int keep = handle_request(w, fd);
+		mutex_lock(&srv->queue_lock);
+		w->fd = -1;
+		mutex_unlock(&srv->queue_lock);
+		if (keep > 0) { write_full(srv->wake_w, &fd, sizeof(fd)); }
+		else if (keep == 0) { close(fd); }
+	}
+}
+
+static int enqueue(server_t *srv, int fd) {
+	mutex_lock(&srv->queue_lock);
+	if (srv->queue_len == srv->queue_cap) {
+		size_t ncap = srv->queue_cap ? srv->queue_cap * 2 : 64;
+		int *nqueue = malloc(ncap * sizeof(int));
+		if (nqueue == NULL) {
+			mutex_unlock(&srv->queue_lock);
+			return 0;
+		}
+		for (size_t i = 0; i < srv->queue_len; i++) {
+			nqueue[i] = srv->queue[(srv->queue_head + i) % srv->queue_cap];
+		}
+		free(srv->queue);
+		srv->queue = nqueue;
+		srv->queue_cap = ncap;
+		srv->queue_head = 0;
+	}
+	srv->queue[(srv->queue_head + srv->queue_len) % srv->queue_cap] = fd;
+	srv->queue_len++;
+	cond_signal(&srv->queue_cond);
+	mutex_unlock(&srv->queue_lock);
+	return 1;
+}
+
+static int open_listener(char const *path, FILE *ferr) {
+	struct sockaddr_un addr = {.sun_family = AF_UNIX};
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		afprintf(ferr, L"Socket path is too long\n");
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) goto no_socket;
+	unlink(path); // stale socket from a previous run
+	if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) goto no_bind;
+	if (listen(fd, 128) != 0) goto no_bind;
+	return fd;
+no_bind:
+	close(fd);
+no_socket:
+	afprintf(ferr, L"Cannot listen on '%s': %s\n", path, strerror(errno));
+	return -1;
+}
+
+// a client that stops sending in the middle of a request fails read_full instead of holding a worker
+static void set_recv_timeout(int fd) {
+	struct timeval timeout = {.tv_sec = SERVER_RECV_TIMEOUT};
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+}
+
+// poll set: [0] listener, [1] wake pipe, then idle connections
+static int add_pollfd(struct pollfd **fds, size_t *len, size_t *cap, int fd) {
+	if (*len == *cap) {
+		size_t ncap = *cap * 2;
+		struct pollfd *nfds = realloc(*fds, ncap * sizeof(struct pollfd));
+		if (nfds == NULL) return 0;
+		*fds = nfds;
+		*cap = ncap;
+	}
+	(*fds)[(*len)++] = (struct pollfd) {.fd = fd, .events = POLLIN};
+	return 1;
+}
+
+int server_run(table_t *table, char const *path, char const *primary, size_t workers, FILE *ferr) {
+	if (table == NULL || path == NULL) return 0;
+	if (workers == 0) workers = thread_count_hint();
+	int ok = 0;
+	server_t srv = {0};
+	int wake[2] = {-1, -1};
+	struct pollfd *fds = NULL;
+	size_t nfds = 0, fds_cap = 16;
+	thread_t *threads = NULL;
+	worker_t *ws = NULL;
+	size_t started = 0;
+	int listener = open_listener(path, ferr);
+	if (listener < 0) return 0;
+	if (pipe(wake) != 0) goto cleanup;
+	srv.wake_w = wake[1];
+	srv.mvcc = table_mvcc_new(table);
+	if (srv.mvcc == NULL) goto cleanup;
+	if (!mutex_init(&srv.write_lock)) goto no_write_lock;
+	if (!mutex_init(&srv.queue_lock)) goto no_mutex;
+	if (!cond_init(&srv.queue_cond)) goto no_cond;
+	if (primary != NULL) srv.replica = repl_replica_start(primary, srv.mvcc, ferr);
+	else srv.log = repl_log_new();
+	if (srv.replica == NULL && srv.log == NULL) goto stop_workers;
+	fds = malloc(fds_cap * sizeof(struct pollfd));
+	threads = calloc(workers, sizeof(thread_t));
+	ws = calloc(workers, sizeof(worker_t));
+	if (fds == NULL || threads == NULL || ws == NULL) goto stop_workers;
+	for (; started < workers; started++) {
+		ws[started].server = &srv;
+		ws[started].fd = -1;
+		if (!thread_create(&threads[started], worker_main, &ws[started])) goto stop_workers;
+	}
+	add_pollfd(&fds, &nfds, &fds_cap, listener);
+	add_pollfd(&fds, &nfds, &fds_cap, wake[0]);
+	wake_fd = wake[1];
+	signal(SIGPIPE, SIG_IGN);
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	if (primary != NULL) { afprintf(ferr, L"Serving replica of '%s' on '%s' with %zu workers\n", primary, path, workers); }
+	else { afprintf(ferr, L"Serving %zu rows on '%s' with %zu workers\n", table->len, path, workers); }
+	int running = 1;
+	while (running) {
+		if (poll(fds, nfds, -1) < 0) {
+			if (errno == EINTR) continue;
+			break;
+		}
+		if (fds[1].revents & POLLIN) {
+			int fd;
+			if (!read_full(wake[0], &fd, sizeof(fd))) break;
+			if (fd < 0) { running = 0; }
+			else if (!add_pollfd(&fds, &nfds, &fds_cap, fd)) { close(fd); }
+		}
+		if (fds[0].revents & POLLIN) {
+			int fd = accept(listener, NULL, NULL);
+			if (fd >= 0) set_recv_timeout(fd);
+			if (fd >= 0 && !add_pollfd(&fds, &nfds, &fds_cap, fd)) close(fd);
+		}
+		for (size_t i = 2; i < nfds;) {
+			if (fds[i].revents == 0) {
+				i++;
+				continue;
+			}
+			int fd = fds[i].fd;
+			fds[i] = fds[--nfds];
+			if (!enqueue(&srv, fd)) close(fd);
+		}
+	}
+	ok = 1;
+	afprintf(ferr, L"Server stopped\n");
+stop_workers:
+	mutex_lock(&srv.queue_lock);
+	srv.stop = 1;
+	cond_broadcast(&srv.queue_cond);
+	// a worker blocked on a client returns at once, the stop does not wait for its sends
+	for (size_t i = 0; i < started; i++) {
+		if (ws[i].fd >= 0) shutdown(ws[i].fd, SHUT_RDWR);
+	}
+	mutex_unlock(&srv.queue_lock);
+	for (size_t i = 0; i < started; i++) thread_join(threads[i]);
+	repl_log_free(srv.log);
+	repl_replica_stop(srv.replica);
+	wake_fd = -1;
+	signal(SIGINT, SIG_DFL);
+	signal(SIGTERM, SIG_DFL);
+	for (size_t i = 0; i < srv.queue_len; i++) close(srv.queue[(srv.queue_head + i) % srv.queue_cap]);
+	for (size_t i = 2; i < nfds; i++) close(fds[i].fd);
+	for (size_t i = 0; ws != NULL && i < workers; i++) {
+		free(ws[i].in);
+		free(ws[i].out);
+		free(ws[i].idx);
+	}
+	free(ws);
+	free(threads);
+	free(fds);
+	free(srv.queue);
+	cond_destroy(&srv.queue_cond);
+no_cond:
+	mutex_destroy(&srv.queue_lock);
+no_mutex:
+	mutex_destroy(&srv.write_lock);
+no_write_lock:
+	// hand the served state back to the caller's table
+	if (ok) {
+		table_snap_t const *snap = table_snap_acquire(srv.mvcc);
+		table->len = 0;
+		table->ids_ascending = 1;
+		table->version++;
+		table_views_rebuild(table);
+		table_trgm_rebuild(table);
+		table_aggs_rebuild(table);
+		table->next_id = table_snap_next_id(snap);
+		for (size_t i = 0, len = table_snap_len(snap); ok && i < len; i += TABLE_CHUNK_ROWS) {
+			size_t n = len - i < TABLE_CHUNK_ROWS ? len - i : TABLE_CHUNK_ROWS;
+			ok = table_append_batch(table, table_snap_row(snap, i), n);
+		}
+		// an empty snapshot appends nothing, a mapped file still has to drop its rows
+		if (table->map != NULL) table_map_store(table);
+		table_snap_release(srv.mvcc, snap);
+	}
+	table_mvcc_free(srv.mvcc);
+cleanup:
+	if (wake[0] >= 0) close(wake[0]);
+	if (wake[1] >= 0) close(wake[1]);
+	close(listener);
+	unlink(path);
+	return ok;
+}
+
+#endif
@@ -0,0 +1,133 @@
+#include <stdatomic.h>
+#include <wchar.h>
+
+#include "stats.h"
+#include "defs.h"
+
+#ifdef WITH_STATS
+// workers record concurrently, relaxed adds keep every count exact without ordering anything else
+typedef struct {
+	_Atomic uint64_t calls;
+	_Atomic uint64_t rows;
+	_Atomic uint64_t bytes_in;
+	_Atomic uint64_t bytes_out;
+	_Atomic uint64_t ns_total;
+	_Atomic uint64_t hist[STATS_BUCKETS];
+} shared_counter_t;
+
+static shared_counter_t counters[ST_COUNT];
+
+#define ADD(field, value) atomic_fetch_add_explicit(&(field), (value), memory_order_relaxed)
+#define LOAD(field) atomic_load_explicit(&(field), memory_order_relaxed)
+#define CLEAR(field) atomic_store_explicit(&(field), 0, memory_order_relaxed)
+
+static wchar_t const *const op_names[ST_COUNT] = {
+	L"find", L"sort", L"append", L"remove", L"load", L"print",
+};
+
+static size_t bucket_of(uint64_t ns) {
+	size_t b = 0;
+	while (ns > 1 && b < STATS_BUCKETS - 1) {
+		ns >>= 1;
+		b++;
+	}
+	return b;
+}
+
+// upper bound (ns) of the bucket where the q-th fraction of calls ends
+static uint64_t quantile(stats_counter_t const *c, double q) {
+	uint64_t want = (uint64_t) (q * (double) c->calls), seen = 0;
+	for (size_t b = 0; b < STATS_BUCKETS; b++) {
+		seen += c->hist[b];
+		if (seen > want) return (uint64_t) 1 << (b + 1);
+	}
+	return (uint64_t) 1 << STATS_BUCKETS;
+}
+
+// a recording running meanwhile may land in some fields of the copy only
+static void load_counter(stats_op_t op, stats_counter_t *out_counter) {
+	shared_counter_t *c = &counters[op];
+	out_counter->calls = LOAD(c->calls);
+	out_counter->rows = LOAD(c->rows);
+	out_counter->bytes_in = LOAD(c->bytes_in);
+	out_counter->bytes_out = LOAD(c->bytes_out);
+	out_counter->ns_total = LOAD(c->ns_total);
+	for (size_t b = 0; b < STATS_BUCKETS; b++) out_counter->hist[b] = LOAD(c->hist[b]);
+}
+
+#endif
+
+void stats_record(stats_op_t op, uint64_t ns, uint64_t rows, uint64_t bytes_in, uint64_t bytes_out) {
+#ifdef WITH_STATS
+	if (op >= ST_COUNT) return;
+	shared_counter_t *c = &counters[op];
+	ADD(c->calls, 1);
+	ADD(c->rows, rows);
+	ADD(c->bytes_in, bytes_in);
+	ADD(c->bytes_out, bytes_out);
+	ADD(c->ns_total, ns);
+	ADD(c->hist[bucket_of(ns)], 1);
+#else
+	(void) op;
+	(void) ns;
+	(void) rows;
+	(void) bytes_in;
+	(void) bytes_out;
+#endif
+}
+
+void stats_reset(void) {
+#ifdef WITH_STATS
+	for (size_t op = 0; op < ST_COUNT; op++) {
+		shared_counter_t *c = &counters[op];
+		CLEAR(c->calls);
+		CLEAR(c->rows);
+		CLEAR(c->bytes_in);
+		CLEAR(c->bytes_out);
+		CLEAR(c->ns_total);
+		for (size_t b = 0; b < STATS_BUCKETS; b++) CLEAR(c->hist[b]);
+	}
+#endif
+}
+
+int stats_get(stats_op_t op, stats_counter_t *out_counter) {
+#ifdef WITH_STATS
+	if (op >= ST_COUNT || out_counter == NULL) return 0;
+	load_counter(op, out_counter);
+	return 1;
+#else
+	(void) op;
+	(void) out_counter;
+	return 0;
+#endif
+}
+
+void stats_print(FILE *fout) {
+#ifndef WITH_STATS
+	afprintf(fout, L"Stats are disabled (build with -DWITH_STATS=ON)\n");
+#else
+	afprintf(fout, L"op\tcalls\trows\tbytes_in\tbytes_out\ttotal_ms\tavg_ns\tp50_ns<\tp99_ns<\n");
+	for (size_t op = 0; op < ST_COUNT; op++) {
+		stats_counter_t counter, *c = &counter;
+		load_counter(op, c);
+		uint64_t avg = c->calls ? c->ns_total / c->calls : 0;
+		afprintf(fout, WSTR_FMT L"\t%llu\t%llu\t%llu\t%llu\t%.3f\t%llu\t%llu\t%llu\n", op_names[op],
+			(unsigned long long) c->calls, (unsigned long long) c->rows,
+			(unsigned long long) c->bytes_in, (unsigned long long) c->bytes_out,
+			(double) c->ns_total / 1e6, (unsigned long long) avg,
+			(unsigned long long) (c->calls ? quantile(c, 0.5) : 0),
+			(unsigned long long) (c->calls ? quantile(c, 0.99) : 0));
+	}
+	afprintf(fout, L"latency histogram, bucket = [2^k, 2^(k+1)) ns\n");
+	for (size_t op = 0; op < ST_COUNT; op++) {
+		stats_counter_t counter, *c = &counter;
+		load_counter(op, c);
+		if (c->calls == 0) continue;
+		afprintf(fout, WSTR_FMT L":", op_names[op]);
+		for (size_t b = 0; b < STATS_BUCKETS; b++) {
+			if (c->hist[b]) afprintf(fout, L" %zu:%llu", b, (unsigned long long) c->hist[b]);
+		}
+		afprintf(fout, L"\n");
+	}
+#endif
+}
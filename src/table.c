@@ -1,6 +1,16 @@
 #include <stdlib.h>
+#include <string.h>
 
 #include "table.h"
+#include "stats.h"
+#include "table_map.h"
+#include "table_cache.h"
+#include "table_view.h"
+#include "table_trgm.h"
+#include "table_plan.h"
+#include "table_sketch.h"
+#include "table_agg.h"
+#include "collate.h"
 
 // https://stackoverflow.com/a/466242/20935957
 // https://graphics.stanford.edu/%7Eseander/bithacks.html#RoundUpPowerOf2
@@ -29,6 +39,15 @@ table_t *table_new(size_t cap) {
 	table->len = 0;
 	table->cap = cap2;
 	table->next_id = 1;
+	table->version = 0;
+	table->ids_ascending = 1;
+	table->map = NULL;
+	table->cache = NULL;
+	table->views = NULL;
+	table->trgm = NULL;
+	table->colstats = NULL;
+	table->sketch = NULL;
+	table->aggs = NULL;
 	return table;
 no_rows:
 	free(table);
@@ -38,34 +57,108 @@ bad_cap:
 }
 
 void table_free(table_t *table) {
-	free(table->rows);
+	table_cache_clear(table);
+	table_views_free(table);
+	table_trgm_free(table);
+	table_stats_free(table);
+	table_sketch_free(table);
+	table_aggs_free(table);
+	if (table->map != NULL) table_map_close(table);
+	else free(table->rows);
 	free(table);
 }
 
+// makes room for at least `need` rows
+static int grow(table_t *table, size_t need) {
+	if (table->rows != NULL && need <= table->cap) return 1;
+	size_t cap2 = npow2(need < 16 ? 16 : need);
+	if (cap2 < need) return 0;
+	if (table->map != NULL) return table_map_grow(table, cap2);
+	dbrow_t *newrows = realloc(table->rows, cap2 * sizeof(dbrow_t));
+	if (newrows == NULL) return 0;
+	if (table->rows == NULL) table->len = 0;
+	table->rows = newrows;
+	table->cap = cap2;
+	return 1;
+}
+
+int table_reserve(table_t *table, size_t cap) {
+	if (table == NULL || !grow(table, cap)) return 0;
+	return cap <= table->len || table_views_reserve(table, cap - table->len);
+}
+
 int table_append(table_t *table, dbrow_t row) {
 	if (table == NULL) return 0;
-	if (table->rows == NULL) {
-		table->rows = calloc(16, sizeof(dbrow_t));
-		if (table->rows == NULL) return 0;
-		table->cap = 16;
-		table->len = 0;
-	}
-	if (table->len == table->cap) {
-		dbrow_t *newrows = realloc(table->rows, table->cap * 2 * sizeof(dbrow_t));
-		if (newrows == NULL) return 0;
-		table->rows = newrows;
-		table->cap *= 2;
+	STATS_START(start);
+	if (!grow(table, table->len + 1) || !table_views_reserve(table, 1)) return 0;
+	collate_row(&row);
+	if (table->ids_ascending) {
+		table->ids_ascending = table_ids_ascend(table->len > 0 ? &table->rows[table->len - 1] : NULL, &row, 1);
 	}
 	table->rows[table->len++] = row;
+	table_views_insert(table, &table->rows[table->len - 1]);
+	table_aggs_insert(table, &table->rows[table->len - 1]);
+	table_trgm_insert(table, table->len - 1);
+	uint64_t version = table->version++;
+	table_sketch_insert(table, table->len - 1, version);
+	if (table->map != NULL) table_map_store(table);
+	STATS_END(ST_APPEND, start, 1, 0, sizeof(dbrow_t));
+	return 1;
+}
+
+int table_append_batch(table_t *table, dbrow_t const *rows, size_t n) {
+	if (table == NULL || (rows == NULL && n > 0)) return 0;
+	if (n == 0) return 1;
+	STATS_START(start);
+	size_t need = table->len + n;
+	if (need < table->len || !grow(table, need) || !table_views_reserve(table, n)) return 0;
+	if (table->ids_ascending) {
+		table->ids_ascending = table_ids_ascend(table->len > 0 ? &table->rows[table->len - 1] : NULL, rows, n);
+	}
+	memcpy(table->rows + table->len, rows, n * sizeof(dbrow_t));
+	collate_rows(table->rows + table->len, n);
+	for (size_t i = table->len; i < need; i++) table_views_insert(table, &table->rows[i]);
+	for (size_t i = table->len; i < need; i++) table_aggs_insert(table, &table->rows[i]);
+	size_t from = table->len;
+	while (table->len < need) table_trgm_insert(table, table->len++);
+	uint64_t version = table->version++;
+	table_sketch_insert(table, from, version);
+	if (table->map != NULL) table_map_store(table);
+	STATS_END(ST_APPEND, start, n, 0, n * sizeof(dbrow_t));
+	return 1;
+}
+
+size_t table_snapshot_rows(table_t const *table, size_t start, dbrow_t *out_rows, size_t cap) {
+	if (table == NULL || table->rows == NULL || out_rows == NULL || start >= table->len) return 0;
+	size_t n = table->len - start < cap ? table->len - start : cap;
+	memcpy(out_rows, table->rows + start, n * sizeof(dbrow_t));
+	return n;
+}
+
+int table_ids_ascend(dbrow_t const *prev, dbrow_t const *rows, size_t n) {
+	if (rows == NULL && n > 0) return 0;
+	for (size_t i = 0; i < n; i++) {
+		if (prev != NULL && rows[i].id <= prev->id) return 0;
+		prev = &rows[i];
+	}
 	return 1;
 }
 
 int table_remove_at(table_t *table, size_t pos) {
 	if (table == NULL || table->rows == NULL || table->len == 0 || pos >= table->len) return 0;
+	STATS_START(start);
+	table_views_remove(table, &table->rows[pos]);
+	table_aggs_remove(table, &table->rows[pos]);
+	table_trgm_remove(table, pos);
 	for (size_t i = pos; i < table->len - 1; i++) {
 		table->rows[i] = table->rows[i + 1];
 	}
 	table->len--;
+	// removing keeps the order, only an empty table is known to be ordered again
+	if (table->len == 0) table->ids_ascending = 1;
+	table->version++;
+	if (table->map != NULL) table_map_store(table);
+	STATS_END(ST_REMOVE, start, table->len - pos, 0, sizeof(dbrow_t) * (table->len - pos));
 	return 1;
 }
 
@@ -0,0 +1,440 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "table_agg.h"
+#include "hash.h"
+
+#define NIL ((size_t) -1)
+#define COMPACT_MIN 16
+
+// min-heap of order-preserving keys, a max-heap keeps complemented keys
+// appends go to an unordered tail [heaped, len) and only a removal merges it
+typedef struct {
+	uint64_t *v;
+	size_t len, cap, heaped;
+	uint64_t tail_min;
+} heap_t;
+
+// dead holds removed values that are still somewhere in live
+typedef struct {
+	heap_t live, dead;
+} dheap_t;
+
+enum { H_MIN_C1, H_MAX_C1, H_MIN_C2, H_MAX_C2, NHEAPS };
+
+typedef struct {
+	dbrow_u key;
+	uint64_t hash;
+	size_t next; // bucket chain
+	size_t count;
+	uint64_t sum_c1; // modulo 2^64
+	double sum_c2, comp_c2;
+	dheap_t heaps[NHEAPS];
+} group_t;
+
+typedef struct {
+	size_t id;
+	table_agg_spec_t spec;
+	group_t *groups; // in order of creation, empty groups stay for reuse
+	size_t ngroups, cap;
+	size_t *buckets;
+	size_t nbuckets; // power of two
+} agg_t;
+
+struct table_aggs {
+	size_t n;
+	size_t next_id;
+	agg_t *list[TABLE_AGG_MAX];
+};
+
+static uint64_t float_bits(double x) {
+	uint64_t b = 0;
+	if (x != 0) memcpy(&b, &x, sizeof(b)); // -0.0 groups with 0.0
+	return b;
+}
+
+// group column access, dbrow_t and dbrow_u share field names
+#define KEY_HASH_UINT(x) hash_u64((uint64_t) (x))
+#define KEY_HASH_INT(x) hash_u64((uint64_t) (x))
+#define KEY_HASH_FLOAT(x) hash_u64(float_bits(x))
+#define KEY_HASH_BOOL(x) hash_u64((uint64_t) (x))
+#define KEY_HASH_STR(x) hash_wcs((x), SIZE_MAX)
+#define KEY_EQ_UINT(x, y) ((x) == (y))
+#define KEY_EQ_INT(x, y) ((x) == (y))
+#define KEY_EQ_FLOAT(x, y) ((x) == (y))
+#define KEY_EQ_BOOL(x, y) ((x) == (y))
+#define KEY_EQ_STR(x, y) (wcscmp((x), (y)) == 0)
+#define KEY_SET_UINT(x, y) (x) = (y)
+#define KEY_SET_INT(x, y) (x) = (y)
+#define KEY_SET_FLOAT(x, y) (x) = (y)
+#define KEY_SET_BOOL(x, y) (x) = (y)
+#define KEY_SET_STR(x, y) wcscpy((x), (y))
+
+#define KEY_HASH_CASE(a, name, tag, kind, len, charset) case tag: return KEY_HASH_##kind(row->name);
+#define KEY_EQ_CASE(a, name, tag, kind, len, charset) case tag: return KEY_EQ_##kind(key->name, row->name);
+#define KEY_SET_CASE(a, name, tag, kind, len, charset) case tag: KEY_SET_##kind(key->name, row->name); break;
+
+static uint64_t key_hash(column_t column, dbrow_t const *row) {
+	switch (column) {
+	default: return 0;
+	TABLE_SCHEMA(KEY_HASH_CASE, _)
+	}
+}
+
+static int key_eq(column_t column, dbrow_u const *key, dbrow_t const *row) {
+	switch (column) {
+	default: return 0;
+	TABLE_SCHEMA(KEY_EQ_CASE, _)
+	}
+}
+
+static void key_set(column_t column, dbrow_u *key, dbrow_t const *row) {
+	memset(key, 0, sizeof(*key));
+	switch (column) {
+	default: break;
+	TABLE_SCHEMA(KEY_SET_CASE, _)
+	}
+}
+
+#define SIGN (1ull << 63)
+
+static uint64_t enc_int(int64_t x) {
+	return (uint64_t) x ^ SIGN;
+}
+
+static int64_t dec_int(uint64_t k) {
+	return (int64_t) (k ^ SIGN);
+}
+
+// unsigned order of the result is the order of doubles (-0.0 before 0.0)
+static uint64_t enc_float(double x) {
+	uint64_t b;
+	memcpy(&b, &x, sizeof(b));
+	return b & SIGN ? ~b : b | SIGN;
+}
+
+static double dec_float(uint64_t k) {
+	uint64_t b = k & SIGN ? k & ~SIGN : ~k;
+	double x;
+	memcpy(&x, &b, sizeof(x));
+	return x;
+}
+
+static int heap_append(heap_t *h, uint64_t x) {
+	if (h->len == h->cap) {
+		size_t cap = h->cap ? h->cap * 2 : 4;
+		uint64_t *v = realloc(h->v, cap * sizeof(uint64_t));
+		if (v == NULL) return 0;
+		h->v = v;
+		h->cap = cap;
+	}
+	if (h->heaped == h->len || x < h->tail_min) h->tail_min = x;
+	h->v[h->len++] = x;
+	return 1;
+}
+
+static void sift_up(uint64_t *v, size_t i) {
+	uint64_t x = v[i];
+	while (i > 0 && v[(i - 1) / 2] > x) {
+		v[i] = v[(i - 1) / 2];
+		i = (i - 1) / 2;
+	}
+	v[i] = x;
+}
+
+static void sift_down(uint64_t *v, size_t len, size_t i) {
+	uint64_t x = v[i];
+	while (2 * i + 1 < len) {
+		size_t c = 2 * i + 1;
+		if (c + 1 < len && v[c + 1] < v[c]) c++;
+		if (v[c] >= x) break;
+		v[i] = v[c];
+		i = c;
+	}
+	v[i] = x;
+}
+
+// merges the tail, bottom-up when it is long
+static void heap_settle(heap_t *h) {
+	if (h->heaped == h->len) return;
+	if ((h->len - h->heaped) * 16 >= h->heaped) {
+		for (size_t i = h->len / 2; i-- > 0;) sift_down(h->v, h->len, i);
+	}
+	else {
+		for (size_t i = h->heaped; i < h->len; i++) sift_up(h->v, i);
+	}
+	h->heaped = h->len;
+}
+
+static int heap_push(heap_t *h, uint64_t x) {
+	heap_settle(h);
+	if (!heap_append(h, x)) return 0;
+	heap_settle(h);
+	return 1;
+}
+
+// settled heaps only
+static void heap_pop(heap_t *h) {
+	h->v[0] = h->v[--h->len];
+	h->heaped = h->len;
+	if (h->len > 0) sift_down(h->v, h->len, 0);
+}
+
+static uint64_t heap_top(heap_t const *h) {
+	if (h->heaped == h->len) return h->v[0];
+	return h->heaped > 0 && h->v[0] < h->tail_min ? h->v[0] : h->tail_min;
+}
+
+// live minus dead as a sorted array, which is a valid heap
+static void dheap_compact(dheap_t *d) {
+	qsort(d->live.v, d->live.len, sizeof(uint64_t), hash_cmp_u64);
+	qsort(d->dead.v, d->dead.len, sizeof(uint64_t), hash_cmp_u64);
+	size_t kept = 0, j = 0;
+	for (size_t i = 0; i < d->live.len; i++) {
+		if (j < d->dead.len && d->dead.v[j] == d->live.v[i]) j++;
+		else d->live.v[kept++] = d->live.v[i];
+	}
+	d->live.len = d->live.heaped = kept;
+	d->dead.len = d->dead.heaped = 0;
+}
+
+static int dheap_remove(dheap_t *d, uint64_t x) {
+	heap_settle(&d->live);
+	if (d->live.len > 0 && d->live.v[0] == x) heap_pop(&d->live);
+	else if (!heap_push(&d->dead, x)) return 0;
+	while (d->dead.len > 0 && d->live.len > 0 && d->live.v[0] == d->dead.v[0]) {
+		heap_pop(&d->live);
+		heap_pop(&d->dead);
+	}
+	if (d->dead.len > COMPACT_MIN && 2 * d->dead.len > d->live.len) dheap_compact(d);
+	return 1;
+}
+
+static void dheap_free(dheap_t *d) {
+	free(d->live.v);
+	free(d->dead.v);
+}
+
+// Neumaier, also for removals (x < 0)
+static void add_c2(group_t *g, double x) {
+	double t = g->sum_c2 + x;
+	if (fabs(g->sum_c2) >= fabs(x)) g->comp_c2 += (g->sum_c2 - t) + x;
+	else g->comp_c2 += (x - t) + g->sum_c2;
+	g->sum_c2 = t;
+}
+
+static void agg_clear(agg_t *agg) {
+	for (size_t i = 0; i < agg->ngroups; i++) {
+		for (int h = 0; h < NHEAPS; h++) dheap_free(&agg->groups[i].heaps[h]);
+	}
+	agg->ngroups = 0;
+	if (agg->buckets != NULL) memset(agg->buckets, 0xff, agg->nbuckets * sizeof(size_t));
+}
+
+static void agg_free(agg_t *agg) {
+	agg_clear(agg);
+	free(agg->groups);
+	free(agg->buckets);
+	free(agg);
+}
+
+static group_t *find_group(agg_t const *agg, dbrow_t const *row, uint64_t hash) {
+	if (agg->buckets == NULL) return NULL;
+	for (size_t i = agg->buckets[hash & (agg->nbuckets - 1)]; i != NIL; i = agg->groups[i].next) {
+		group_t *g = &agg->groups[i];
+		if (g->hash == hash && key_eq(agg->spec.group, &g->key, row)) return g;
+	}
+	return NULL;
+}
+
+static group_t *add_group(agg_t *agg, dbrow_t const *row, uint64_t hash) {
+	if (agg->ngroups == agg->cap) {
+		size_t cap = agg->cap ? agg->cap * 2 : 16;
+		group_t *groups = realloc(agg->groups, cap * sizeof(group_t));
+		if (groups == NULL) return NULL;
+		agg->groups = groups;
+		agg->cap = cap;
+	}
+	if (agg->ngroups >= agg->nbuckets) {
+		size_t nbuckets = agg->nbuckets ? agg->nbuckets * 2 : 16;
+		size_t *buckets = malloc(nbuckets * sizeof(size_t));
+		if (buckets == NULL) return NULL;
+		memset(buckets, 0xff, nbuckets * sizeof(size_t));
+		for (size_t i = 0; i < agg->ngroups; i++) {
+			size_t b = agg->groups[i].hash & (nbuckets - 1);
+			agg->groups[i].next = buckets[b];
+			buckets[b] = i;
+		}
+		free(agg->buckets);
+		agg->buckets = buckets;
+		agg->nbuckets = nbuckets;
+	}
+	size_t i = agg->ngroups++;
+	group_t *g = &agg->groups[i];
+	memset(g, 0, sizeof(*g));
+	key_set(agg->spec.group, &g->key, row);
+	g->hash = hash;
+	size_t b = hash & (agg->nbuckets - 1);
+	g->next = agg->buckets[b];
+	agg->buckets[b] = i;
+	return g;
+}
+
+static int agg_insert(agg_t *agg, dbrow_t const *row) {
+	if (agg->spec.filtered && !table_row_matches(row, agg->spec.filter)) return 1;
+	uint64_t hash = key_hash(agg->spec.group, row);
+	group_t *g = find_group(agg, row, hash);
+	if (g == NULL) g = add_group(agg, row, hash);
+	if (g == NULL) return 0;
+	uint64_t c1 = enc_int(row->c1), c2 = enc_float(row->c2);
+	if (!heap_append(&g->heaps[H_MIN_C1].live, c1) || !heap_append(&g->heaps[H_MAX_C1].live, ~c1)
+		|| !heap_append(&g->heaps[H_MIN_C2].live, c2) || !heap_append(&g->heaps[H_MAX_C2].live, ~c2)) return 0;
+	g->count++;
+	g->sum_c1 += (uint64_t) row->c1;
+	add_c2(g, row->c2);
+	return 1;
+}
+
+static int agg_remove(agg_t *agg, dbrow_t const *row) {
+	if (agg->spec.filtered && !table_row_matches(row, agg->spec.filter)) return 1;
+	group_t *g = find_group(agg, row, key_hash(agg->spec.group, row));
+	if (g == NULL || g->count == 0) return 0;
+	uint64_t c1 = enc_int(row->c1), c2 = enc_float(row->c2);
+	if (!dheap_remove(&g->heaps[H_MIN_C1], c1) || !dheap_remove(&g->heaps[H_MAX_C1], ~c1)
+		|| !dheap_remove(&g->heaps[H_MIN_C2], c2) || !dheap_remove(&g->heaps[H_MAX_C2], ~c2)) return 0;
+	g->sum_c1 -= (uint64_t) row->c1;
+	add_c2(g, -row->c2);
+	if (--g->count == 0) {
+		// no drift carried into the next rows of the group
+		g->sum_c2 = g->comp_c2 = 0;
+	}
+	return 1;
+}
+
+static int agg_fill(agg_t *agg, table_t const *table) {
+	agg_clear(agg);
+	for (size_t i = 0; table->rows != NULL && i < table->len; i++) {
+		if (!agg_insert(agg, &table->rows[i])) return 0;
+	}
+	return 1;
+}
+
+static agg_t *find_agg(table_t const *table, size_t id, size_t *out_pos) {
+	if (table->aggs == NULL) return NULL;
+	for (size_t i = 0; i < table->aggs->n; i++) {
+		if (table->aggs->list[i]->id == id) {
+			if (out_pos != NULL) *out_pos = i;
+			return table->aggs->list[i];
+		}
+	}
+	return NULL;
+}
+
+static void drop_at(table_t *table, size_t pos) {
+	agg_free(table->aggs->list[pos]);
+	table->aggs->list[pos] = table->aggs->list[--table->aggs->n];
+}
+
+int table_agg_add(table_t *table, table_agg_spec_t spec, size_t *out_id) {
+	if (table == NULL || out_id == NULL || (size_t) spec.group >= TABLE_NCOLUMNS) return 0;
+	if (spec.filtered && !table_find_valid(&spec.filter)) return 0;
+	if (table->aggs == NULL) {
+		table->aggs = calloc(1, sizeof(struct table_aggs));
+		if (table->aggs == NULL) return 0;
+		table->aggs->next_id = 1;
+	}
+	if (table->aggs->n == TABLE_AGG_MAX) return 0;
+	agg_t *agg = calloc(1, sizeof(agg_t));
+	if (agg == NULL) return 0;
+	agg->spec = spec;
+	agg->spec.filter.start_pos = 0;
+	if (!agg_fill(agg, table)) {
+		agg_free(agg);
+		return 0;
+	}
+	agg->id = table->aggs->next_id++;
+	table->aggs->list[table->aggs->n++] = agg;
+	*out_id = agg->id;
+	return 1;
+}
+
+int table_agg_drop(table_t *table, size_t id) {
+	size_t pos;
+	if (table == NULL || find_agg(table, id, &pos) == NULL) return 0;
+	drop_at(table, pos);
+	return 1;
+}
+
+size_t table_agg_list(table_t const *table, size_t *out_ids, table_agg_spec_t *out_specs, size_t cap) {
+	if (table == NULL || table->aggs == NULL) return 0;
+	for (size_t i = 0; i < table->aggs->n && i < cap; i++) {
+		if (out_ids != NULL) out_ids[i] = table->aggs->list[i]->id;
+		if (out_specs != NULL) out_specs[i] = table->aggs->list[i]->spec;
+	}
+	return table->aggs->n;
+}
+
+int table_agg_read(table_t const *table, size_t id, table_agg_group_t *out_groups, size_t cap,
+	size_t *out_n) {
+	if (table == NULL || out_n == NULL) return 0;
+	agg_t const *agg = find_agg(table, id, NULL);
+	if (agg == NULL) return 0;
+	size_t n = 0;
+	for (size_t i = 0; i < agg->ngroups; i++) {
+		group_t const *g = &agg->groups[i];
+		if (g->count == 0) continue;
+		if (out_groups != NULL && n < cap) {
+			table_agg_group_t *out = &out_groups[n];
+			out->key = g->key;
+			out->count = g->count;
+			out->sum_c1 = (int64_t) g->sum_c1;
+			out->sum_c2 = g->sum_c2 + g->comp_c2;
+			out->min_c1 = dec_int(heap_top(&g->heaps[H_MIN_C1].live));
+			out->max_c1 = dec_int(~heap_top(&g->heaps[H_MAX_C1].live));
+			out->min_c2 = dec_float(heap_top(&g->heaps[H_MIN_C2].live));
+			out->max_c2 = dec_float(~heap_top(&g->heaps[H_MAX_C2].live));
+		}
+		n++;
+	}
+	*out_n = n;
+	return 1;
+}
+
+void table_aggs_insert(table_t *table, dbrow_t const *row) {
+	if (table->aggs == NULL) return;
+	for (size_t i = 0; i < table->aggs->n;) {
+		if (agg_insert(table->aggs->list[i], row)) i++;
+		else drop_at(table, i);
+	}
+}
+
+void table_aggs_remove(table_t *table, dbrow_t const *row) {
+	if (table->aggs == NULL) return;
+	for (size_t i = 0; i < table->aggs->n;) {
+		if (agg_remove(table->aggs->list[i], row)) i++;
+		else drop_at(table, i);
+	}
+}
+
+int table_aggs_rebuild(table_t *table) {
+	if (table->aggs == NULL) return 1;
+	int ok = 1;
+	for (size_t i = 0; i < table->aggs->n;) {
+		if (agg_fill(table->aggs->list[i], table)) {
+			i++;
+		}
+		else {
+			drop_at(table, i);
+			ok = 0;
+		}
+	}
+	return ok;
+}
+
+void table_aggs_free(table_t *table) {
+	if (table == NULL || table->aggs == NULL) return;
+	for (size_t i = 0; i < table->aggs->n; i++) agg_free(table->aggs->list[i]);
+	free(table->aggs);
+	table->aggs = NULL;
+}
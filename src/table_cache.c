@@ -0,0 +1,209 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "table_cache.h"
+
+typedef enum { CK_FIND, CK_SORT } cache_kind_t;
+
+// zeroed before filling, compared with memcmp
+typedef struct {
+	cache_kind_t kind;
+	column_t column;
+	int mode; // condition_t or sort_dir_t
+	dbrow_u data1;
+	dbrow_u data2;
+	size_t start_pos;
+} cache_key_t;
+
+typedef struct {
+	cache_key_t key;
+	uint64_t used; // last use tick, 0 for a free slot
+	void *data;
+	size_t n;
+	size_t bytes;
+} cache_entry_t;
+
+struct table_cache {
+	uint64_t version;
+	uint64_t tick;
+	cache_entry_t entries[TABLE_CACHE_ENTRIES];
+	void *scratch; // last result that was too large to keep
+	table_cache_stats_t stats;
+};
+
+#define COPY_UINT(name, len) dst->name = src->name;
+#define COPY_INT(name, len) dst->name = src->name;
+// -0.0 and 0.0 match the same rows
+#define COPY_FLOAT(name, len) dst->name = src->name == 0 ? 0.0 : src->name;
+#define COPY_BOOL(name, len) dst->name = src->name ? true : false;
+#define COPY_STR(name, len) wcsncpy(dst->name, src->name, len);
+#define COPY_CASE(a, name, tag, kind, len, charset) case tag: COPY_##kind(name, len) break;
+
+static void copy_operand(dbrow_u *dst, dbrow_u const *src, column_t column) {
+	switch (column) {
+	default: break;
+	TABLE_SCHEMA(COPY_CASE, _)
+	}
+}
+
+static int find_key(table_find_t const *findspec, cache_key_t *key) {
+	if (findspec->column < TC_ID || findspec->column >= TABLE_NCOLUMNS) return 0;
+	if (findspec->condition < C_EQ || findspec->condition > C_PREFIX) return 0;
+	memset(key, 0, sizeof(*key));
+	key->kind = CK_FIND;
+	key->column = findspec->column;
+	key->mode = findspec->condition;
+	copy_operand(&key->data1, &findspec->data1, findspec->column);
+	if (findspec->condition == C_BTW) copy_operand(&key->data2, &findspec->data2, findspec->column);
+	key->start_pos = findspec->start_pos;
+	return 1;
+}
+
+static int sort_key(table_sort_t const *sortspec, cache_key_t *key) {
+	if (sortspec->column < TC_ID || sortspec->column >= TABLE_NCOLUMNS) return 0;
+	if (sortspec->direction != S_ASC && sortspec->direction != S_DESC) return 0;
+	memset(key, 0, sizeof(*key));
+	key->kind = CK_SORT;
+	key->column = sortspec->column;
+	key->mode = sortspec->direction;
+	return 1;
+}
+
+static void drop(struct table_cache *cache, cache_entry_t *entry) {
+	cache->stats.entries--;
+	cache->stats.bytes -= entry->bytes;
+	free(entry->data);
+	memset(entry, 0, sizeof(*entry));
+}
+
+/*
+ * creates cache on first use, drops entries of older versions
+ * returns NULL on failure
+ */
+static struct table_cache *prepare(table_t *table) {
+	struct table_cache *cache = table->cache;
+	if (cache == NULL) {
+		cache = calloc(1, sizeof(struct table_cache));
+		if (cache == NULL) return NULL;
+		cache->version = table->version;
+		table->cache = cache;
+	}
+	free(cache->scratch);
+	cache->scratch = NULL;
+	if (cache->version != table->version) {
+		for (size_t i = 0; i < TABLE_CACHE_ENTRIES; i++) {
+			if (cache->entries[i].used != 0) drop(cache, &cache->entries[i]);
+		}
+		cache->version = table->version;
+	}
+	return cache;
+}
+
+static cache_entry_t *lookup(struct table_cache *cache, cache_key_t const *key) {
+	for (size_t i = 0; i < TABLE_CACHE_ENTRIES; i++) {
+		cache_entry_t *entry = &cache->entries[i];
+		if (entry->used != 0 && memcmp(&entry->key, key, sizeof(*key)) == 0) {
+			entry->used = ++cache->tick;
+			cache->stats.hits++;
+			return entry;
+		}
+	}
+	cache->stats.misses++;
+	return NULL;
+}
+
+/*
+ * takes ownership of data
+ */
+static void insert(struct table_cache *cache, cache_key_t const *key, void *data, size_t n, size_t bytes) {
+	if (bytes > TABLE_CACHE_BYTES) {
+		cache->scratch = data;
+		return;
+	}
+	cache_entry_t *slot = NULL;
+	for (;;) {
+		cache_entry_t *lru = NULL;
+		slot = NULL;
+		for (size_t i = 0; i < TABLE_CACHE_ENTRIES; i++) {
+			cache_entry_t *entry = &cache->entries[i];
+			if (entry->used == 0) { if (slot == NULL) slot = entry; }
+			else if (lru == NULL || entry->used < lru->used) { lru = entry; }
+		}
+		if (slot != NULL && cache->stats.bytes + bytes <= TABLE_CACHE_BYTES) break;
+		drop(cache, lru);
+		cache->stats.evictions++;
+	}
+	memcpy(&slot->key, key, sizeof(*key)); // keeps zeroed padding
+	slot->used = ++cache->tick;
+	slot->data = data;
+	slot->n = n;
+	slot->bytes = bytes;
+	cache->stats.entries++;
+	cache->stats.bytes += bytes;
+}
+
+int table_cached_find(table_t *table, table_find_t findspec, size_t const **out_idx, size_t *out_n) {
+	cache_key_t key;
+	if (table == NULL || out_idx == NULL || out_n == NULL || !find_key(&findspec, &key)) return 0;
+	struct table_cache *cache = prepare(table);
+	if (cache == NULL) return 0;
+	cache_entry_t const *entry = lookup(cache, &key);
+	if (entry != NULL) {
+		*out_idx = entry->data;
+		*out_n = entry->n;
+		return 1;
+	}
+	size_t *idx = NULL, n = 0;
+	if (table->rows != NULL && table->len > 0) {
+		idx = malloc(table->len * sizeof(size_t));
+		if (idx == NULL) return 0;
+		n = table_find_all(table, findspec, idx, table->len, NULL);
+		if (n == 0) {
+			free(idx);
+			idx = NULL;
+		}
+		else if (n < table->len) {
+			size_t *shrunk = realloc(idx, n * sizeof(size_t));
+			if (shrunk != NULL) idx = shrunk;
+		}
+	}
+	insert(cache, &key, idx, n, n * sizeof(size_t));
+	*out_idx = idx;
+	*out_n = n;
+	return 1;
+}
+
+int table_cached_sort(table_t *table, table_sort_t sortspec, dbrow_t const **out_rows) {
+	cache_key_t key;
+	if (table == NULL || table->rows == NULL || table->len == 0 || out_rows == NULL
+		|| !sort_key(&sortspec, &key)) return 0;
+	struct table_cache *cache = prepare(table);
+	if (cache == NULL) return 0;
+	cache_entry_t const *entry = lookup(cache, &key);
+	if (entry != NULL) {
+		*out_rows = entry->data;
+		return 1;
+	}
+	dbrow_t *rows;
+	if (!table_sort(table, sortspec, &rows)) return 0;
+	insert(cache, &key, rows, table->len, table->len * sizeof(dbrow_t));
+	*out_rows = rows;
+	return 1;
+}
+
+void table_cache_stats(table_t const *table, table_cache_stats_t *out_stats) {
+	if (out_stats == NULL) return;
+	if (table == NULL || table->cache == NULL) memset(out_stats, 0, sizeof(*out_stats));
+	else *out_stats = table->cache->stats;
+}
+
+void table_cache_clear(table_t *table) {
+	if (table == NULL || table->cache == NULL) return;
+	struct table_cache *cache = table->cache;
+	for (size_t i = 0; i < TABLE_CACHE_ENTRIES; i++) {
+		if (cache->entries[i].used != 0) free(cache->entries[i].data);
+	}
+	free(cache->scratch);
+	free(cache);
+	table->cache = NULL;
+}
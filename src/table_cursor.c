@@ -0,0 +1,187 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "table_cursor.h"
+#include "stats.h"
+
+// positions matched per table_find_all call while selecting
+#define SELECT_BATCH 1024
+
+enum { CM_SCAN, CM_VIEW, CM_HEAP };
+
+// a goes before b in output order
+static int before(table_top_t const *top, size_t a, size_t b) {
+	int c = top->cmp(top->row_at(top->src, a), top->row_at(top->src, b));
+	return c != 0 ? c < 0 : a < b;
+}
+
+// max-heap in output order, the root is the last selected row
+static void sift_up(table_top_t *top, size_t i) {
+	size_t *heap = top->pos;
+	while (i > 0) {
+		size_t p = (i - 1) / 2;
+		if (!before(top, heap[p], heap[i])) return;
+		size_t tmp = heap[p];
+		heap[p] = heap[i];
+		heap[i] = tmp;
+		i = p;
+	}
+}
+
+static void sift_down(table_top_t *top, size_t n, size_t i) {
+	size_t *heap = top->pos;
+	for (;;) {
+		size_t l = 2 * i + 1, r = l + 1, m = i;
+		if (l < n && before(top, heap[m], heap[l])) m = l;
+		if (r < n && before(top, heap[m], heap[r])) m = r;
+		if (m == i) return;
+		size_t tmp = heap[m];
+		heap[m] = heap[i];
+		heap[i] = tmp;
+		i = m;
+	}
+}
+
+int table_top_init(table_top_t *top, size_t k, void const *src, table_row_at_t row_at, table_cmp_t cmp) {
+	if (top == NULL || row_at == NULL || cmp == NULL) return 0;
+	*top = (table_top_t) {.k = k, .src = src, .row_at = row_at, .cmp = cmp};
+	top->pos = malloc((k > 0 ? k : 1) * sizeof(size_t));
+	return top->pos != NULL;
+}
+
+void table_top_offer(table_top_t *top, size_t pos) {
+	if (top->n < top->k) {
+		top->pos[top->n++] = pos;
+		sift_up(top, top->n - 1);
+	}
+	else if (top->k > 0 && before(top, pos, top->pos[0])) {
+		top->pos[0] = pos;
+		sift_down(top, top->n, 0);
+	}
+}
+
+size_t table_top_finish(table_top_t *top) {
+	// heap sort, the root goes to the end
+	for (size_t m = top->n; m > 1; m--) {
+		size_t tmp = top->pos[0];
+		top->pos[0] = top->pos[m - 1];
+		top->pos[m - 1] = tmp;
+		sift_down(top, m - 1, 0);
+	}
+	return top->n;
+}
+
+static dbrow_t const *table_row_at(void const *table, size_t pos) {
+	return &((table_t const *) table)->rows[pos];
+}
+
+/*
+ * keeps the first k matching positions in output order in cur->top
+ * returns 1 on success, 0 on failure
+ */
+static int select_top(table_cursor_t *cur, table_cmp_t cmp, size_t k) {
+	table_t const *table = cur->table;
+	size_t len = TABLE_ROWS_LEN(table);
+	table_top_t top;
+	if (!table_top_init(&top, k < len ? k : len, table, table_row_at, cmp)) return 0;
+	STATS_START(start);
+	size_t batch[SELECT_BATCH];
+	table_find_t findspec = cur->findspec;
+	for (size_t from = 0; top.k > 0 && from < len;) {
+		size_t nb;
+		if (cur->filtered) {
+			findspec.start_pos = from;
+			nb = table_find_all(table, findspec, batch, SELECT_BATCH, &from);
+		}
+		else {
+			nb = len - from < SELECT_BATCH ? len - from : SELECT_BATCH;
+			for (size_t j = 0; j < nb; j++) batch[j] = from + j;
+			from += nb;
+		}
+		for (size_t j = 0; j < nb; j++) table_top_offer(&top, batch[j]);
+	}
+	size_t n = table_top_finish(&top);
+	STATS_END(ST_SORT, start, len, len * sizeof(dbrow_t), n * sizeof(size_t));
+	cur->top = top.pos;
+	cur->ntop = n;
+	cur->at = cur->skip < n ? cur->skip : n;
+	cur->skip = 0;
+	return 1;
+}
+
+int table_cursor_open(table_cursor_t *cur, table_t const *table, table_find_t const *findspec,
+	table_sort_t const *sortspec, size_t offset, size_t limit) {
+	if (cur == NULL || table == NULL) return 0;
+	memset(cur, 0, sizeof(*cur));
+	cur->table = table;
+	cur->version = table->version;
+	if (findspec != NULL) {
+		cur->filtered = 1;
+		cur->findspec = *findspec;
+	}
+	cur->skip = offset;
+	cur->left = limit;
+	if (sortspec == NULL) {
+		cur->mode = CM_SCAN;
+		if (!cur->filtered) {
+			// every row matches, jump over the offset
+			cur->pos = offset < TABLE_ROWS_LEN(table) ? offset : TABLE_ROWS_LEN(table);
+			cur->skip = 0;
+		}
+		return 1;
+	}
+	table_cmp_t cmp = table_sort_cmp(*sortspec);
+	if (cmp == NULL) return 0;
+	if (table_view_begin(table, *sortspec, &cur->iter)) {
+		cur->mode = CM_VIEW;
+		return 1;
+	}
+	cur->mode = CM_HEAP;
+	size_t k = limit > SIZE_MAX - offset ? SIZE_MAX : offset + limit;
+	return select_top(cur, cmp, k);
+}
+
+dbrow_t const *table_cursor_next(table_cursor_t *cur) {
+	if (cur == NULL || cur->table == NULL || cur->left == 0) return NULL;
+	table_t const *table = cur->table;
+	if (table->version != cur->version) return NULL;
+	dbrow_t const *row = NULL;
+	switch (cur->mode) {
+	case CM_SCAN:
+		while (cur->pos < TABLE_ROWS_LEN(table)) {
+			size_t idx = cur->pos;
+			if (cur->filtered) {
+				cur->findspec.start_pos = cur->pos;
+				if (!table_find_first(table, cur->findspec, &idx)) {
+					cur->pos = TABLE_ROWS_LEN(table);
+					break;
+				}
+			}
+			cur->pos = idx + 1;
+			if (cur->skip == 0) {
+				row = &table->rows[idx];
+				break;
+			}
+			cur->skip--;
+		}
+		break;
+	case CM_VIEW:
+		while ((row = table_view_next(&cur->iter)) != NULL) {
+			if (cur->filtered && !table_row_matches(row, cur->findspec)) continue;
+			if (cur->skip == 0) break;
+			cur->skip--;
+		}
+		break;
+	case CM_HEAP:
+		if (cur->at < cur->ntop) row = &table->rows[cur->top[cur->at++]];
+		break;
+	}
+	if (row != NULL && cur->left != TABLE_CURSOR_ALL) cur->left--;
+	return row;
+}
+
+void table_cursor_close(table_cursor_t *cur) {
+	if (cur == NULL) return;
+	free(cur->top);
+	memset(cur, 0, sizeof(*cur));
+}
@@ -0,0 +1,305 @@
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "table_extsort.h"
+#include "table_pack.h"
+#include "collate.h"
+#include "csv.h"
+
+// rows per spilled block, smaller blocks let more runs share the merge budget
+#define MAX_BLOCK_ROWS TABLE_PACK_BLOCK_ROWS
+#define MIN_BLOCK_ROWS 64
+// shrink blocks until at least this many runs merge at once
+#define MIN_FAN_IN 16
+// a decoded block row with its share of codec scratch
+#define BLOCK_ROW_BYTES (2 * sizeof(dbrow_t))
+
+typedef struct {
+	FILE *f;
+	size_t len;
+} run_t;
+
+typedef struct {
+	table_sort_t sortspec;
+	table_cmp_t cmp;
+	size_t block; // rows per block
+	size_t fan_in; // runs merged at once
+	char const *tmpdir;
+	uint8_t *buf; // codec scratch
+	size_t cap;
+} xsort_t;
+
+typedef struct {
+	FILE *f;
+	size_t left; // rows not read yet
+	dbrow_t *rows; // current block
+	size_t n, pos;
+} input_t;
+
+typedef struct {
+	input_t *in;
+	size_t k;
+	size_t *node; // node[0] is the winner, node[1..k-1] losers of their matches
+	table_cmp_t cmp;
+} losers_t;
+
+typedef struct {
+	xsort_t *xs;
+	run_t run;
+} spill_t;
+
+static FILE *temp_file(char const *tmpdir) {
+#ifndef _WIN32
+	if (tmpdir != NULL) {
+		static char const name[] = "/stankindb-XXXXXX";
+		size_t len = strlen(tmpdir);
+		char *path = malloc(len + sizeof(name));
+		if (path == NULL) return NULL;
+		memcpy(path, tmpdir, len);
+		memcpy(path + len, name, sizeof(name));
+		FILE *f = NULL;
+		int fd = mkstemp(path);
+		if (fd >= 0) {
+			unlink(path);
+			f = fdopen(fd, "w+b");
+			if (f == NULL) close(fd);
+		}
+		free(path);
+		return f;
+	}
+#else
+	(void) tmpdir;
+#endif
+	return tmpfile();
+}
+
+static void close_runs(run_t *runs, size_t n) {
+	for (size_t i = 0; i < n; i++) {
+		if (runs[i].f != NULL) fclose(runs[i].f);
+		runs[i].f = NULL;
+	}
+}
+
+#define KEY_CASE(rows, name, tag, kind, len, charset) KEY_CASE_##kind(rows, name, tag, len)
+#define KEY_CASE_UINT(rows, name, tag, len)
+#define KEY_CASE_INT(rows, name, tag, len)
+#define KEY_CASE_FLOAT(rows, name, tag, len)
+#define KEY_CASE_BOOL(rows, name, tag, len)
+#define KEY_CASE_STR(rows, name, tag, len) \
+	case tag: for (size_t i = 0; i < n; i++) collate_key((rows)[i].name, len, (rows)[i].name##_key); break;
+
+// the pack codec drops collation keys, the comparator needs the one of the sort column
+static void collate_column(dbrow_t *rows, size_t n, column_t column) {
+	switch (column) {
+	default: break;
+	TABLE_SCHEMA(KEY_CASE, rows)
+	}
+}
+
+static int spill_sink(void *ctx, dbrow_t const *rows, size_t n) {
+	spill_t *s = ctx;
+	if (!table_pack_write(s->run.f, rows, n, &s->xs->buf, &s->xs->cap)) return 0;
+	s->run.len += n;
+	return 1;
+}
+
+static int spill_end(spill_t *s) {
+	return fflush(s->run.f) == 0 && fseek(s->run.f, 0, SEEK_SET) == 0;
+}
+
+static int emit(xsort_t *xs, dbrow_t const *rows, size_t n, table_extsort_sink_t sink, void *ctx) {
+	for (size_t i = 0; i < n; i += xs->block) {
+		if (!sink(ctx, rows + i, n - i < xs->block ? n - i : xs->block)) return 0;
+	}
+	return 1;
+}
+
+static int refill(xsort_t *xs, input_t *in) {
+	in->n = in->pos = 0;
+	if (in->left == 0) return 1;
+	if (!table_unpack_read(in->f, in->rows, xs->block, &xs->buf, &xs->cap, &in->n)) return 0;
+	if (in->n > in->left) return 0;
+	in->left -= in->n;
+	collate_column(in->rows, in->n, xs->sortspec.column);
+	return 1;
+}
+
+// input a goes out before input b: exhausted inputs last, ties by input order
+// k stands for a row below all others while the tree is built
+static int beats(losers_t const *lt, size_t a, size_t b) {
+	if (a == lt->k) return 1;
+	if (b == lt->k) return 0;
+	input_t const *x = &lt->in[a], *y = &lt->in[b];
+	if (x->pos == x->n) return 0;
+	if (y->pos == y->n) return 1;
+	int c = lt->cmp(&x->rows[x->pos], &y->rows[y->pos]);
+	return c < 0 || (c == 0 && a < b);
+}
+
+// input s changed its head, replays its matches from leaf to root
+static void replay(losers_t *lt, size_t s) {
+	size_t winner = s;
+	for (size_t t = (s + lt->k) / 2; t > 0; t /= 2) {
+		if (beats(lt, lt->node[t], winner)) {
+			size_t loser = winner;
+			winner = lt->node[t];
+			lt->node[t] = loser;
+		}
+	}
+	lt->node[0] = winner;
+}
+
+/*
+ * merges k runs into sink in blocks, closes the runs
+ * returns 1 on success, 0 on failure
+ */
+static int merge(xsort_t *xs, run_t *runs, size_t k, table_extsort_sink_t sink, void *ctx) {
+	input_t *in = calloc(k, sizeof(input_t));
+	size_t *node = malloc(k * sizeof(size_t));
+	// one block per run and one for output
+	dbrow_t *blocks = calloc((k + 1) * xs->block, sizeof(dbrow_t));
+	int ok = in != NULL && node != NULL && blocks != NULL;
+	for (size_t i = 0; ok && i < k; i++) {
+		in[i] = (input_t) {.f = runs[i].f, .left = runs[i].len, .rows = blocks + i * xs->block};
+		ok = refill(xs, &in[i]);
+	}
+	losers_t lt = {in, k, node, xs->cmp};
+	if (ok) {
+		for (size_t i = 0; i < k; i++) node[i] = k;
+		for (size_t s = k; s-- > 0;) replay(&lt, s);
+	}
+	dbrow_t *out = blocks + k * xs->block;
+	size_t nout = 0;
+	while (ok) {
+		input_t *w = &in[node[0]];
+		if (w->pos == w->n) break; // every input is exhausted
+		out[nout++] = w->rows[w->pos++];
+		if (nout == xs->block) {
+			ok = sink(ctx, out, nout);
+			nout = 0;
+		}
+		if (ok && w->pos == w->n) ok = refill(xs, w);
+		replay(&lt, node[0]);
+	}
+	if (ok && nout > 0) ok = sink(ctx, out, nout);
+	close_runs(runs, k);
+	free(blocks);
+	free(node);
+	free(in);
+	return ok;
+}
+
+/*
+ * sorts runs of the table and spills them, then merges groups of fan_in runs until
+ * one merge is left
+ * returns number of runs in *out_runs, 0 on failure
+ */
+static size_t make_runs(xsort_t *xs, table_t const *table, dbrow_t *buf, size_t run_rows, run_t **out_runs) {
+	size_t nruns = (table->len + run_rows - 1) / run_rows;
+	run_t *runs = calloc(nruns, sizeof(run_t));
+	if (runs == NULL) return 0;
+	for (size_t r = 0; r < nruns; r++) {
+		size_t from = r * run_rows, n = table->len - from < run_rows ? table->len - from : run_rows;
+		memcpy(buf, table->rows + from, n * sizeof(dbrow_t));
+		spill_t s = {xs, {temp_file(xs->tmpdir), 0}};
+		runs[r] = s.run;
+		if (s.run.f == NULL || !table_sort_rows(buf, n, xs->sortspec) || !emit(xs, buf, n, spill_sink, &s)
+			|| !spill_end(&s)) goto fail;
+		runs[r] = s.run;
+	}
+	// merged runs take the place of their group, slots behind them are closed
+	while (nruns > xs->fan_in) {
+		size_t merged = 0;
+		for (size_t i = 0; i < nruns; i += xs->fan_in) {
+			size_t k = nruns - i < xs->fan_in ? nruns - i : xs->fan_in;
+			if (k == 1) {
+				run_t moved = runs[i];
+				runs[i].f = NULL;
+				runs[merged++] = moved;
+				continue;
+			}
+			spill_t s = {xs, {temp_file(xs->tmpdir), 0}};
+			if (s.run.f == NULL) goto fail;
+			if (!merge(xs, runs + i, k, spill_sink, &s) || !spill_end(&s)) {
+				fclose(s.run.f);
+				goto fail;
+			}
+			runs[merged++] = s.run;
+		}
+		nruns = merged;
+	}
+	*out_runs = runs;
+	return nruns;
+fail:
+	close_runs(runs, (table->len + run_rows - 1) / run_rows);
+	free(runs);
+	return 0;
+}
+
+int table_extsort(table_t const *table, table_sort_t sortspec, size_t budget, char const *tmpdir,
+	table_extsort_sink_t sink, void *ctx) {
+	if (table == NULL || (table->rows == NULL && table->len > 0) || sink == NULL) return 0;
+	xsort_t xs = {.sortspec = sortspec, .cmp = table_sort_cmp(sortspec), .tmpdir = tmpdir};
+	if (xs.cmp == NULL) return 0;
+	if (budget == 0) budget = TABLE_EXTSORT_BUDGET;
+	if (budget < TABLE_EXTSORT_MIN_BUDGET) budget = TABLE_EXTSORT_MIN_BUDGET;
+	xs.block = MAX_BLOCK_ROWS;
+	while (xs.block > MIN_BLOCK_ROWS && budget / (BLOCK_ROW_BYTES * xs.block) < MIN_FAN_IN + 1) xs.block /= 2;
+	xs.fan_in = budget / (BLOCK_ROW_BYTES * xs.block) - 1;
+	size_t run_rows = budget / sizeof(dbrow_t);
+	if (table->len == 0) return 1;
+	dbrow_t *buf = malloc((table->len < run_rows ? table->len : run_rows) * sizeof(dbrow_t));
+	if (buf == NULL) return 0;
+	int ok;
+	if (table->len <= run_rows) {
+		memcpy(buf, table->rows, table->len * sizeof(dbrow_t));
+		ok = table_sort_rows(buf, table->len, sortspec) && emit(&xs, buf, table->len, sink, ctx);
+		free(buf);
+		return ok;
+	}
+	run_t *runs;
+	size_t nruns = make_runs(&xs, table, buf, run_rows, &runs);
+	free(buf);
+	ok = nruns > 0 && merge(&xs, runs, nruns, sink, ctx);
+	if (nruns > 0) free(runs);
+	free(xs.buf);
+	return ok;
+}
+
+typedef struct {
+	FILE *fout;
+	uint8_t *buf;
+	size_t cap;
+	char sep;
+} out_t;
+
+static int pack_sink(void *ctx, dbrow_t const *rows, size_t n) {
+	out_t *out = ctx;
+	return table_pack_write(out->fout, rows, n, &out->buf, &out->cap);
+}
+
+int table_extsort_pack(FILE *fout, table_t const *table, table_sort_t sortspec, size_t budget,
+	char const *tmpdir) {
+	if (fout == NULL || table == NULL) return 0;
+	out_t out = {.fout = fout};
+	int ok = table_pack_header(fout, table->len, table->next_id)
+		&& table_extsort(table, sortspec, budget, tmpdir, pack_sink, &out);
+	free(out.buf);
+	return ok && fflush(fout) == 0;
+}
+
+static int csv_sink(void *ctx, dbrow_t const *rows, size_t n) {
+	out_t *out = ctx;
+	return csv_export_rows(out->fout, rows, n, out->sep, 1);
+}
+
+int table_extsort_csv(FILE *fout, table_t const *table, table_sort_t sortspec, size_t budget,
+	char const *tmpdir, char sep) {
+	if (fout == NULL || table == NULL) return 0;
+	out_t out = {.fout = fout, .sep = sep};
+	return csv_export_header(fout, sep) && table_extsort(table, sortspec, budget, tmpdir, csv_sink, &out)
+		&& fflush(fout) == 0;
+}
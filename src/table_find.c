@@ -2,35 +2,33 @@
 #include <string.h>
 
 #include "table.h"
+#include "stats.h"
+#include "table_trgm.h"
+#include "collate.h"
+#include "table_plan.h"
+#include "thread.h"
 
-int table_find_first(table_t const *table, table_find_t findspec, size_t *out_idx) {
+// rows of one thread per round of a parallel scan
+#define PARALLEL_BLOCK_ROWS (1 << 16)
+#define PARALLEL_MAX_JOBS 64
+
+// orders a string against an operand like table_sort_cmp: collation keys, then code units on a tie
+static int str_order(uint8_t const *key, wchar_t const *str, uint8_t const *operand_key, wchar_t const *operand,
+	size_t maxlen) {
+	int c = memcmp(key, operand_key, COLLATE_KEY_SIZE(maxlen));
+	return c != 0 ? c : wcsncmp(str, operand, maxlen + 1);
+}
+
+// scan from findspec.start_pos, all other paths fall back to it
+static int find_first(table_t const *table, table_find_t findspec, size_t *out_idx) {
 	if (table == NULL || table->rows == NULL || table->len == 0 || out_idx == NULL ||
 		findspec.start_pos >= table->len) return 0;
-	if (findspec.column == TC_ID && findspec.condition == C_EQ) {
-		// special case - id ASC unique
-		// use binary search
-		size_t id = findspec.data1.id;
-		size_t start = findspec.start_pos, end = table->len - 1;
-		size_t end0 = end, result_idx = (size_t) -1;
-		while (result_idx == (size_t) -1 && start <= end && end <= end0) {
-			size_t middle = (start + end) / 2;
-			size_t middle_id = table->rows[middle].id;
-			if (middle_id < id) { start = middle + 1; }
-			else if (middle_id > id) { end = middle - 1; }
-			else { result_idx = middle; }
-		}
-		*out_idx = result_idx;
-		return result_idx != (size_t) -1;
-	}
 	switch (findspec.column) {
 	default:
 		return 0;
-	case TC_ID:
-	case TC_C1:
-	case TC_C2:
-	case TC_C3:
-	case TC_C4:
-	case TC_C5:
+#define TFF_VALID(a, name, tag, kind, len, charset) case tag:
+	TABLE_SCHEMA(TFF_VALID, _)
+#undef TFF_VALID
 		break;
 	}
 	switch (findspec.condition) {
@@ -43,16 +41,18 @@ int table_find_first(table_t const *table, table_find_t findspec, size_t *out_id
 	case C_LE:
 	case C_LT:
 	case C_BTW:
+	case C_CONTAINS:
+	case C_PREFIX:
 		break;
 	}
-	if ((findspec.column == TC_C3 || findspec.column == TC_C5)
-		&& !(findspec.condition == C_EQ || findspec.condition == C_NEQ)) return 0;
 
 // here is the actual search
+// every loop returns so that a miss never falls through into the next column
 #define TFF_LOOP(cond, pre) for \
 	(size_t i = findspec.start_pos, len = table->len; i < len; i++) { \
 		pre; if (cond) { *out_idx = i; return 1; } \
-	}
+	} \
+	return 0;
 #define TFF_ROW(col) (table->rows[i]. col)
 #define TFF_DATA1(col) (findspec.data1. col)
 #define TFF_DATA2(col) (findspec.data2. col)
@@ -71,53 +71,68 @@ int table_find_first(table_t const *table, table_find_t findspec, size_t *out_id
 	wchar_t *str1 = TFF_ROW(col); wchar_t *str2 = TFF_DATA1(col); \
 	size_t a = wcslen(str1); size_t b = wcslen(str2); \
 )
+// string ranges agree with the sort order: collation keys (see collate.h), then str_order
+	uint8_t key1[COLLATE_KEY_SIZE(TABLE_STR_MAXLEN)], key2[COLLATE_KEY_SIZE(TABLE_STR_MAXLEN)];
+#define TFF_KEY_ORDER(col, key, maxlen, k, data) str_order(TFF_ROW(key), TFF_ROW(col), k, data, maxlen)
+#define TFF_KEY_COND(col, key, maxlen, cmp) collate_key(TFF_DATA1(col), maxlen, key1); \
+	TFF_LOOP((TFF_KEY_ORDER(col, key, maxlen, key1, TFF_DATA1(col)) cmp 0),)
+#define TFF_KEY_BTW(col, key, maxlen) collate_key(TFF_DATA1(col), maxlen, key1); \
+	collate_key(TFF_DATA2(col), maxlen, key2); \
+	TFF_LOOP( \
+		((TFF_KEY_ORDER(col, key, maxlen, key1, TFF_DATA1(col)) >= 0) \
+			&& (TFF_KEY_ORDER(col, key, maxlen, key2, TFF_DATA2(col)) <= 0)), \
+	)
+#define TFF_STR_CONTAINS(col) TFF_LOOP((wcsstr(TFF_ROW(col), TFF_DATA1(col)) != NULL),)
+#define TFF_STR_PREFIX(col) TFF_LOOP( \
+	(wcsncmp(TFF_ROW(col), TFF_DATA1(col), b) == 0), \
+	size_t b = wcslen(TFF_DATA1(col)); \
+)
+// one switch per column, its cases come from the column kind, see schema.h
+#define TFF_CASES_NUM(col) \
+	case C_EQ: TFF_COND(col, ==); break; \
+	case C_NEQ: TFF_COND(col, !=); break; \
+	case C_GE: TFF_COND(col, >=); break; \
+	case C_GT: TFF_COND(col, >); break; \
+	case C_LE: TFF_COND(col, <=); break; \
+	case C_LT: TFF_COND(col, <); break; \
+	case C_BTW: TFF_BTW(col); break;
+#define TFF_CASES_UINT(col, len) TFF_CASES_NUM(col)
+#define TFF_CASES_INT(col, len) TFF_CASES_NUM(col)
+#define TFF_CASES_FLOAT(col, len) TFF_CASES_NUM(col)
+#define TFF_CASES_BOOL(col, len) \
+	case C_EQ: TFF_COND(col, ==); break; \
+	case C_NEQ: TFF_COND(col, !=); break;
+#define TFF_CASES_STR(col, len) \
+	case C_EQ: TFF_STR_EQ(col); break; \
+	case C_NEQ: TFF_STR_NEQ(col); break; \
+	case C_CONTAINS: TFF_STR_CONTAINS(col); break; \
+	case C_PREFIX: TFF_STR_PREFIX(col); break; \
+	case C_GE: TFF_KEY_COND(col, col##_key, len, >=); break; \
+	case C_GT: TFF_KEY_COND(col, col##_key, len, >); break; \
+	case C_LE: TFF_KEY_COND(col, col##_key, len, <=); break; \
+	case C_LT: TFF_KEY_COND(col, col##_key, len, <); break; \
+	case C_BTW: TFF_KEY_BTW(col, col##_key, len); break;
+#define TFF_COLUMN(a, name, tag, kind, len, charset) \
+	case tag: switch (findspec.condition) { \
+		default: return 0; \
+		TFF_CASES_##kind(name, len) \
+		}
 	switch (findspec.column) {
 	default: return 0;
-	case TC_ID: switch (findspec.condition) {
-		default: return 0;
-		case C_NEQ: TFF_COND(id, !=); break;
-		case C_GE: TFF_COND(id, >=); break;
-		case C_GT: TFF_COND(id, >); break;
-		case C_LE: TFF_COND(id, <=); break;
-		case C_LT: TFF_COND(id, <); break;
-		case C_BTW: TFF_BTW(id); break;
-		}
-	case TC_C1: switch (findspec.condition) {
-		default: return 0;
-		case C_EQ: TFF_COND(c1, ==); break;
-		case C_NEQ: TFF_COND(c1, !=); break;
-		case C_GE: TFF_COND(c1, >=); break;
-		case C_GT: TFF_COND(c1, >); break;
-		case C_LE: TFF_COND(c1, <=); break;
-		case C_LT: TFF_COND(c1, <); break;
-		case C_BTW: TFF_BTW(c1); break;
-		}
-	case TC_C2: switch (findspec.condition) {
-		default: return 0;
-		case C_EQ: TFF_COND(c2, ==); break;
-		case C_NEQ: TFF_COND(c2, !=); break;
-		case C_GE: TFF_COND(c2, >=); break;
-		case C_GT: TFF_COND(c2, >); break;
-		case C_LE: TFF_COND(c2, <=); break;
-		case C_LT: TFF_COND(c2, <); break;
-		case C_BTW: TFF_BTW(c2); break;
-		}
-	case TC_C3: switch (findspec.condition) {
-		default: return 0;
-		case C_EQ: TFF_STR_EQ(c3); break;
-		case C_NEQ: TFF_STR_NEQ(c3); break;
-		}
-	case TC_C4: switch (findspec.condition) {
-		default: return 0;
-		case C_EQ: TFF_COND(c4, ==); break;
-		case C_NEQ: TFF_COND(c4, !=); break;
-		}
-	case TC_C5: switch (findspec.condition) {
-		default: return 0;
-		case C_EQ: TFF_STR_EQ(c5); break;
-		case C_NEQ: TFF_STR_NEQ(c5); break;
-		}
+	TABLE_SCHEMA(TFF_COLUMN, _)
 	}
+#undef TFF_COLUMN
+#undef TFF_CASES_STR
+#undef TFF_CASES_BOOL
+#undef TFF_CASES_FLOAT
+#undef TFF_CASES_INT
+#undef TFF_CASES_UINT
+#undef TFF_CASES_NUM
+#undef TFF_STR_PREFIX
+#undef TFF_KEY_BTW
+#undef TFF_KEY_COND
+#undef TFF_KEY_ORDER
+#undef TFF_STR_CONTAINS
 #undef TFF_STR_NEQ
 #undef TFF_STR_EQ
 #undef TFF_BTW
@@ -128,3 +143,217 @@ int table_find_first(table_t const *table, table_find_t findspec, size_t *out_id
 #undef TFF_LOOP
 	return 0;
 }
+
+// first position >= from with an id >= id, ids are unique and ascend with positions
+static size_t id_lower_bound(table_t const *table, size_t from, size_t id) {
+	// walks over ranges find the next match right at from
+	if (table->rows[from].id >= id) return from;
+	size_t lo = from + 1, hi = table->len;
+	while (lo < hi) {
+		size_t middle = lo + (hi - lo) / 2;
+		if (table->rows[middle].id < id) lo = middle + 1;
+		else hi = middle;
+	}
+	return lo;
+}
+
+static int id_search(table_t const *table, table_find_t findspec, size_t *out_idx) {
+	size_t from = findspec.start_pos, len = table->len, pos;
+	size_t a = findspec.data1.id, b = findspec.data2.id;
+	dbrow_t const *rows = table->rows;
+	switch (findspec.condition) {
+	default:
+		return 0;
+	case C_EQ:
+		pos = id_lower_bound(table, from, a);
+		if (pos < len && rows[pos].id != a) pos = len;
+		break;
+	case C_NEQ:
+		pos = rows[from].id != a ? from : from + 1;
+		break;
+	case C_GE:
+		pos = id_lower_bound(table, from, a);
+		break;
+	case C_GT:
+		pos = a == SIZE_MAX ? len : id_lower_bound(table, from, a + 1);
+		break;
+	case C_LT:
+		pos = rows[from].id < a ? from : len;
+		break;
+	case C_LE:
+		pos = rows[from].id <= a ? from : len;
+		break;
+	case C_BTW:
+		pos = id_lower_bound(table, from, a);
+		if (pos < len && rows[pos].id > b) pos = len;
+		break;
+	}
+	if (pos >= len) return 0;
+	*out_idx = pos;
+	return 1;
+}
+
+typedef struct {
+	table_t part; // one block of rows
+	table_find_t findspec;
+	int found;
+	size_t idx;
+} scan_job_t;
+
+static void scan_worker(void *arg) {
+	scan_job_t *job = arg;
+	job->found = find_first(&job->part, job->findspec, &job->idx);
+}
+
+/*
+ * scans rounds of threads * PARALLEL_BLOCK_ROWS rows, one block per thread,
+ * and stops after the first round with a match
+ */
+static int parallel_scan(table_t const *table, table_find_t findspec, size_t threads, size_t *out_idx) {
+	scan_job_t jobs[PARALLEL_MAX_JOBS];
+	if (threads > PARALLEL_MAX_JOBS) threads = PARALLEL_MAX_JOBS;
+	size_t pos = findspec.start_pos, len = table->len;
+	findspec.start_pos = 0;
+	while (pos < len) {
+		size_t n = 0;
+		for (; n < threads && pos < len; n++) {
+			size_t count = len - pos < PARALLEL_BLOCK_ROWS ? len - pos : PARALLEL_BLOCK_ROWS;
+			jobs[n] = (scan_job_t) {
+				.part = {.rows = table->rows + pos, .len = count, .cap = count},
+				.findspec = findspec,
+			};
+			pos += count;
+		}
+		thread_run(scan_worker, jobs, sizeof(scan_job_t), n);
+		for (size_t t = 0; t < n; t++) {
+			if (jobs[t].found) {
+				*out_idx = (size_t) (jobs[t].part.rows - table->rows) + jobs[t].idx;
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+static int find_planned(table_t const *table, table_find_t findspec, table_plan_t const *plan,
+	size_t *out_idx) {
+	switch (plan->path) {
+	case TP_ID_SEARCH:
+		return id_search(table, findspec, out_idx);
+	case TP_TRGM: {
+		int found = table_trgm_find(table, &findspec, out_idx);
+		if (found >= 0) return found;
+		break;
+	}
+	case TP_PARALLEL:
+		return parallel_scan(table, findspec, plan->threads, out_idx);
+	case TP_SCAN:
+		break;
+	}
+	return find_first(table, findspec, out_idx);
+}
+
+/*
+ * scans the next TABLE_PLAN_HEAD_ROWS rows first, so dense matches never pay for planning,
+ * then plans once (*planned is set) and runs the chosen path over the rest
+ * the id column of a table in id order and searches a trigram index can answer skip the head scan
+ */
+static int find_next(table_t const *table, table_find_t const *findspec, table_plan_t *plan, int *planned,
+	size_t *out_idx) {
+	if (table == NULL || table->rows == NULL || table->len == 0 || out_idx == NULL ||
+		findspec->start_pos >= table->len) return 0;
+	// table_plan always takes the binary search on the id column while ids ascend
+	if (findspec->column == TC_ID && table->ids_ascending) return id_search(table, *findspec, out_idx);
+	size_t from = findspec->start_pos;
+	// an index the user built is worth planning for right away
+	int indexed = (findspec->condition == C_CONTAINS || findspec->condition == C_PREFIX)
+		&& table_trgm_has(table, findspec->column);
+	if (!indexed) {
+		table_t head = *table;
+		if (head.len - from > TABLE_PLAN_HEAD_ROWS) head.len = from + TABLE_PLAN_HEAD_ROWS;
+		if (find_first(&head, *findspec, out_idx)) return 1;
+		if (head.len == table->len) return 0;
+		from = head.len;
+	}
+	table_find_t rest = *findspec;
+	rest.start_pos = from;
+	if (!*planned) {
+		if (!table_plan(table, &rest, plan)) return 0;
+		*planned = 1;
+	}
+	return find_planned(table, rest, plan, out_idx);
+}
+
+int table_find_first(table_t const *table, table_find_t findspec, size_t *out_idx) {
+	STATS_START(start);
+	table_plan_t plan;
+	int planned = 0;
+	int found = find_next(table, &findspec, &plan, &planned, out_idx);
+#ifdef WITH_STATS
+	size_t scanned = 0;
+	if (table != NULL && findspec.start_pos < table->len) {
+		size_t left = table->len - findspec.start_pos;
+		if (found && findspec.column == TC_ID && table->ids_ascending) {
+			// binary search probes
+			while (left > 0) {
+				scanned++;
+				left >>= 1;
+			}
+		}
+		else {
+			scanned = found ? *out_idx - findspec.start_pos + 1 : left;
+		}
+	}
+	STATS_END(ST_FIND, start, scanned, scanned * sizeof(dbrow_t), 0);
+#endif
+	return found;
+}
+
+size_t table_find_all(table_t const *table, table_find_t findspec, size_t *out_idx, size_t cap,
+	size_t *out_next) {
+	if (table == NULL || out_idx == NULL) return 0;
+	STATS_START(start);
+	size_t n = 0, from = findspec.start_pos, idx;
+	// one plan for the whole walk
+	table_plan_t plan;
+	int planned = 0;
+	while (n < cap && find_next(table, &findspec, &plan, &planned, &idx)) {
+		out_idx[n++] = idx;
+		findspec.start_pos = idx + 1;
+	}
+	// a full buffer means there may be more, resume right after the last match
+	size_t next = n == cap ? findspec.start_pos : table->len;
+	if (out_next != NULL) *out_next = next;
+#ifdef WITH_STATS
+	size_t scanned = next > from ? next - from : 0;
+	STATS_END(ST_FIND, start, scanned, scanned * sizeof(dbrow_t), 0);
+#else
+	(void) from;
+#endif
+	return n;
+}
+
+int table_row_matches(dbrow_t const *row, table_find_t findspec) {
+	if (row == NULL) return 0;
+	// a one-row table runs the same loops as a scan
+	table_t one = {.rows = (dbrow_t *) row, .len = 1, .cap = 1};
+	size_t idx;
+	findspec.start_pos = 0;
+	return find_first(&one, findspec, &idx);
+}
+
+// conditions the scan loops above have for each column kind
+#define VALID_CASE(a, name, tag, kind, len, charset) case tag: return VALID_##kind(a);
+#define VALID_UINT(condition) ((condition) < C_CONTAINS)
+#define VALID_INT(condition) ((condition) < C_CONTAINS)
+#define VALID_FLOAT(condition) ((condition) < C_CONTAINS)
+#define VALID_BOOL(condition) ((condition) == C_EQ || (condition) == C_NEQ)
+#define VALID_STR(condition) 1
+
+int table_find_valid(table_find_t const *findspec) {
+	if (findspec == NULL || findspec->condition < C_EQ || findspec->condition > C_PREFIX) return 0;
+	switch (findspec->column) {
+	default: return 0;
+	TABLE_SCHEMA(VALID_CASE, findspec->condition)
+	}
+}
@@ -0,0 +1,127 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "table_join.h"
+#include "hash.h"
+
+#define NIL ((size_t) -1)
+
+// integer keys are the UINT and INT columns, string keys the STR columns
+#define KEY_CASE(a, name, tag, kind, len, charset) KEY_CASE_##kind(a, name, tag)
+#define KEY_CASE_UINT(a, name, tag) case tag: return (uint64_t) (a)->name;
+#define KEY_CASE_INT(a, name, tag) case tag: return (uint64_t) (a)->name;
+#define KEY_CASE_FLOAT(a, name, tag)
+#define KEY_CASE_BOOL(a, name, tag)
+#define KEY_CASE_STR(a, name, tag)
+
+#define STR_CASE(a, name, tag, kind, len, charset) STR_CASE_##kind(a, name, tag)
+#define STR_CASE_UINT(a, name, tag)
+#define STR_CASE_INT(a, name, tag)
+#define STR_CASE_FLOAT(a, name, tag)
+#define STR_CASE_BOOL(a, name, tag)
+#define STR_CASE_STR(a, name, tag) case tag: return (a)->name;
+
+#define INT_TAG(a, name, tag, kind, len, charset) INT_TAG_##kind(tag)
+#define INT_TAG_UINT(tag) case tag:
+#define INT_TAG_INT(tag) case tag:
+#define INT_TAG_FLOAT(tag)
+#define INT_TAG_BOOL(tag)
+#define INT_TAG_STR(tag)
+
+#define STR_TAG(a, name, tag, kind, len, charset) STR_TAG_##kind(tag)
+#define STR_TAG_UINT(tag)
+#define STR_TAG_INT(tag)
+#define STR_TAG_FLOAT(tag)
+#define STR_TAG_BOOL(tag)
+#define STR_TAG_STR(tag) case tag:
+
+static int int_column(column_t column) {
+	switch (column) {
+	TABLE_SCHEMA(INT_TAG, _) return 1;
+	default: return 0;
+	}
+}
+
+static int str_column(column_t column) {
+	switch (column) {
+	TABLE_SCHEMA(STR_TAG, _) return 1;
+	default: return 0;
+	}
+}
+
+int table_join_column(column_t column) {
+	return int_column(column) || str_column(column);
+}
+
+static uint64_t int_key(dbrow_t const *row, column_t column) {
+	switch (column) {
+	default: return 0;
+	TABLE_SCHEMA(KEY_CASE, row)
+	}
+}
+
+static wchar_t const *str_key(dbrow_t const *row, column_t column) {
+	switch (column) {
+	default: return L"";
+	TABLE_SCHEMA(STR_CASE, row)
+	}
+}
+
+static size_t hash_key(dbrow_t const *row, column_t column) {
+	if (int_column(column)) return (size_t) hash_u64(int_key(row, column));
+	return (size_t) hash_wcs(str_key(row, column), SIZE_MAX);
+}
+
+static int same_key(dbrow_t const *a, column_t ca, dbrow_t const *b, column_t cb) {
+	if (int_column(ca)) return int_key(a, ca) == int_key(b, cb);
+	return wcscmp(str_key(a, ca), str_key(b, cb)) == 0;
+}
+
+int table_join(table_t const *left, column_t left_column, table_t const *right, column_t right_column,
+	table_join_emit_t emit, void *arg, size_t *out_pairs) {
+	if (left == NULL || right == NULL || emit == NULL) return 0;
+	if (!(int_column(left_column) && int_column(right_column))
+		&& !(str_column(left_column) && str_column(right_column))) return 0;
+	int build_left = TABLE_ROWS_LEN(left) <= TABLE_ROWS_LEN(right);
+	table_t const *build = build_left ? left : right, *probe = build_left ? right : left;
+	column_t build_column = build_left ? left_column : right_column;
+	column_t probe_column = build_left ? right_column : left_column;
+	size_t nbuild = TABLE_ROWS_LEN(build), nprobe = TABLE_ROWS_LEN(probe), pairs = 0;
+	if (nbuild == 0) goto done;
+	size_t nbuckets = 16;
+	while (nbuckets < nbuild * 2 && nbuckets * 2 > nbuckets) nbuckets *= 2;
+	size_t mask = nbuckets - 1;
+	size_t *head = malloc(nbuckets * sizeof(size_t));
+	size_t *next = malloc(nbuild * sizeof(size_t));
+	size_t *hashes = malloc(nbuild * sizeof(size_t));
+	if (head == NULL || next == NULL || hashes == NULL) goto no_memory;
+	memset(head, 0xff, nbuckets * sizeof(size_t));
+	// backwards, so every chain lists its rows in table order
+	for (size_t i = nbuild; i-- > 0;) {
+		size_t h = hashes[i] = hash_key(&build->rows[i], build_column);
+		next[i] = head[h & mask];
+		head[h & mask] = i;
+	}
+	for (size_t j = 0; j < nprobe; j++) {
+		dbrow_t const *p = &probe->rows[j];
+		size_t h = hash_key(p, probe_column);
+		for (size_t i = head[h & mask]; i != NIL; i = next[i]) {
+			dbrow_t const *b = &build->rows[i];
+			if (hashes[i] != h || !same_key(b, build_column, p, probe_column)) continue;
+			if (build_left) emit(b, p, arg);
+			else emit(p, b, arg);
+			pairs++;
+		}
+	}
+	free(hashes);
+	free(next);
+	free(head);
+done:
+	if (out_pairs != NULL) *out_pairs = pairs;
+	return 1;
+no_memory:
+	free(hashes);
+	free(next);
+	free(head);
+	return 0;
+}
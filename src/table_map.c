@@ -0,0 +1,182 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "table_map.h"
+
+#ifdef _WIN32
+
+table_t *table_map(char const *path, size_t cap) {
+	(void) path;
+	(void) cap;
+	return NULL;
+}
+
+int table_map_sync(table_t *table) {
+	(void) table;
+	return 0;
+}
+
+int table_map_grow(table_t *table, size_t cap) {
+	(void) table;
+	(void) cap;
+	return 0;
+}
+
+void table_map_store(table_t *table) {
+	(void) table;
+}
+
+void table_map_close(table_t *table) {
+	(void) table;
+}
+
+#else
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "table_view.h"
+#include "table_trgm.h"
+#include "table_agg.h"
+#include "table_plan.h"
+
+struct table_map {
+	int fd;
+	void *base;
+	size_t size;
+};
+
+#define HEADER(map) ((table_map_header_t *) (map)->base)
+#define FILE_SIZE(cap) (sizeof(table_map_header_t) + (cap) * sizeof(dbrow_t))
+// largest cap whose FILE_SIZE fits size_t
+#define MAX_CAP ((SIZE_MAX - sizeof(table_map_header_t)) / sizeof(dbrow_t))
+
+static int remap(struct table_map *map, size_t size) {
+	if (map->base != NULL) munmap(map->base, map->size);
+	map->base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, map->fd, 0);
+	if (map->base == MAP_FAILED) {
+		map->base = NULL;
+		return 0;
+	}
+	map->size = size;
+	return 1;
+}
+
+table_t *table_map(char const *path, size_t cap) {
+	if (path == NULL) return NULL;
+	struct table_map *map = malloc(sizeof(struct table_map));
+	if (map == NULL) goto no_map;
+	table_t *table = malloc(sizeof(table_t));
+	if (table == NULL) goto no_table;
+	map->base = NULL;
+	map->fd = open(path, O_RDWR | O_CREAT, 0644);
+	if (map->fd < 0) goto no_file;
+	struct stat st;
+	if (fstat(map->fd, &st) != 0) goto bad_file;
+	if (st.st_size == 0) {
+		size_t cap2 = 16;
+		while (cap2 < cap) cap2 *= 2;
+		if (ftruncate(map->fd, (off_t) FILE_SIZE(cap2)) != 0) goto bad_file;
+		if (!remap(map, FILE_SIZE(cap2))) goto bad_file;
+		table_map_header_t *hdr = HEADER(map);
+		memset(hdr, 0, sizeof(*hdr));
+		memcpy(hdr->magic, TABLE_MAP_MAGIC, sizeof(hdr->magic));
+		hdr->row_size = sizeof(dbrow_t);
+		hdr->next_id = 1;
+		hdr->cap = cap2;
+	}
+	else {
+		if ((size_t) st.st_size < sizeof(table_map_header_t)) goto bad_file;
+		if (!remap(map, (size_t) st.st_size)) goto bad_file;
+		table_map_header_t const *hdr = HEADER(map);
+		if (memcmp(hdr->magic, TABLE_MAP_MAGIC, sizeof(hdr->magic)) != 0
+			|| hdr->row_size != sizeof(dbrow_t) || hdr->len > hdr->cap || hdr->cap > MAX_CAP
+			|| FILE_SIZE(hdr->cap) > (size_t) st.st_size) goto bad_file;
+	}
+	table_map_header_t const *hdr = HEADER(map);
+	table->rows = (dbrow_t *) (hdr + 1);
+	table->len = hdr->len;
+	table->cap = hdr->cap;
+	table->next_id = hdr->next_id > 0 ? hdr->next_id : 1;
+	table->version = 0;
+	table->ids_ascending = table_ids_ascend(NULL, table->rows, table->len);
+	table->map = map;
+	table->cache = NULL;
+	table->views = NULL;
+	table->trgm = NULL;
+	table->colstats = NULL;
+	table->sketch = NULL;
+	table->aggs = NULL;
+	return table;
+bad_file:
+	if (map->base != NULL) munmap(map->base, map->size);
+	close(map->fd);
+no_file:
+	free(table);
+no_table:
+	free(map);
+no_map:
+	return NULL;
+}
+
+void table_map_store(table_t *table) {
+	if (table == NULL || table->map == NULL || table->map->base == NULL) return;
+	table_map_header_t *hdr = HEADER(table->map);
+	hdr->len = table->len;
+	hdr->next_id = table->next_id;
+}
+
+int table_map_sync(table_t *table) {
+	if (table == NULL || table->map == NULL) return 0;
+	table_map_store(table);
+	return msync(table->map->base, table->map->size, MS_SYNC) == 0;
+}
+
+int table_map_grow(table_t *table, size_t cap) {
+	if (table == NULL || table->map == NULL) return 0;
+	struct table_map *map = table->map;
+	if (cap <= table->cap) return 1;
+	if (cap > MAX_CAP) return 0;
+	if (ftruncate(map->fd, (off_t) FILE_SIZE(cap)) != 0) return 0;
+	table_map_store(table);
+	if (!remap(map, FILE_SIZE(cap))) {
+		// old mapping is gone, try to get back to a usable state
+		if (!remap(map, FILE_SIZE(table->cap))) {
+			// the rows are gone, so are the positions indexes and statistics hold
+			table->rows = NULL;
+			table->len = 0;
+			table->ids_ascending = 1;
+			table->version++;
+			table_views_rebuild(table);
+			table_trgm_rebuild(table);
+			table_aggs_rebuild(table);
+			table_stats_free(table);
+		}
+		else {
+			table->rows = (dbrow_t *) (HEADER(map) + 1);
+		}
+		return 0;
+	}
+	HEADER(map)->cap = cap;
+	table->rows = (dbrow_t *) (HEADER(map) + 1);
+	table->cap = cap;
+	return 1;
+}
+
+void table_map_close(table_t *table) {
+	if (table == NULL || table->map == NULL) return;
+	struct table_map *map = table->map;
+	if (map->base != NULL) {
+		table_map_sync(table);
+		munmap(map->base, map->size);
+	}
+	close(map->fd);
+	free(map);
+	table->map = NULL;
+	table->rows = NULL;
+}
+
+#endif
@@ -0,0 +1,323 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "table_mvcc.h"
+#include "thread.h"
+
+typedef struct {
+	size_t refs; // directories referencing this chunk
+	dbrow_t rows[TABLE_CHUNK_ROWS];
+} chunk_t;
+
+typedef struct {
+	size_t refs; // versions referencing this directory
+	size_t cap;
+	size_t used; // slots [0, used) hold chunks
+	chunk_t *slots[];
+} chunk_dir_t;
+
+struct table_snap {
+	size_t refs; // readers, +1 while it is the current version
+	size_t len;
+	size_t next_id;
+	int ids_ascending; // see table_t
+	chunk_dir_t *dir;
+};
+
+struct table_mvcc {
+	mutex_t lock; // guards all refcounts and `current`
+	table_snap_t *current;
+};
+
+#define CHUNKS_FOR(len) (((len) + TABLE_CHUNK_ROWS - 1) / TABLE_CHUNK_ROWS)
+
+static chunk_dir_t *dir_new(size_t cap) {
+	chunk_dir_t *dir = malloc(sizeof(chunk_dir_t) + cap * sizeof(chunk_t *));
+	if (dir == NULL) return NULL;
+	dir->refs = 0;
+	dir->cap = cap;
+	dir->used = 0;
+	return dir;
+}
+
+// lock held
+static void chunk_unref(chunk_t *chunk) {
+	if (--chunk->refs == 0) free(chunk);
+}
+
+// lock held
+static void dir_unref(chunk_dir_t *dir) {
+	if (dir->refs > 0 && --dir->refs > 0) return;
+	for (size_t i = 0; i < dir->used; i++) chunk_unref(dir->slots[i]);
+	free(dir);
+}
+
+// lock held
+static void snap_unref(table_snap_t *snap) {
+	if (--snap->refs > 0) return;
+	dir_unref(snap->dir);
+	free(snap);
+}
+
+// lock held, dir should be new (unpublished) or have free slots past every published version
+static int dir_fill(chunk_dir_t *dir, size_t nchunks) {
+	for (; dir->used < nchunks; dir->used++) {
+		chunk_t *chunk = malloc(sizeof(chunk_t));
+		if (chunk == NULL) return 0;
+		chunk->refs = 1;
+		dir->slots[dir->used] = chunk;
+	}
+	return 1;
+}
+
+// lock held, shares first n chunks of src
+static chunk_dir_t *dir_copy(chunk_dir_t const *src, size_t n, size_t cap) {
+	chunk_dir_t *dir = dir_new(cap);
+	if (dir == NULL) return NULL;
+	for (size_t i = 0; i < n; i++) {
+		dir->slots[i] = src->slots[i];
+		dir->slots[i]->refs++;
+	}
+	dir->used = n;
+	return dir;
+}
+
+static table_snap_t *snap_new(size_t len, size_t next_id, int ids_ascending, chunk_dir_t *dir) {
+	table_snap_t *snap = malloc(sizeof(table_snap_t));
+	if (snap == NULL) return NULL;
+	snap->refs = 1;
+	snap->len = len;
+	snap->next_id = next_id;
+	snap->ids_ascending = ids_ascending || len == 0;
+	snap->dir = dir;
+	dir->refs++;
+	return snap;
+}
+
+static void publish(table_mvcc_t *mvcc, table_snap_t *snap) {
+	mutex_lock(&mvcc->lock);
+	table_snap_t *old = mvcc->current;
+	mvcc->current = snap;
+	snap_unref(old);
+	mutex_unlock(&mvcc->lock);
+}
+
+table_mvcc_t *table_mvcc_new(table_t const *table) {
+	table_mvcc_t *mvcc = malloc(sizeof(table_mvcc_t));
+	if (mvcc == NULL) goto no_mvcc;
+	if (!mutex_init(&mvcc->lock)) goto no_lock;
+	chunk_dir_t *dir = dir_new(16);
+	if (dir == NULL) goto no_dir;
+	mvcc->current = snap_new(0, 1, 1, dir);
+	if (mvcc->current == NULL) goto no_snap;
+	if (table != NULL && table->rows != NULL && table->len > 0) {
+		if (!table_mvcc_append(mvcc, table->rows, table->len)) goto no_rows;
+	}
+	if (table != NULL && !table_mvcc_set_next_id(mvcc, table->next_id)) goto no_rows;
+	return mvcc;
+no_rows:
+	table_mvcc_free(mvcc);
+	return NULL;
+no_snap:
+	free(dir);
+no_dir:
+	mutex_destroy(&mvcc->lock);
+no_lock:
+	free(mvcc);
+no_mvcc:
+	return NULL;
+}
+
+void table_mvcc_free(table_mvcc_t *mvcc) {
+	if (mvcc == NULL) return;
+	mutex_lock(&mvcc->lock);
+	snap_unref(mvcc->current);
+	mutex_unlock(&mvcc->lock);
+	mutex_destroy(&mvcc->lock);
+	free(mvcc);
+}
+
+int table_mvcc_append(table_mvcc_t *mvcc, dbrow_t const *rows, size_t n) {
+	if (mvcc == NULL || (rows == NULL && n > 0)) return 0;
+	if (n == 0) return 1;
+	// only the writer replaces `current`, so it can be read without the lock here
+	table_snap_t const *cur = mvcc->current;
+	size_t len = cur->len, new_len = len + n;
+	size_t nchunks = CHUNKS_FOR(new_len);
+	if (new_len < len) return 0;
+	mutex_lock(&mvcc->lock);
+	chunk_dir_t *dir = cur->dir;
+	if (nchunks > dir->cap) {
+		size_t cap = dir->cap * 2 > nchunks ? dir->cap * 2 : nchunks;
+		dir = dir_copy(cur->dir, cur->dir->used, cap);
+	}
+	int ok = dir != NULL && dir_fill(dir, nchunks);
+	if (!ok && dir != NULL && dir != cur->dir) dir_unref(dir);
+	mutex_unlock(&mvcc->lock);
+	if (!ok) return 0;
+	// slots past `len` are invisible to every published version
+	size_t next_id = cur->next_id;
+	for (size_t i = 0; i < n;) {
+		size_t pos = len + i;
+		size_t off = pos % TABLE_CHUNK_ROWS;
+		size_t cnt = TABLE_CHUNK_ROWS - off < n - i ? TABLE_CHUNK_ROWS - off : n - i;
+		memcpy(&dir->slots[pos / TABLE_CHUNK_ROWS]->rows[off], rows + i, cnt * sizeof(dbrow_t));
+		i += cnt;
+	}
+	for (size_t i = 0; i < n; i++) {
+		if (rows[i].id >= next_id) next_id = rows[i].id + 1;
+	}
+	int ids_ascending = cur->ids_ascending
+		&& table_ids_ascend(len > 0 ? table_snap_row(cur, len - 1) : NULL, rows, n);
+	mutex_lock(&mvcc->lock);
+	table_snap_t *snap = snap_new(new_len, next_id, ids_ascending, dir);
+	if (snap == NULL && dir != cur->dir) dir_unref(dir);
+	mutex_unlock(&mvcc->lock);
+	if (snap == NULL) return 0;
+	publish(mvcc, snap);
+	return 1;
+}
+
+int table_mvcc_remove_at(table_mvcc_t *mvcc, size_t pos) {
+	if (mvcc == NULL) return 0;
+	table_snap_t const *cur = mvcc->current;
+	if (pos >= cur->len) return 0;
+	size_t first = pos / TABLE_CHUNK_ROWS;
+	size_t new_len = cur->len - 1;
+	// chunks before `first` stay shared, the rest is copied with the row cut out
+	mutex_lock(&mvcc->lock);
+	chunk_dir_t *dir = dir_copy(cur->dir, first, cur->dir->cap);
+	int ok = dir != NULL && dir_fill(dir, CHUNKS_FOR(new_len));
+	if (!ok && dir != NULL) dir_unref(dir);
+	mutex_unlock(&mvcc->lock);
+	if (!ok) return 0;
+	for (size_t i = first * TABLE_CHUNK_ROWS; i < new_len; i++) {
+		size_t from = i < pos ? i : i + 1;
+		dir->slots[i / TABLE_CHUNK_ROWS]->rows[i % TABLE_CHUNK_ROWS] =
+			cur->dir->slots[from / TABLE_CHUNK_ROWS]->rows[from % TABLE_CHUNK_ROWS];
+	}
+	mutex_lock(&mvcc->lock);
+	table_snap_t *snap = snap_new(new_len, cur->next_id, cur->ids_ascending, dir);
+	if (snap == NULL) dir_unref(dir);
+	mutex_unlock(&mvcc->lock);
+	if (snap == NULL) return 0;
+	publish(mvcc, snap);
+	return 1;
+}
+
+int table_mvcc_set_next_id(table_mvcc_t *mvcc, size_t next_id) {
+	if (mvcc == NULL) return 0;
+	table_snap_t const *cur = mvcc->current;
+	mutex_lock(&mvcc->lock);
+	table_snap_t *snap = snap_new(cur->len, next_id, cur->ids_ascending, cur->dir);
+	mutex_unlock(&mvcc->lock);
+	if (snap == NULL) return 0;
+	publish(mvcc, snap);
+	return 1;
+}
+
+int table_mvcc_replace(table_mvcc_t *mvcc, dbrow_t const *rows, size_t n, size_t next_id) {
+	if (mvcc == NULL || (rows == NULL && n > 0)) return 0;
+	size_t nchunks = CHUNKS_FOR(n);
+	mutex_lock(&mvcc->lock);
+	chunk_dir_t *dir = dir_new(nchunks > 16 ? nchunks : 16);
+	int ok = dir != NULL && dir_fill(dir, nchunks);
+	if (!ok && dir != NULL) dir_unref(dir);
+	mutex_unlock(&mvcc->lock);
+	if (!ok) return 0;
+	for (size_t c = 0; c < nchunks; c++) {
+		size_t cnt = n - c * TABLE_CHUNK_ROWS < TABLE_CHUNK_ROWS ? n - c * TABLE_CHUNK_ROWS : TABLE_CHUNK_ROWS;
+		memcpy(dir->slots[c]->rows, rows + c * TABLE_CHUNK_ROWS, cnt * sizeof(dbrow_t));
+	}
+	mutex_lock(&mvcc->lock);
+	table_snap_t *snap = snap_new(n, next_id, table_ids_ascend(NULL, rows, n), dir);
+	if (snap == NULL) dir_unref(dir);
+	mutex_unlock(&mvcc->lock);
+	if (snap == NULL) return 0;
+	publish(mvcc, snap);
+	return 1;
+}
+
+table_snap_t const *table_snap_acquire(table_mvcc_t *mvcc) {
+	mutex_lock(&mvcc->lock);
+	table_snap_t *snap = mvcc->current;
+	snap->refs++;
+	mutex_unlock(&mvcc->lock);
+	return snap;
+}
+
+void table_snap_release(table_mvcc_t *mvcc, table_snap_t const *snap) {
+	if (snap == NULL) return;
+	mutex_lock(&mvcc->lock);
+	snap_unref((table_snap_t *) snap);
+	mutex_unlock(&mvcc->lock);
+}
+
+size_t table_snap_len(table_snap_t const *snap) {
+	return snap->len;
+}
+
+size_t table_snap_next_id(table_snap_t const *snap) {
+	return snap->next_id;
+}
+
+dbrow_t const *table_snap_row(table_snap_t const *snap, size_t pos) {
+	return &snap->dir->slots[pos / TABLE_CHUNK_ROWS]->rows[pos % TABLE_CHUNK_ROWS];
+}
+
+int table_snap_find_first(table_snap_t const *snap, table_find_t findspec, size_t *out_idx) {
+	if (snap == NULL || out_idx == NULL || findspec.start_pos >= snap->len) return 0;
+	// every chunk is searched as a small table of its own
+	for (size_t c = findspec.start_pos / TABLE_CHUNK_ROWS; c < CHUNKS_FOR(snap->len); c++) {
+		size_t base = c * TABLE_CHUNK_ROWS;
+		size_t len = snap->len - base < TABLE_CHUNK_ROWS ? snap->len - base : TABLE_CHUNK_ROWS;
+		table_t view = {.rows = snap->dir->slots[c]->rows, .len = len, .cap = len,
+			.ids_ascending = snap->ids_ascending};
+		table_find_t spec = findspec;
+		spec.start_pos = findspec.start_pos > base ? findspec.start_pos - base : 0;
+		size_t idx;
+		if (table_find_first(&view, spec, &idx)) {
+			*out_idx = base + idx;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+size_t table_snap_find_all(table_snap_t const *snap, table_find_t findspec, size_t *out_idx,
+	size_t cap, size_t *out_next) {
+	if (snap == NULL || out_idx == NULL) return 0;
+	size_t n = 0, idx;
+	while (n < cap && table_snap_find_first(snap, findspec, &idx)) {
+		out_idx[n++] = idx;
+		findspec.start_pos = idx + 1;
+	}
+	if (out_next != NULL) *out_next = n == cap ? findspec.start_pos : snap->len;
+	return n;
+}
+
+int table_snap_sort(table_snap_t const *snap, table_sort_t sortspec, dbrow_t **out_result) {
+	if (snap == NULL || snap->len == 0 || out_result == NULL) return 0;
+	dbrow_t *rows = malloc(sizeof(dbrow_t) * snap->len);
+	if (rows == NULL) return 0;
+	table_snap_rows(snap, 0, rows, snap->len);
+	if (!table_sort_rows(rows, snap->len, sortspec)) {
+		free(rows);
+		return 0;
+	}
+	*out_result = rows;
+	return 1;
+}
+
+size_t table_snap_rows(table_snap_t const *snap, size_t start, dbrow_t *out_rows, size_t cap) {
+	if (snap == NULL || out_rows == NULL || start >= snap->len) return 0;
+	size_t n = snap->len - start < cap ? snap->len - start : cap;
+	for (size_t i = 0; i < n;) {
+		size_t pos = start + i;
+		size_t off = pos % TABLE_CHUNK_ROWS;
+		size_t cnt = TABLE_CHUNK_ROWS - off < n - i ? TABLE_CHUNK_ROWS - off : n - i;
+		memcpy(out_rows + i, &snap->dir->slots[pos / TABLE_CHUNK_ROWS]->rows[off], cnt * sizeof(dbrow_t));
+		i += cnt;
+	}
+	return n;
+}
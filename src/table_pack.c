@@ -0,0 +1,396 @@
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+#include "table_pack.h"
+#include "hash.h"
+#include "thread.h"
+
+// sanity limit for a single block read from a file
+#define MAX_BLOCK_ROWS (1u << 20)
+
+typedef struct {
+	uint8_t *data;
+	size_t len, cap;
+	int ok;
+} wbuf_t;
+
+typedef struct {
+	uint8_t const *p, *end;
+	int ok;
+} rbuf_t;
+
+static uint64_t zigzag(int64_t v) {
+	return ((uint64_t) v << 1) ^ (v < 0 ? ~(uint64_t) 0 : 0);
+}
+
+static int64_t unzigzag(uint64_t v) {
+	return (int64_t) (v >> 1) ^ -(int64_t) (v & 1);
+}
+
+static int reserve(wbuf_t *w, size_t n) {
+	if (!w->ok) return 0;
+	if (w->cap - w->len >= n) return 1;
+	size_t cap = w->cap < 256 ? 256 : w->cap;
+	while (cap - w->len < n) {
+		if (cap * 2 < cap) return w->ok = 0;
+		cap *= 2;
+	}
+	uint8_t *data = realloc(w->data, cap);
+	if (data == NULL) return w->ok = 0;
+	w->data = data;
+	w->cap = cap;
+	return 1;
+}
+
+static void put_byte(wbuf_t *w, uint8_t b) {
+	if (reserve(w, 1)) w->data[w->len++] = b;
+}
+
+static void put_varint(wbuf_t *w, uint64_t v) {
+	if (!reserve(w, 10)) return;
+	while (v >= 0x80) {
+		w->data[w->len++] = (uint8_t) (v | 0x80);
+		v >>= 7;
+	}
+	w->data[w->len++] = (uint8_t) v;
+}
+
+static void put_double(wbuf_t *w, double d) {
+	uint64_t v;
+	memcpy(&v, &d, sizeof(v));
+	if (!reserve(w, 8)) return;
+	for (int i = 0; i < 8; i++) w->data[w->len++] = (uint8_t) (v >> (8 * i));
+}
+
+static uint8_t get_byte(rbuf_t *r) {
+	if (!r->ok || r->p >= r->end) return r->ok = 0;
+	return *r->p++;
+}
+
+static uint64_t get_varint(rbuf_t *r) {
+	uint64_t v = 0;
+	for (int shift = 0; shift < 64; shift += 7) {
+		uint8_t b = get_byte(r);
+		if (!r->ok) return 0;
+		v |= (uint64_t) (b & 0x7f) << shift;
+		if (!(b & 0x80)) return v;
+	}
+	return r->ok = 0;
+}
+
+static double get_double(rbuf_t *r) {
+	uint64_t v = 0;
+	for (int i = 0; i < 8; i++) v |= (uint64_t) get_byte(r) << (8 * i);
+	double d;
+	memcpy(&d, &v, sizeof(d));
+	return d;
+}
+
+#define FIELD(rows, i, offset) ((wchar_t const *) ((char const *) &(rows)[i] + (offset)))
+
+/*
+ * dictionary in first-appearance order, then entry index per row
+ * slots is scratch of nslots (power of 2, > n) entries, dict and idx of n entries
+ */
+static void put_strings(wbuf_t *w, dbrow_t const *rows, size_t n, size_t offset,
+	size_t *slots, size_t nslots, wchar_t const **dict, size_t *idx) {
+	size_t ndict = 0;
+	memset(slots, 0, nslots * sizeof(size_t));
+	for (size_t i = 0; i < n; i++) {
+		wchar_t const *s = FIELD(rows, i, offset);
+		size_t h = (size_t) hash_wcs(s, SIZE_MAX) & (nslots - 1);
+		// slot holds dictionary index + 1, 0 is empty
+		while (slots[h] != 0 && wcscmp(dict[slots[h] - 1], s) != 0) h = (h + 1) & (nslots - 1);
+		if (slots[h] == 0) {
+			dict[ndict++] = s;
+			slots[h] = ndict;
+		}
+		idx[i] = slots[h] - 1;
+	}
+	put_varint(w, ndict);
+	wchar_t const *prev = L"";
+	for (size_t d = 0; d < ndict; d++) {
+		wchar_t const *s = dict[d];
+		size_t shared = 0;
+		while (s[shared] && s[shared] == prev[shared]) shared++;
+		size_t rest = wcslen(s + shared);
+		put_varint(w, shared);
+		put_varint(w, rest);
+		for (size_t k = 0; k < rest; k++) put_varint(w, (uint32_t) s[shared + k]);
+		prev = s;
+	}
+	for (size_t i = 0; i < n; i++) put_varint(w, idx[i]);
+}
+
+/*
+ * dict is scratch of n * cap code units
+ */
+static void get_strings(rbuf_t *r, dbrow_t *rows, size_t n, size_t offset, size_t cap, wchar_t *dict) {
+	uint64_t ndict = get_varint(r);
+	if (!r->ok || ndict > n) {
+		r->ok = 0;
+		return;
+	}
+	size_t prev_len = 0;
+	for (size_t d = 0; d < ndict && r->ok; d++) {
+		wchar_t *s = dict + d * cap;
+		uint64_t shared = get_varint(r);
+		uint64_t rest = get_varint(r);
+		if (!r->ok || shared > prev_len || rest >= cap - shared) {
+			r->ok = 0;
+			return;
+		}
+		if (shared > 0) wmemcpy(s, s - cap, shared);
+		for (size_t k = 0; k < rest; k++) {
+			uint64_t c = get_varint(r);
+			if (c == 0 || c > WCHAR_MAX) r->ok = 0;
+			s[shared + k] = (wchar_t) c;
+		}
+		prev_len = shared + rest;
+		s[prev_len] = L'\0';
+	}
+	for (size_t i = 0; i < n && r->ok; i++) {
+		uint64_t d = get_varint(r);
+		if (d >= ndict) {
+			r->ok = 0;
+			return;
+		}
+		wchar_t *field = (wchar_t *) ((char *) &rows[i] + offset);
+		wchar_t const *s = dict + d * cap;
+		size_t len = wcslen(s);
+		wmemcpy(field, s, len);
+		wmemset(field + len, L'\0', cap - len);
+	}
+}
+
+static size_t slots_for(size_t n) {
+	size_t nslots = 16;
+	while (nslots <= n * 2) nslots *= 2;
+	return nslots;
+}
+
+/*
+ * data columns follow the ids in schema order, each stored whole by its kind:
+ * UINT varint, INT zig-zag varint, FLOAT 8 bytes, BOOL a bit per row, STR a dictionary (put_strings)
+ * the macros expect rows and n, and the string scratch of the block
+ */
+#define PUT_COLUMN(w, name, tag, kind, len, charset) PUT_##kind(w, name)
+#define PUT_UINT(w, name) for (size_t i = 0; i < n; i++) put_varint(w, rows[i].name);
+#define PUT_INT(w, name) for (size_t i = 0; i < n; i++) put_varint(w, zigzag(rows[i].name));
+#define PUT_FLOAT(w, name) for (size_t i = 0; i < n; i++) put_double(w, rows[i].name);
+#define PUT_BOOL(w, name) \
+	for (size_t i = 0; i < n; i += 8) { \
+		uint8_t bits = 0; \
+		for (size_t k = 0; k < 8 && i + k < n; k++) bits |= (uint8_t) (rows[i + k].name ? 1 : 0) << k; \
+		put_byte(w, bits); \
+	}
+#define PUT_STR(w, name) put_strings(w, rows, n, offsetof(dbrow_t, name), slots, nslots, dict, idx);
+
+#define GET_COLUMN(r, name, tag, kind, len, charset) GET_##kind(r, name, len)
+#define GET_UINT(r, name, len) for (size_t i = 0; i < n; i++) out_rows[i].name = (size_t) get_varint(r);
+#define GET_INT(r, name, len) for (size_t i = 0; i < n; i++) out_rows[i].name = unzigzag(get_varint(r));
+#define GET_FLOAT(r, name, len) for (size_t i = 0; i < n; i++) out_rows[i].name = get_double(r);
+#define GET_BOOL(r, name, len) \
+	for (size_t i = 0; i < n; i += 8) { \
+		uint8_t bits = get_byte(r); \
+		for (size_t k = 0; k < 8 && i + k < n; k++) out_rows[i + k].name = (bits >> k) & 1; \
+	}
+#define GET_STR(r, name, len) get_strings(r, out_rows, n, offsetof(dbrow_t, name), (len) + 1, dict);
+
+int table_pack_block(dbrow_t const *rows, size_t n, uint8_t **buf, size_t *len, size_t *cap) {
+	if (rows == NULL || n == 0 || buf == NULL || len == NULL || cap == NULL) return 0;
+	size_t nslots = slots_for(n);
+	size_t *slots = malloc(nslots * sizeof(size_t));
+	wchar_t const **dict = malloc(n * sizeof(wchar_t const *));
+	size_t *idx = malloc(n * sizeof(size_t));
+	wbuf_t w = {.data = *buf, .len = *len, .cap = *cap, .ok = 1};
+	if (slots == NULL || dict == NULL || idx == NULL) w.ok = 0;
+	if (w.ok) {
+		put_varint(&w, rows[0].id);
+		for (size_t i = 1; i < n; i++) put_varint(&w, zigzag((int64_t) (rows[i].id - rows[i - 1].id)));
+		TABLE_SCHEMA_DATA(PUT_COLUMN, &w)
+	}
+	free(idx);
+	free(dict);
+	free(slots);
+	// buffer may have moved even on failure
+	*buf = w.data;
+	*cap = w.cap;
+	if (!w.ok) return 0;
+	*len = w.len;
+	return 1;
+}
+
+int table_unpack_block(uint8_t const *payload, size_t size, size_t n, dbrow_t *out_rows) {
+	if (payload == NULL || n == 0 || out_rows == NULL) return 0;
+	wchar_t *dict = malloc(n * (TABLE_STR_MAXLEN + 1) * sizeof(wchar_t));
+	if (dict == NULL) return 0;
+	rbuf_t r = {.p = payload, .end = payload + size, .ok = 1};
+	out_rows[0].id = (size_t) get_varint(&r);
+	for (size_t i = 1; i < n; i++) out_rows[i].id = out_rows[i - 1].id + (size_t) unzigzag(get_varint(&r));
+	TABLE_SCHEMA_DATA(GET_COLUMN, &r)
+	free(dict);
+	return r.ok && r.p == r.end;
+}
+
+static int write_varint(FILE *fout, uint64_t v) {
+	uint8_t buf[10];
+	size_t n = 0;
+	while (v >= 0x80) {
+		buf[n++] = (uint8_t) (v | 0x80);
+		v >>= 7;
+	}
+	buf[n++] = (uint8_t) v;
+	return fwrite(buf, 1, n, fout) == n;
+}
+
+static int read_varint(FILE *fin, uint64_t *out) {
+	uint64_t v = 0;
+	for (int shift = 0; shift < 64; shift += 7) {
+		int c = getc(fin);
+		if (c == EOF) return 0;
+		v |= (uint64_t) (c & 0x7f) << shift;
+		if (!(c & 0x80)) {
+			*out = v;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int table_pack_header(FILE *fout, size_t len, size_t next_id) {
+	if (fout == NULL) return 0;
+	if (fwrite(TABLE_PACK_MAGIC, 1, sizeof(TABLE_PACK_MAGIC), fout) != sizeof(TABLE_PACK_MAGIC)) return 0;
+	return write_varint(fout, len) && write_varint(fout, next_id);
+}
+
+int table_pack_write(FILE *fout, dbrow_t const *rows, size_t n, uint8_t **buf, size_t *cap) {
+	size_t len = 0;
+	return fout != NULL && table_pack_block(rows, n, buf, &len, cap)
+		&& write_varint(fout, n) && write_varint(fout, len)
+		&& fwrite(*buf, 1, len, fout) == len;
+}
+
+int table_unpack_read(FILE *fin, dbrow_t *out_rows, size_t max_rows, uint8_t **buf, size_t *cap,
+	size_t *out_n) {
+	uint64_t n, size;
+	if (fin == NULL || out_rows == NULL || buf == NULL || cap == NULL || out_n == NULL) return 0;
+	if (!read_varint(fin, &n) || !read_varint(fin, &size)) return 0;
+	if (n == 0 || n > max_rows || size > n * (sizeof(dbrow_t) * 2)) return 0;
+	if (*cap < size) {
+		uint8_t *grown = realloc(*buf, size);
+		if (grown == NULL) return 0;
+		*buf = grown;
+		*cap = (size_t) size;
+	}
+	if (fread(*buf, 1, size, fin) != size) return 0;
+	if (!table_unpack_block(*buf, (size_t) size, (size_t) n, out_rows)) return 0;
+	*out_n = (size_t) n;
+	return 1;
+}
+
+int table_pack(FILE *fout, table_t const *table) {
+	if (fout == NULL || table == NULL || (table->rows == NULL && table->len > 0)) return 0;
+	if (!table_pack_header(fout, table->len, table->next_id)) return 0;
+	uint8_t *buf = NULL;
+	size_t cap = 0;
+	int ok = 1;
+	for (size_t i = 0; ok && i < table->len; i += TABLE_PACK_BLOCK_ROWS) {
+		size_t n = table->len - i < TABLE_PACK_BLOCK_ROWS ? table->len - i : TABLE_PACK_BLOCK_ROWS;
+		ok = table_pack_write(fout, table->rows + i, n, &buf, &cap);
+	}
+	free(buf);
+	return ok && fflush(fout) == 0;
+}
+
+typedef struct {
+	size_t rows; // row offset in the decoded table
+	size_t n;
+	size_t size;
+	uint8_t *payload;
+} block_t;
+
+typedef struct {
+	block_t const *blocks;
+	size_t nblocks;
+	size_t first, step;
+	dbrow_t *rows;
+	int ok;
+} unpack_job_t;
+
+static void unpack_worker(void *arg) {
+	unpack_job_t *job = arg;
+	for (size_t b = job->first; job->ok && b < job->nblocks; b += job->step) {
+		block_t const *blk = &job->blocks[b];
+		job->ok = table_unpack_block(blk->payload, blk->size, blk->n, job->rows + blk->rows);
+	}
+}
+
+int table_unpack(FILE *fin, table_t **out_table, size_t threads) {
+	if (fin == NULL || out_table == NULL) return 0;
+	char magic[sizeof(TABLE_PACK_MAGIC)];
+	uint64_t len, next_id;
+	if (fread(magic, 1, sizeof(magic), fin) != sizeof(magic)) goto bad_header;
+	if (memcmp(magic, TABLE_PACK_MAGIC, sizeof(magic)) != 0) goto bad_header;
+	if (!read_varint(fin, &len) || !read_varint(fin, &next_id)) goto bad_header;
+	if (len > SIZE_MAX / sizeof(dbrow_t)) goto bad_header;
+	// blocks are read sequentially, so their count is only known at the end
+	block_t *blocks = NULL;
+	size_t nblocks = 0, cap = 0, total = 0;
+	int ok = 1;
+	while (ok && total < len) {
+		uint64_t n, size;
+		ok = read_varint(fin, &n) && read_varint(fin, &size)
+			&& n > 0 && n <= MAX_BLOCK_ROWS && n <= len - total && size <= n * (sizeof(dbrow_t) * 2);
+		if (ok && nblocks == cap) {
+			cap = cap == 0 ? 16 : cap * 2;
+			block_t *grown = realloc(blocks, cap * sizeof(block_t));
+			if (grown == NULL) ok = 0;
+			else blocks = grown;
+		}
+		if (!ok) break;
+		block_t *blk = &blocks[nblocks];
+		blk->rows = total;
+		blk->n = (size_t) n;
+		blk->size = (size_t) size;
+		blk->payload = malloc(size > 0 ? size : 1);
+		if (blk->payload == NULL) break;
+		nblocks++;
+		ok = fread(blk->payload, 1, size, fin) == size;
+		total += n;
+	}
+	ok = ok && total == len;
+	dbrow_t *rows = ok && len > 0 ? malloc(len * sizeof(dbrow_t)) : NULL;
+	if (len > 0 && rows == NULL) ok = 0;
+	if (ok && nblocks > 0) {
+		if (threads == 0) threads = thread_count_hint();
+		if (threads > nblocks) threads = nblocks;
+		unpack_job_t *jobs = calloc(threads, sizeof(unpack_job_t));
+		if (jobs == NULL) ok = 0;
+		for (size_t t = 0; ok && t < threads; t++) jobs[t] = (unpack_job_t) {blocks, nblocks, t, threads, rows, 1};
+		if (ok) thread_run(unpack_worker, jobs, sizeof(unpack_job_t), threads);
+		for (size_t t = 0; ok && t < threads; t++) ok = jobs[t].ok;
+		free(jobs);
+	}
+	for (size_t b = 0; b < nblocks; b++) free(blocks[b].payload);
+	free(blocks);
+	// a pack sorted by another column (table_extsort_pack) is loaded in id order, duplicate ids are rejected
+	if (ok && !table_ids_ascend(NULL, rows, (size_t) len)) {
+		table_sort_t by_id = {.column = TC_ID, .direction = S_ASC};
+		ok = table_sort_rows(rows, (size_t) len, by_id) && table_ids_ascend(NULL, rows, (size_t) len);
+	}
+	table_t *table = ok ? table_new(len > 0 ? (size_t) len : 1) : NULL;
+	if (table == NULL) goto no_table;
+	if (!table_append_batch(table, rows, (size_t) len)) goto no_rows;
+	table->next_id = (size_t) next_id;
+	free(rows);
+	*out_table = table;
+	return 1;
+no_rows:
+	table_free(table);
+no_table:
+	free(rows);
+bad_header:
+	return 0;
+}
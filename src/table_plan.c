@@ -0,0 +1,299 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "table_plan.h"
+#include "table_trgm.h"
+#include "table_sketch.h"
+#include "collate.h"
+#include "hash.h"
+#include "thread.h"
+
+// selectivity guesses without statistics
+#define DEFAULT_EQ_SEL 0.005
+#define DEFAULT_INEQ_SEL (1.0 / 3.0)
+#define DEFAULT_RANGE_SEL 0.005
+#define DEFAULT_MATCH_SEL 0.005
+
+// costs in row visits
+#define TRGM_SEEK_COST 2.0 // per probe of a posting list
+#define THREAD_COST 32768.0 // starting one thread of a parallel scan
+// parallel scans give every thread at least this many rows
+#define PARALLEL_MIN_ROWS (1 << 18)
+#define PARALLEL_MAX_THREADS 64
+
+struct table_colstats {
+	table_stats_t stats;
+};
+
+static int cmp_double(void const *a0, void const *b0) {
+	double a = *(double const *) a0, b = *(double const *) b0;
+	return (a > b) - (a < b);
+}
+
+/*
+ * distinct count of n rows from a sorted sample of m values (Haas-Stokes Duj1, as in postgres)
+ * a sample without repeats is taken for a unique column
+ */
+#define ESTIMATE_DISTINCT(values, m, n, out) { \
+	size_t ds = 0, f1 = 0; \
+	for (size_t i = 0; i < (m);) { \
+		size_t j = i + 1; \
+		while (j < (m) && values[j] == values[i]) j++; \
+		ds++; \
+		if (j - i == 1) f1++; \
+		i = j; \
+	} \
+	if ((m) == (n)) { \
+		(out) = (double) ds; \
+	} \
+	else if (f1 == ds) { \
+		(out) = (double) (n); \
+	} \
+	else { \
+		double q = (double) (m) / (double) (n); \
+		(out) = (double) ds / (1.0 - (double) f1 * (1.0 - q) / (double) (m)); \
+		if ((out) > (double) (n)) (out) = (double) (n); \
+	} \
+}
+
+static void numeric_stats(double *values, size_t m, size_t n, table_column_stats_t *out) {
+	qsort(values, m, sizeof(double), cmp_double);
+	ESTIMATE_DISTINCT(values, m, n, out->distinct);
+	if (m == 0) return;
+	out->nbounds = TABLE_HIST_BUCKETS + 1;
+	for (size_t b = 0; b <= TABLE_HIST_BUCKETS; b++) {
+		out->bounds[b] = values[(m - 1) * b / TABLE_HIST_BUCKETS];
+	}
+}
+
+static void string_stats(uint64_t *hashes, size_t m, size_t n, table_column_stats_t *out) {
+	qsort(hashes, m, sizeof(uint64_t), hash_cmp_u64);
+	ESTIMATE_DISTINCT(hashes, m, n, out->distinct);
+}
+
+// one analyze_<name> per column: min/max over all rows, the rest from every step-th row
+#define ANALYZE_FN(a, name, tag, kind, len, charset) ANALYZE_FN_##kind(name, len)
+#define ANALYZE_FN_NUM(name) \
+	static void analyze_##name(dbrow_t const *rows, size_t n, size_t step, void *scratch, \
+		table_column_stats_t *out) { \
+		double *values = scratch; \
+		size_t m = 0; \
+		for (size_t i = 0; i < n; i++) { \
+			if (i == 0 || rows[i].name < out->min.name) out->min.name = rows[i].name; \
+			if (i == 0 || rows[i].name > out->max.name) out->max.name = rows[i].name; \
+		} \
+		for (size_t i = 0; i < n; i += step) values[m++] = (double) rows[i].name; \
+		numeric_stats(values, m, n, out); \
+	}
+#define ANALYZE_FN_UINT(name, len) ANALYZE_FN_NUM(name)
+#define ANALYZE_FN_INT(name, len) ANALYZE_FN_NUM(name)
+#define ANALYZE_FN_FLOAT(name, len) ANALYZE_FN_NUM(name)
+#define ANALYZE_FN_BOOL(name, len) ANALYZE_FN_NUM(name)
+#define ANALYZE_FN_STR(name, len) \
+	static void analyze_##name(dbrow_t const *rows, size_t n, size_t step, void *scratch, \
+		table_column_stats_t *out) { \
+		uint64_t *hashes = scratch; \
+		size_t m = 0, lo = 0, hi = 0; \
+		for (size_t i = 1; i < n; i++) { \
+			if (memcmp(rows[i].name##_key, rows[lo].name##_key, sizeof(rows[i].name##_key)) < 0) lo = i; \
+			if (memcmp(rows[i].name##_key, rows[hi].name##_key, sizeof(rows[i].name##_key)) > 0) hi = i; \
+		} \
+		if (n > 0) { \
+			wmemcpy(out->min.name, rows[lo].name, (len) + 1); \
+			wmemcpy(out->max.name, rows[hi].name, (len) + 1); \
+		} \
+		for (size_t i = 0; i < n; i += step) hashes[m++] = hash_wcs(rows[i].name, len); \
+		string_stats(hashes, m, n, out); \
+	}
+
+TABLE_SCHEMA(ANALYZE_FN, _)
+
+#define ANALYZE_CALL(a, name, tag, kind, len, charset) \
+	analyze_##name(rows, n, step, scratch, &stats->columns[tag]);
+
+int table_analyze(table_t *table) {
+	if (table == NULL) return 0;
+	dbrow_t const *rows = table->rows;
+	size_t n = TABLE_ROWS_LEN(table), step = 1;
+	if (n > TABLE_ANALYZE_SAMPLE) step = (n + TABLE_ANALYZE_SAMPLE - 1) / TABLE_ANALYZE_SAMPLE;
+	size_t m = n > 0 ? (n - 1) / step + 1 : 0;
+	struct table_colstats *colstats = calloc(1, sizeof(struct table_colstats));
+	if (colstats == NULL) goto no_stats;
+	void *scratch = malloc((m > 0 ? m : 1) * sizeof(uint64_t));
+	if (scratch == NULL) goto no_scratch;
+	table_stats_t *stats = &colstats->stats;
+	stats->version = table->version;
+	stats->rows = n;
+	stats->sampled = m;
+	TABLE_SCHEMA(ANALYZE_CALL, _)
+	free(scratch);
+	// a sketch of all rows beats an estimate from the sample
+	for (column_t c = 0; c < TABLE_NCOLUMNS && m < n; c++) {
+		table_distinct_t d;
+		if (table_sketch_column(c) && table_distinct(table, c, &d)) stats->columns[c].distinct = d.distinct;
+	}
+	table_stats_free(table);
+	table->colstats = colstats;
+	return 1;
+no_scratch:
+	free(colstats);
+no_stats:
+	return 0;
+}
+
+table_stats_t const *table_stats(table_t const *table) {
+	return table != NULL && table->colstats != NULL ? &table->colstats->stats : NULL;
+}
+
+void table_stats_free(table_t *table) {
+	if (table == NULL) return;
+	free(table->colstats);
+	table->colstats = NULL;
+}
+
+// fraction of values <= x, linear inside a bucket
+static double hist_le(table_column_stats_t const *cs, double x) {
+	double const *b = cs->bounds;
+	size_t last = cs->nbounds - 1;
+	if (x < b[0]) return 0;
+	if (x >= b[last]) return 1;
+	size_t i = 0;
+	while (i + 1 < last && b[i + 1] <= x) i++;
+	double within = b[i + 1] > b[i] ? (x - b[i]) / (b[i + 1] - b[i]) : 1;
+	return ((double) i + within) / (double) last;
+}
+
+static double clamp01(double x) {
+	return x < 0 ? 0 : x > 1 ? 1 : x;
+}
+
+// equal bounds mark a frequent value, the rest share the distinct count
+static double numeric_eq(table_column_stats_t const *cs, double v, double min, double max) {
+	if (v < min || v > max) return 0;
+	size_t same = 0;
+	for (size_t i = 0; i < cs->nbounds; i++) same += cs->bounds[i] == v;
+	double eq = cs->distinct >= 1 ? 1 / cs->distinct : 1;
+	if (same >= 2) {
+		double freq = (double) (same - 1) / (double) (cs->nbounds - 1);
+		if (freq > eq) eq = freq;
+	}
+	return eq;
+}
+
+static double numeric_sel(table_column_stats_t const *cs, condition_t condition, double v1, double v2,
+	double min, double max) {
+	if (cs->nbounds == 0) return 0; // empty table
+	double eq = numeric_eq(cs, v1, min, max);
+	switch (condition) {
+	default: return 0;
+	case C_EQ: return eq;
+	case C_NEQ: return 1 - eq;
+	case C_LT: return clamp01(hist_le(cs, v1) - eq);
+	case C_LE: return hist_le(cs, v1);
+	case C_GT: return clamp01(1 - hist_le(cs, v1));
+	case C_GE: return clamp01(1 - hist_le(cs, v1) + eq);
+	case C_BTW: return v2 < v1 ? 0 : clamp01(hist_le(cs, v2) - hist_le(cs, v1) + eq);
+	}
+}
+
+static double string_sel(table_column_stats_t const *cs, condition_t condition, wchar_t const *v1,
+	wchar_t const *min, wchar_t const *max, size_t maxlen, size_t rows) {
+	if (rows == 0) return 0;
+	double eq = cs->distinct >= 1 ? 1 / cs->distinct : 1;
+	if (collate_cmp(v1, min, maxlen) < 0 || collate_cmp(v1, max, maxlen) > 0) eq = 0;
+	switch (condition) {
+	default: return 0;
+	case C_EQ: return eq;
+	case C_NEQ: return 1 - eq;
+	case C_LT: return collate_cmp(v1, min, maxlen) <= 0 ? 0 : DEFAULT_INEQ_SEL;
+	case C_LE: return collate_cmp(v1, min, maxlen) < 0 ? 0 : DEFAULT_INEQ_SEL;
+	case C_GT: return collate_cmp(v1, max, maxlen) >= 0 ? 0 : DEFAULT_INEQ_SEL;
+	case C_GE: return collate_cmp(v1, max, maxlen) > 0 ? 0 : DEFAULT_INEQ_SEL;
+	case C_BTW: return DEFAULT_RANGE_SEL;
+	case C_CONTAINS:
+	case C_PREFIX: return v1[0] == L'\0' ? 1 : DEFAULT_MATCH_SEL;
+	}
+}
+
+static double default_sel(condition_t condition) {
+	switch (condition) {
+	default: return 0;
+	case C_EQ: return DEFAULT_EQ_SEL;
+	case C_NEQ: return 1 - DEFAULT_EQ_SEL;
+	case C_LT:
+	case C_LE:
+	case C_GT:
+	case C_GE: return DEFAULT_INEQ_SEL;
+	case C_BTW: return DEFAULT_RANGE_SEL;
+	case C_CONTAINS:
+	case C_PREFIX: return DEFAULT_MATCH_SEL;
+	}
+}
+
+#define SEL_CASE(a, name, tag, kind, len, charset) case tag: return SEL_##kind(name, tag, len);
+#define SEL_NUM(name, tag) numeric_sel(&stats->columns[tag], findspec->condition, \
+	(double) findspec->data1.name, (double) findspec->data2.name, \
+	(double) stats->columns[tag].min.name, (double) stats->columns[tag].max.name)
+#define SEL_UINT(name, tag, len) SEL_NUM(name, tag)
+#define SEL_INT(name, tag, len) SEL_NUM(name, tag)
+#define SEL_FLOAT(name, tag, len) SEL_NUM(name, tag)
+#define SEL_BOOL(name, tag, len) SEL_NUM(name, tag)
+#define SEL_STR(name, tag, len) string_sel(&stats->columns[tag], findspec->condition, \
+	findspec->data1.name, stats->columns[tag].min.name, stats->columns[tag].max.name, len, stats->rows)
+
+static double selectivity(table_stats_t const *stats, table_find_t const *findspec) {
+	switch (findspec->column) {
+	default: return 0;
+	TABLE_SCHEMA(SEL_CASE, _)
+	}
+}
+
+int table_plan(table_t const *table, table_find_t const *findspec, table_plan_t *out_plan) {
+	if (table == NULL || findspec == NULL || out_plan == NULL) return 0;
+	if (!table_find_valid(findspec)) return 0;
+	size_t len = TABLE_ROWS_LEN(table);
+	double left = findspec->start_pos < len ? (double) (len - findspec->start_pos) : 0;
+	table_stats_t const *stats = table_stats(table);
+	table_plan_t plan = {.path = TP_SCAN, .threads = 1, .analyzed = stats != NULL};
+	if (stats != NULL) plan.selectivity = selectivity(stats, findspec);
+	else if (findspec->column == TC_ID && findspec->condition == C_EQ) plan.selectivity = len > 0 ? 1.0 / (double) len : 0;
+	else plan.selectivity = default_sel(findspec->condition);
+	plan.rows = plan.selectivity * left;
+	// positions of matches are taken as uniform, the first one is about 1 / selectivity rows away
+	plan.scan_cost = plan.selectivity > 0 && 1 / plan.selectivity < left ? 1 / plan.selectivity : left;
+	plan.cost = plan.scan_cost;
+	double probe = log2(left + 1) + 1;
+	if (findspec->column == TC_ID && table->ids_ascending) {
+		// never worse than a scan: ranges open at start_pos take one probe
+		plan.path = TP_ID_SEARCH;
+		if (probe < plan.cost) plan.cost = probe;
+	}
+	else if (table_trgm_usable(table, findspec) && TRGM_SEEK_COST * probe < plan.cost) {
+		plan.path = TP_TRGM;
+		plan.cost = TRGM_SEEK_COST * probe;
+	}
+	if (plan.path == TP_SCAN && plan.scan_cost >= 2.0 * PARALLEL_MIN_ROWS) {
+		size_t threads = thread_count_hint();
+		if (threads > PARALLEL_MAX_THREADS) threads = PARALLEL_MAX_THREADS;
+		if (threads > (size_t) (plan.scan_cost / PARALLEL_MIN_ROWS)) threads = (size_t) (plan.scan_cost / PARALLEL_MIN_ROWS);
+		double cost = plan.scan_cost / (double) threads + THREAD_COST * (double) threads;
+		if (threads >= 2 && cost < plan.cost) {
+			plan.path = TP_PARALLEL;
+			plan.threads = threads;
+			plan.cost = cost;
+		}
+	}
+	*out_plan = plan;
+	return 1;
+}
+
+wchar_t const *table_path_name(table_path_t path) {
+	switch (path) {
+	default: return L"unknown";
+	case TP_SCAN: return L"scan";
+	case TP_ID_SEARCH: return L"id binary search";
+	case TP_TRGM: return L"trigram index";
+	case TP_PARALLEL: return L"parallel scan";
+	}
+}
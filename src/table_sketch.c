@@ -0,0 +1,138 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "table_sketch.h"
+#include "hash.h"
+
+#define REGISTERS ((size_t) 1 << TABLE_SKETCH_BITS)
+#define NSKETCHES 3
+// 95% two-sided
+#define Z 1.959963984540054
+
+static column_t const sketched[NSKETCHES] = {TC_C1, TC_C3, TC_C5};
+
+struct table_sketch {
+	uint64_t version; // table version the registers are up to date with
+	size_t len; // rows added
+	uint8_t registers[NSKETCHES][REGISTERS];
+};
+
+static int sketch_of(column_t column) {
+	for (int s = 0; s < NSKETCHES; s++) if (sketched[s] == column) return s;
+	return -1;
+}
+
+int table_sketch_column(column_t column) {
+	return sketch_of(column) >= 0;
+}
+
+static void add_hash(uint8_t *registers, uint64_t h) {
+	size_t idx = (size_t) (h >> (64 - TABLE_SKETCH_BITS));
+	uint64_t rest = h << TABLE_SKETCH_BITS;
+	// position of the first set bit of the remaining 64 - bits, 64 - bits + 1 if none
+	uint8_t rank = 1;
+	while (rank <= 64 - TABLE_SKETCH_BITS && !(rest & (1ull << 63))) {
+		rest <<= 1;
+		rank++;
+	}
+	if (registers[idx] < rank) registers[idx] = rank;
+}
+
+static void add_rows(struct table_sketch *sketch, dbrow_t const *rows, size_t n) {
+	for (size_t i = 0; i < n; i++) {
+		add_hash(sketch->registers[0], hash_u64((uint64_t) rows[i].c1));
+		add_hash(sketch->registers[1], hash_wcs(rows[i].c3, SIZE_MAX));
+		add_hash(sketch->registers[2], hash_wcs(rows[i].c5, SIZE_MAX));
+	}
+	sketch->len += n;
+}
+
+static int in_sync(table_t const *table) {
+	struct table_sketch const *sketch = table->sketch;
+	return sketch != NULL && sketch->version == table->version && sketch->len == TABLE_ROWS_LEN(table);
+}
+
+void table_sketch_insert(table_t *table, size_t from, uint64_t version) {
+	struct table_sketch *sketch = table->sketch;
+	// the registers can only grow, anything but appends to a sketch in sync waits for a rebuild
+	if (sketch == NULL || sketch->version != version || sketch->len != from) return;
+	add_rows(sketch, table->rows + from, table->len - from);
+	sketch->version = table->version;
+}
+
+void table_sketch_free(table_t *table) {
+	free(table->sketch);
+	table->sketch = NULL;
+}
+
+static int build(table_t *table) {
+	struct table_sketch *sketch = table->sketch;
+	if (sketch == NULL) sketch = malloc(sizeof(struct table_sketch));
+	if (sketch == NULL) return 0;
+	memset(sketch->registers, 0, sizeof(sketch->registers));
+	sketch->len = 0;
+	add_rows(sketch, table->rows, TABLE_ROWS_LEN(table));
+	sketch->version = table->version;
+	table->sketch = sketch;
+	return 1;
+}
+
+int table_distinct(table_t *table, column_t column, table_distinct_t *out_distinct) {
+	int s = sketch_of(column);
+	if (table == NULL || out_distinct == NULL || s < 0) return 0;
+	if (!in_sync(table) && !build(table)) return 0;
+	uint8_t const *registers = table->sketch->registers[s];
+	double m = (double) REGISTERS, sum = 0;
+	size_t zeros = 0;
+	for (size_t i = 0; i < REGISTERS; i++) {
+		sum += ldexp(1.0, -registers[i]);
+		zeros += registers[i] == 0;
+	}
+	double e = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+	// linear counting while many registers are empty
+	if (e <= 2.5 * m && zeros > 0) e = m * log(m / (double) zeros);
+	table_distinct_t d = {.distinct = e, .error = 1.04 / sqrt(m)};
+	*out_distinct = d;
+	return 1;
+}
+
+static uint64_t splitmix64(uint64_t *state) {
+	uint64_t z = (*state += 0x9E3779B97F4A7C15u);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9u;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBu;
+	return z ^ (z >> 31);
+}
+
+int table_estimate(table_t const *table, table_find_t const *findspec, size_t sample, uint64_t seed,
+	table_estimate_t *out_estimate) {
+	if (table == NULL || out_estimate == NULL || !table_find_valid(findspec)) return 0;
+	if (sample == 0) sample = TABLE_ESTIMATE_SAMPLE;
+	size_t len = TABLE_ROWS_LEN(table), matched = 0;
+	table_estimate_t est = {.rows = len};
+	if (len <= sample) {
+		for (size_t i = 0; i < len; i++) matched += table_row_matches(&table->rows[i], *findspec);
+		est.sampled = len;
+		est.matched = matched;
+		est.count = est.low = est.high = (double) matched;
+		est.exact = 1;
+		*out_estimate = est;
+		return 1;
+	}
+	// with replacement, so the interval needs no correction for sampled share of the table
+	uint64_t state = seed;
+	for (size_t i = 0; i < sample; i++) {
+		size_t pos = (size_t) (splitmix64(&state) % len);
+		matched += table_row_matches(&table->rows[pos], *findspec);
+	}
+	double k = (double) sample, p = (double) matched / k, n = (double) len;
+	double center = (p + Z * Z / (2 * k)) / (1 + Z * Z / k);
+	double half = Z * sqrt(p * (1 - p) / k + Z * Z / (4 * k * k)) / (1 + Z * Z / k);
+	est.sampled = sample;
+	est.matched = matched;
+	est.count = p * n;
+	est.low = center - half > 0 ? (center - half) * n : 0;
+	est.high = center + half < 1 ? (center + half) * n : n;
+	*out_estimate = est;
+	return 1;
+}
@@ -3,8 +3,7 @@
 #include <string.h>
 
 #include "table.h"
-
-typedef int (*cmp_func)(void const *, void const *);
+#include "stats.h"
 
 #define CMP(field, type, mul) static int \
 	cmp_##field##_##type(void const *a0, void const *b0) { \
@@ -13,24 +12,42 @@ typedef int (*cmp_func)(void const *, void const *);
 		int gt = a->field > b->field, lt = a->field < b->field; \
 		return (mul) * ( gt - lt ); \
 	}
-#define STR_CMP(field, type, mul, maxlen) static int cmp_##field##_##type(void const *a, void const *b) { \
-		wchar_t const *str1 = ( (dbrow_t const *)a )->field; \
-		wchar_t const *str2 = ( (dbrow_t const *)b )->field; \
-		return (mul) * wcsncmp(str1, str2, maxlen); \
+// collation keys decide, strings only break ties between characters of the same weight
+#define STR_CMP(field, key, type, mul, maxlen) static int cmp_##field##_##type(void const *a0, void const *b0) { \
+		dbrow_t const *a = (dbrow_t const *)a0; \
+		dbrow_t const *b = (dbrow_t const *)b0; \
+		int c = memcmp(a->key, b->key, sizeof(a->key)); \
+		if (c == 0) c = wcsncmp(a->field, b->field, maxlen); \
+		return (mul) * ((c > 0) - (c < 0)); \
 	}
 #define ASC(field) CMP(field, asc, +1)
 #define DESC(field) CMP(field, desc, -1)
-#define STR_ASC(field, maxlen) STR_CMP(field, asc, +1, maxlen)
-#define STR_DESC(field, maxlen) STR_CMP(field, desc, -1, maxlen)
+#define STR_ASC(field, key, maxlen) STR_CMP(field, key, asc, +1, maxlen)
+#define STR_DESC(field, key, maxlen) STR_CMP(field, key, desc, -1, maxlen)
 #define Q(field) ASC(field) DESC(field)
-#define STR_Q(field, maxlen) STR_ASC(field, maxlen) STR_DESC(field, maxlen)
+#define STR_Q(field, key, maxlen) STR_ASC(field, key, maxlen) STR_DESC(field, key, maxlen)
+
+#define SORT_Q(a, name, tag, kind, len, charset) SORT_Q_##kind(name, len)
+#define SORT_Q_UINT(name, len) Q(name)
+#define SORT_Q_INT(name, len) Q(name)
+#define SORT_Q_FLOAT(name, len) Q(name)
+#define SORT_Q_BOOL(name, len) Q(name)
+#define SORT_Q_STR(name, len) STR_Q(name, name##_key, (len) + 1)
+
+TABLE_SCHEMA(SORT_Q, _)
 
-Q(id)
-Q(c1)
-Q(c2)
-STR_Q(c3, 17)
-Q(c4)
-STR_Q(c5, 33)
+#define SORT_CASE(a, name, tag, kind, len, charset) \
+	case tag: cmp = desc ? cmp_##name##_desc : cmp_##name##_asc; break;
+
+table_cmp_t table_sort_cmp(table_sort_t sortspec) {
+	int desc = sortspec.direction == S_DESC;
+	table_cmp_t cmp = NULL;
+	switch (sortspec.column) {
+	default: return NULL;
+	TABLE_SCHEMA(SORT_CASE, _)
+	}
+	return cmp;
+}
 
 /*
  * returns 1 on success, 0 on failure
@@ -38,22 +55,31 @@ STR_Q(c5, 33)
  */
 int table_sort(table_t const *table, table_sort_t sortspec, dbrow_t **out_result) {
 	if (table == NULL || table->rows == NULL || table->len == 0 || out_result == NULL) return 0;
-	int desc = sortspec.direction == S_DESC;
-	cmp_func cmp = NULL;
-	switch (sortspec.column) {
-	default: return 0;
-	case TC_ID: cmp = desc ? cmp_id_desc : cmp_id_asc; break;
-	case TC_C1: cmp = desc ? cmp_c1_desc : cmp_c1_asc; break;
-	case TC_C2: cmp = desc ? cmp_c2_desc : cmp_c2_asc; break;
-	case TC_C3: cmp = desc ? cmp_c3_desc : cmp_c3_asc; break;
-	case TC_C4: cmp = desc ? cmp_c4_desc : cmp_c4_asc; break;
-	case TC_C5: cmp = desc ? cmp_c5_desc : cmp_c5_asc; break;
-	}
 	size_t len = table->len;
 	dbrow_t *rows = malloc(sizeof(dbrow_t) * len);
 	if (rows == NULL) return 0;
-	memcpy(rows, table->rows, sizeof(dbrow_t) * len);
-	qsort(rows, len, sizeof(dbrow_t), cmp);
+	if (table_sort_into(table, sortspec, rows, len) == 0) {
+		free(rows);
+		return 0;
+	}
 	*out_result = rows;
 	return 1;
 }
+
+int table_sort_into(table_t const *table, table_sort_t sortspec, dbrow_t *out_rows, size_t cap) {
+	if (table == NULL || table->rows == NULL || table->len == 0 || out_rows == NULL) return 0;
+	if (cap < table->len) return 0;
+	if (table_sort_cmp(sortspec) == NULL) return 0;
+	memcpy(out_rows, table->rows, sizeof(dbrow_t) * table->len);
+	return table_sort_rows(out_rows, table->len, sortspec);
+}
+
+int table_sort_rows(dbrow_t *rows, size_t n, table_sort_t sortspec) {
+	if (rows == NULL && n > 0) return 0;
+	table_cmp_t cmp = table_sort_cmp(sortspec);
+	if (cmp == NULL) return 0;
+	STATS_START(start);
+	qsort(rows, n, sizeof(dbrow_t), cmp);
+	STATS_END(ST_SORT, start, n, sizeof(dbrow_t) * n, sizeof(dbrow_t) * n);
+	return 1;
+}
@@ -0,0 +1,344 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "table_trgm.h"
+#include "hash.h"
+
+// boundary marks plus the longest string
+#define MAX_TRIGRAMS (2 + TABLE_STR_MAXLEN)
+#define CODE_BITS 21
+#define CODE_MASK ((1u << CODE_BITS) - 1)
+
+typedef struct {
+	uint64_t key; // 0 for a free slot
+	size_t *pos;
+	size_t len, cap;
+} posting_t;
+
+typedef struct {
+	column_t column;
+	posting_t *slots; // open addressing
+	size_t nslots, used;
+} trgm_index_t;
+
+// an index slot per column, only STR columns ever fill theirs
+struct table_trgm {
+	trgm_index_t *index[TABLE_NCOLUMNS];
+};
+
+#define STR_CASE(a, name, tag, kind, len, charset) STR_CASE_##kind(a, name, tag, len)
+#define STR_CASE_UINT(a, name, tag, len)
+#define STR_CASE_INT(a, name, tag, len)
+#define STR_CASE_FLOAT(a, name, tag, len)
+#define STR_CASE_BOOL(a, name, tag, len)
+#define STR_CASE_STR(a, name, tag, len) case tag: return (a)->name;
+
+#define CAP_CASE(a, name, tag, kind, len, charset) CAP_CASE_##kind(tag, len)
+#define CAP_CASE_UINT(tag, len)
+#define CAP_CASE_INT(tag, len)
+#define CAP_CASE_FLOAT(tag, len)
+#define CAP_CASE_BOOL(tag, len)
+#define CAP_CASE_STR(tag, len) case tag: return (len) + 1;
+
+// code units of a STR column including the terminator, 0 for other columns
+static size_t str_cap(column_t column) {
+	switch (column) {
+	default: return 0;
+	TABLE_SCHEMA(CAP_CASE, _)
+	}
+}
+
+static wchar_t const *row_str(dbrow_t const *row, column_t column) {
+	switch (column) {
+	default: return NULL;
+	TABLE_SCHEMA(STR_CASE, row)
+	}
+}
+
+static wchar_t const *needle_of(table_find_t const *findspec) {
+	switch (findspec->column) {
+	default: return NULL;
+	TABLE_SCHEMA(STR_CASE, &findspec->data1)
+	}
+}
+
+static trgm_index_t **index_slot(table_t const *table, column_t column) {
+	if (table->trgm == NULL || str_cap(column) == 0) return NULL;
+	return &table->trgm->index[column];
+}
+
+static trgm_index_t *index_of(table_t const *table, column_t column) {
+	trgm_index_t **slot = index_slot(table, column);
+	return slot != NULL ? *slot : NULL;
+}
+
+// 0 marks the boundary, code units are never 0 inside a string
+static uint64_t pack(uint32_t a, uint32_t b, uint32_t c) {
+	return ((uint64_t) (a & CODE_MASK) << (2 * CODE_BITS)) | ((uint64_t) (b & CODE_MASK) << CODE_BITS)
+		| (c & CODE_MASK);
+}
+
+/*
+ * distinct trigrams of s (at most cap code units long)
+ * padded adds the leading boundary trigrams
+ * returns number of trigrams written to out
+ */
+static size_t trigrams(wchar_t const *s, size_t cap, int padded, uint64_t out[MAX_TRIGRAMS]) {
+	uint32_t buf[2 + TABLE_STR_MAXLEN];
+	size_t len = 0, n = 0;
+	if (padded) {
+		buf[len++] = 0;
+		buf[len++] = 0;
+	}
+	for (size_t i = 0; i < cap && s[i] != L'\0'; i++) buf[len++] = (uint32_t) s[i];
+	for (size_t i = 0; i + 2 < len; i++) {
+		uint64_t key = pack(buf[i], buf[i + 1], buf[i + 2]);
+		size_t k = 0;
+		while (k < n && out[k] != key) k++;
+		if (k == n) out[n++] = key;
+	}
+	return n;
+}
+
+static posting_t *lookup(trgm_index_t const *index, uint64_t key) {
+	size_t mask = index->nslots - 1;
+	for (size_t h = (size_t) hash_u64(key) & mask;; h = (h + 1) & mask) {
+		posting_t *slot = &index->slots[h];
+		if (slot->key == key) return slot;
+		if (slot->key == 0) return NULL;
+	}
+}
+
+static int rehash(trgm_index_t *index, size_t nslots) {
+	posting_t *slots = calloc(nslots, sizeof(posting_t));
+	if (slots == NULL) return 0;
+	for (size_t i = 0; i < index->nslots; i++) {
+		posting_t const *old = &index->slots[i];
+		if (old->key == 0) continue;
+		size_t h = (size_t) hash_u64(old->key) & (nslots - 1);
+		while (slots[h].key != 0) h = (h + 1) & (nslots - 1);
+		slots[h] = *old;
+	}
+	free(index->slots);
+	index->slots = slots;
+	index->nslots = nslots;
+	return 1;
+}
+
+static posting_t *lookup_or_add(trgm_index_t *index, uint64_t key) {
+	posting_t *slot = lookup(index, key);
+	if (slot != NULL) return slot;
+	if ((index->used + 1) * 2 > index->nslots && !rehash(index, index->nslots * 2)) return NULL;
+	size_t h = (size_t) hash_u64(key) & (index->nslots - 1);
+	while (index->slots[h].key != 0) h = (h + 1) & (index->nslots - 1);
+	index->slots[h].key = key;
+	index->used++;
+	return &index->slots[h];
+}
+
+static int push(posting_t *list, size_t pos) {
+	if (list->len == list->cap) {
+		size_t cap = list->cap < 4 ? 4 : list->cap * 2;
+		size_t *grown = realloc(list->pos, cap * sizeof(size_t));
+		if (grown == NULL) return 0;
+		list->pos = grown;
+		list->cap = cap;
+	}
+	list->pos[list->len++] = pos;
+	return 1;
+}
+
+// first position in list[from, len) that is >= x, galloping
+static size_t seek(size_t const *list, size_t len, size_t from, size_t x) {
+	size_t lo = from, hi = from, step = 1;
+	while (hi < len && list[hi] < x) {
+		lo = hi + 1;
+		hi += step;
+		step *= 2;
+	}
+	if (hi > len) hi = len;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (list[mid] < x) lo = mid + 1;
+		else hi = mid;
+	}
+	return lo;
+}
+
+static int index_row(trgm_index_t *index, table_t const *table, size_t pos) {
+	uint64_t keys[MAX_TRIGRAMS];
+	size_t n = trigrams(row_str(&table->rows[pos], index->column), str_cap(index->column), 1, keys);
+	for (size_t k = 0; k < n; k++) {
+		posting_t *list = lookup_or_add(index, keys[k]);
+		if (list == NULL || !push(list, pos)) return 0;
+	}
+	return 1;
+}
+
+static void index_free(trgm_index_t *index) {
+	if (index == NULL) return;
+	for (size_t i = 0; i < index->nslots; i++) free(index->slots[i].pos);
+	free(index->slots);
+	free(index);
+}
+
+static int index_fill(trgm_index_t *index, table_t const *table) {
+	for (size_t i = 0; i < index->nslots; i++) {
+		free(index->slots[i].pos);
+		index->slots[i] = (posting_t) {0};
+	}
+	index->used = 0;
+	for (size_t i = 0; table->rows != NULL && i < table->len; i++) {
+		if (!index_row(index, table, i)) return 0;
+	}
+	return 1;
+}
+
+int table_trgm_add(table_t *table, column_t column) {
+	if (table == NULL || !table_trgm_column(column)) return 0;
+	if (table->trgm == NULL) {
+		table->trgm = calloc(1, sizeof(struct table_trgm));
+		if (table->trgm == NULL) return 0;
+	}
+	trgm_index_t **slot = index_slot(table, column);
+	if (*slot != NULL) return 1;
+	trgm_index_t *index = calloc(1, sizeof(trgm_index_t));
+	if (index == NULL) return 0;
+	index->column = column;
+	if (!rehash(index, 1024) || !index_fill(index, table)) {
+		index_free(index);
+		return 0;
+	}
+	*slot = index;
+	return 1;
+}
+
+int table_trgm_drop(table_t *table, column_t column) {
+	if (table == NULL) return 0;
+	trgm_index_t **slot = index_slot(table, column);
+	if (slot == NULL || *slot == NULL) return 0;
+	index_free(*slot);
+	*slot = NULL;
+	for (size_t c = 0; c < TABLE_NCOLUMNS; c++) {
+		if (table->trgm->index[c] != NULL) return 1;
+	}
+	free(table->trgm);
+	table->trgm = NULL;
+	return 1;
+}
+
+int table_trgm_column(column_t column) {
+	return str_cap(column) > 0;
+}
+
+int table_trgm_has(table_t const *table, column_t column) {
+	return table != NULL && index_of(table, column) != NULL;
+}
+
+int table_trgm_usable(table_t const *table, table_find_t const *findspec) {
+	if (table == NULL || findspec == NULL) return 0;
+	if (findspec->condition != C_CONTAINS && findspec->condition != C_PREFIX) return 0;
+	if (index_of(table, findspec->column) == NULL) return 0;
+	column_t column = findspec->column;
+	wchar_t const *needle = needle_of(findspec);
+	uint64_t keys[MAX_TRIGRAMS];
+	return trigrams(needle, str_cap(column), findspec->condition == C_PREFIX, keys) > 0;
+}
+
+int table_trgm_find(table_t const *table, table_find_t const *findspec, size_t *out_idx) {
+	if (table == NULL || findspec == NULL || out_idx == NULL) return -1;
+	if (findspec->condition != C_CONTAINS && findspec->condition != C_PREFIX) return -1;
+	trgm_index_t const *index = index_of(table, findspec->column);
+	if (index == NULL) return -1;
+	column_t column = findspec->column;
+	wchar_t const *needle = needle_of(findspec);
+	size_t cap = str_cap(column);
+	int prefix = findspec->condition == C_PREFIX;
+	uint64_t keys[MAX_TRIGRAMS];
+	size_t n = trigrams(needle, cap, prefix, keys);
+	if (n == 0) return -1;
+	size_t needle_len = 0;
+	while (needle_len < cap && needle[needle_len] != L'\0') needle_len++;
+	posting_t const *lists[MAX_TRIGRAMS];
+	size_t cur[MAX_TRIGRAMS] = {0};
+	for (size_t k = 0; k < n; k++) {
+		lists[k] = lookup(index, keys[k]);
+		if (lists[k] == NULL || lists[k]->len == 0) return 0;
+		// shortest list first, it drives the intersection
+		for (size_t j = k; j > 0 && lists[j]->len < lists[j - 1]->len; j--) {
+			posting_t const *tmp = lists[j];
+			lists[j] = lists[j - 1];
+			lists[j - 1] = tmp;
+		}
+	}
+	size_t x = findspec->start_pos;
+	while (x < table->len) {
+		int agree = 1;
+		for (size_t k = 0; k < n; k++) {
+			cur[k] = seek(lists[k]->pos, lists[k]->len, cur[k], x);
+			if (cur[k] == lists[k]->len) return 0;
+			if (lists[k]->pos[cur[k]] > x) {
+				x = lists[k]->pos[cur[k]];
+				agree = 0;
+				break;
+			}
+		}
+		if (!agree) continue;
+		// a candidate has all trigrams, but not necessarily in the needle's order
+		wchar_t const *s = row_str(&table->rows[x], column);
+		int match = prefix ? wcsncmp(s, needle, needle_len) == 0 : wcsstr(s, needle) != NULL;
+		if (match) {
+			*out_idx = x;
+			return 1;
+		}
+		x++;
+	}
+	return 0;
+}
+
+void table_trgm_insert(table_t *table, size_t pos) {
+	if (table->trgm == NULL) return;
+	for (size_t c = 0; c < TABLE_NCOLUMNS; c++) {
+		trgm_index_t *index = index_of(table, (column_t) c);
+		if (index != NULL && !index_row(index, table, pos)) table_trgm_drop(table, (column_t) c);
+	}
+}
+
+void table_trgm_remove(table_t *table, size_t pos) {
+	if (table->trgm == NULL) return;
+	for (size_t c = 0; c < TABLE_NCOLUMNS; c++) {
+		trgm_index_t *index = index_of(table, (column_t) c);
+		if (index == NULL) continue;
+		uint64_t keys[MAX_TRIGRAMS];
+		size_t n = trigrams(row_str(&table->rows[pos], index->column), str_cap(index->column), 1, keys);
+		for (size_t k = 0; k < n; k++) {
+			posting_t *list = lookup(index, keys[k]);
+			if (list == NULL) continue;
+			size_t at = seek(list->pos, list->len, 0, pos);
+			if (at < list->len && list->pos[at] == pos) {
+				memmove(list->pos + at, list->pos + at + 1, (list->len - at - 1) * sizeof(size_t));
+				list->len--;
+			}
+		}
+		// rows after pos move one position up
+		for (size_t i = 0; i < index->nslots; i++) {
+			posting_t *list = &index->slots[i];
+			for (size_t at = seek(list->pos, list->len, 0, pos); at < list->len; at++) list->pos[at]--;
+		}
+	}
+}
+
+void table_trgm_rebuild(table_t *table) {
+	if (table->trgm == NULL) return;
+	for (size_t c = 0; c < TABLE_NCOLUMNS; c++) {
+		trgm_index_t *index = index_of(table, (column_t) c);
+		if (index != NULL && !index_fill(index, table)) table_trgm_drop(table, (column_t) c);
+	}
+}
+
+void table_trgm_free(table_t *table) {
+	if (table == NULL || table->trgm == NULL) return;
+	for (size_t c = 0; c < TABLE_NCOLUMNS; c++) index_free(table->trgm->index[c]);
+	free(table->trgm);
+	table->trgm = NULL;
+}
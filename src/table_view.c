@@ -0,0 +1,275 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "table_view.h"
+
+#define NIL ((size_t) -1)
+#define MAX_VIEWS (2 * TABLE_NCOLUMNS)
+
+typedef struct {
+	dbrow_t row;
+	size_t left, right, parent;
+	uint32_t prio;
+} node_t;
+
+typedef struct {
+	table_sort_t spec;
+	table_cmp_t cmp;
+	node_t *nodes; // pool, freed nodes are chained through `right`
+	size_t cap, used, free_list;
+	size_t root;
+	size_t len;
+	uint32_t seed;
+} view_t;
+
+struct table_views {
+	size_t n;
+	view_t *list[MAX_VIEWS];
+};
+
+// field by field, padding does not take part
+// any total order over all fields will do, equal rows are the same row
+#define ROW_CMP_VALUE(x, y) ((x) != (y) ? ((x) < (y) ? -1 : 1) : 0)
+#define ROW_CMP_UINT(x, y) ROW_CMP_VALUE(x, y)
+#define ROW_CMP_INT(x, y) ROW_CMP_VALUE(x, y)
+#define ROW_CMP_FLOAT(x, y) memcmp(&(x), &(y), sizeof(x))
+#define ROW_CMP_BOOL(x, y) ROW_CMP_VALUE(x, y)
+#define ROW_CMP_STR(x, y) memcmp((x), (y), sizeof(x))
+#define ROW_CMP_FIELD(_, name, tag, kind, len, charset) \
+	if ((c = ROW_CMP_##kind(a->name, b->name)) != 0) return c;
+
+static int row_cmp(view_t const *view, dbrow_t const *a, dbrow_t const *b) {
+	int c = view->cmp(a, b);
+	if (c != 0) return c;
+	TABLE_SCHEMA(ROW_CMP_FIELD, _)
+	return 0;
+}
+
+// xorshift32
+static uint32_t next_prio(view_t *view) {
+	uint32_t x = view->seed;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return view->seed = x;
+}
+
+static int view_reserve(view_t *view, size_t n) {
+	size_t need = view->len + n;
+	if (need < view->len) return 0;
+	if (need <= view->cap) return 1;
+	size_t cap = view->cap * 2 > need ? view->cap * 2 : need;
+	if (cap < 16) cap = 16;
+	node_t *nodes = realloc(view->nodes, cap * sizeof(node_t));
+	if (nodes == NULL) return 0;
+	view->nodes = nodes;
+	view->cap = cap;
+	return 1;
+}
+
+// moves x above its parent
+static void rotate_up(view_t *view, size_t x) {
+	node_t *nodes = view->nodes;
+	size_t p = nodes[x].parent, g = nodes[p].parent;
+	if (nodes[p].left == x) {
+		nodes[p].left = nodes[x].right;
+		if (nodes[x].right != NIL) nodes[nodes[x].right].parent = p;
+		nodes[x].right = p;
+	}
+	else {
+		nodes[p].right = nodes[x].left;
+		if (nodes[x].left != NIL) nodes[nodes[x].left].parent = p;
+		nodes[x].left = p;
+	}
+	nodes[p].parent = x;
+	nodes[x].parent = g;
+	if (g == NIL) view->root = x;
+	else if (nodes[g].left == p) nodes[g].left = x;
+	else nodes[g].right = x;
+}
+
+// capacity should be reserved
+static void view_insert(view_t *view, dbrow_t const *row) {
+	node_t *nodes = view->nodes;
+	size_t x;
+	if (view->free_list != NIL) {
+		x = view->free_list;
+		view->free_list = nodes[x].right;
+	}
+	else {
+		x = view->used++;
+	}
+	memcpy(&nodes[x].row, row, sizeof(dbrow_t));
+	nodes[x].left = nodes[x].right = nodes[x].parent = NIL;
+	nodes[x].prio = next_prio(view);
+	size_t *link = &view->root, parent = NIL;
+	while (*link != NIL) {
+		parent = *link;
+		link = row_cmp(view, row, &nodes[parent].row) < 0 ? &nodes[parent].left : &nodes[parent].right;
+	}
+	*link = x;
+	nodes[x].parent = parent;
+	while (nodes[x].parent != NIL && nodes[x].prio > nodes[nodes[x].parent].prio) rotate_up(view, x);
+	view->len++;
+}
+
+static void view_remove(view_t *view, dbrow_t const *row) {
+	node_t *nodes = view->nodes;
+	size_t x = view->root;
+	while (x != NIL) {
+		int c = row_cmp(view, row, &nodes[x].row);
+		if (c == 0) break;
+		x = c < 0 ? nodes[x].left : nodes[x].right;
+	}
+	if (x == NIL) return;
+	// sink to a leaf, keeping heap order of priorities
+	while (nodes[x].left != NIL || nodes[x].right != NIL) {
+		size_t l = nodes[x].left, r = nodes[x].right;
+		size_t child = l == NIL ? r : r == NIL ? l : nodes[l].prio > nodes[r].prio ? l : r;
+		rotate_up(view, child);
+	}
+	size_t p = nodes[x].parent;
+	if (p == NIL) view->root = NIL;
+	else if (nodes[p].left == x) nodes[p].left = NIL;
+	else nodes[p].right = NIL;
+	nodes[x].right = view->free_list;
+	view->free_list = x;
+	view->len--;
+}
+
+static void view_clear(view_t *view) {
+	view->used = 0;
+	view->free_list = NIL;
+	view->root = NIL;
+	view->len = 0;
+}
+
+static int view_fill(view_t *view, table_t const *table) {
+	view_clear(view);
+	if (table->rows == NULL || table->len == 0) return 1;
+	if (!view_reserve(view, table->len)) return 0;
+	for (size_t i = 0; i < table->len; i++) view_insert(view, &table->rows[i]);
+	return 1;
+}
+
+static void view_free(view_t *view) {
+	free(view->nodes);
+	free(view);
+}
+
+static view_t *find_view(table_t const *table, table_sort_t sortspec, size_t *out_pos) {
+	if (table->views == NULL) return NULL;
+	for (size_t i = 0; i < table->views->n; i++) {
+		view_t *view = table->views->list[i];
+		if (view->spec.column == sortspec.column && view->spec.direction == sortspec.direction) {
+			if (out_pos != NULL) *out_pos = i;
+			return view;
+		}
+	}
+	return NULL;
+}
+
+int table_view_add(table_t *table, table_sort_t sortspec) {
+	if (table == NULL) return 0;
+	table_cmp_t cmp = table_sort_cmp(sortspec);
+	if (cmp == NULL) return 0;
+	if (find_view(table, sortspec, NULL) != NULL) return 1;
+	if (table->views == NULL) {
+		table->views = calloc(1, sizeof(struct table_views));
+		if (table->views == NULL) return 0;
+	}
+	if (table->views->n == MAX_VIEWS) return 0;
+	view_t *view = calloc(1, sizeof(view_t));
+	if (view == NULL) return 0;
+	view->spec = sortspec;
+	view->cmp = cmp;
+	view->seed = 2463534242u;
+	if (!view_fill(view, table)) {
+		view_free(view);
+		return 0;
+	}
+	table->views->list[table->views->n++] = view;
+	return 1;
+}
+
+int table_view_drop(table_t *table, table_sort_t sortspec) {
+	size_t pos;
+	if (table == NULL) return 0;
+	view_t *view = find_view(table, sortspec, &pos);
+	if (view == NULL) return 0;
+	view_free(view);
+	table->views->list[pos] = table->views->list[--table->views->n];
+	return 1;
+}
+
+size_t table_view_list(table_t const *table, table_sort_t *out_specs, size_t cap) {
+	if (table == NULL || table->views == NULL) return 0;
+	for (size_t i = 0; out_specs != NULL && i < table->views->n && i < cap; i++) {
+		out_specs[i] = table->views->list[i]->spec;
+	}
+	return table->views->n;
+}
+
+int table_view_begin(table_t const *table, table_sort_t sortspec, table_view_iter_t *out_iter) {
+	if (table == NULL || out_iter == NULL) return 0;
+	view_t const *view = find_view(table, sortspec, NULL);
+	if (view == NULL) return 0;
+	size_t x = view->root;
+	while (x != NIL && view->nodes[x].left != NIL) x = view->nodes[x].left;
+	out_iter->view = view;
+	out_iter->node = x;
+	return 1;
+}
+
+dbrow_t const *table_view_next(table_view_iter_t *iter) {
+	if (iter == NULL || iter->node == NIL) return NULL;
+	node_t const *nodes = ((view_t const *) iter->view)->nodes;
+	size_t x = iter->node;
+	dbrow_t const *row = &nodes[x].row;
+	if (nodes[x].right != NIL) {
+		x = nodes[x].right;
+		while (nodes[x].left != NIL) x = nodes[x].left;
+	}
+	else {
+		while (nodes[x].parent != NIL && nodes[nodes[x].parent].right == x) x = nodes[x].parent;
+		x = nodes[x].parent;
+	}
+	iter->node = x;
+	return row;
+}
+
+int table_views_reserve(table_t *table, size_t n) {
+	if (table->views == NULL) return 1;
+	for (size_t i = 0; i < table->views->n; i++) {
+		if (!view_reserve(table->views->list[i], n)) return 0;
+	}
+	return 1;
+}
+
+void table_views_insert(table_t *table, dbrow_t const *row) {
+	if (table->views == NULL) return;
+	for (size_t i = 0; i < table->views->n; i++) view_insert(table->views->list[i], row);
+}
+
+void table_views_remove(table_t *table, dbrow_t const *row) {
+	if (table->views == NULL) return;
+	for (size_t i = 0; i < table->views->n; i++) view_remove(table->views->list[i], row);
+}
+
+int table_views_rebuild(table_t *table) {
+	if (table->views == NULL) return 1;
+	for (size_t i = 0; i < table->views->n; i++) {
+		if (!view_fill(table->views->list[i], table)) {
+			table_views_free(table);
+			return 0;
+		}
+	}
+	return 1;
+}
+
+void table_views_free(table_t *table) {
+	if (table == NULL || table->views == NULL) return;
+	for (size_t i = 0; i < table->views->n; i++) view_free(table->views->list[i]);
+	free(table->views);
+	table->views = NULL;
+}
@@ -0,0 +1,115 @@
+#include <stdlib.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "thread.h"
+
+typedef struct {
+	thread_func func;
+	void *arg;
+} thread_start_t;
+
+#ifdef _WIN32
+static DWORD WINAPI thread_main(LPVOID p) {
+#else
+static void *thread_main(void *p) {
+#endif
+	thread_start_t start = *(thread_start_t *) p;
+	free(p);
+	start.func(start.arg);
+#ifdef _WIN32
+	return 0;
+#else
+	return NULL;
+#endif
+}
+
+int thread_create(thread_t *thread, thread_func func, void *arg) {
+	thread_start_t *start = malloc(sizeof(thread_start_t));
+	if (start == NULL) return 0;
+	start->func = func;
+	start->arg = arg;
+#ifdef _WIN32
+	*thread = CreateThread(NULL, 0, thread_main, start, 0, NULL);
+	if (*thread == NULL) goto no_thread;
+#else
+	if (pthread_create(thread, NULL, thread_main, start) != 0) goto no_thread;
+#endif
+	return 1;
+no_thread:
+	free(start);
+	return 0;
+}
+
+void thread_join(thread_t thread) {
+#ifdef _WIN32
+	WaitForSingleObject(thread, INFINITE);
+	CloseHandle(thread);
+#else
+	pthread_join(thread, NULL);
+#endif
+}
+
+size_t thread_count_hint(void) {
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors > 0 ? info.dwNumberOfProcessors : 1;
+#else
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? (size_t) n : 1;
+#endif
+}
+
+void thread_run(thread_func func, void *jobs, size_t size, size_t n) {
+	if (n == 0) return;
+	thread_t *tids = n > 1 ? malloc((n - 1) * sizeof(thread_t)) : NULL;
+	char *job = jobs;
+	size_t started = 0;
+	while (tids != NULL && started + 1 < n && thread_create(&tids[started], func, job + (started + 1) * size)) {
+		started++;
+	}
+	for (size_t i = started + 1; i < n; i++) func(job + i * size);
+	func(job);
+	for (size_t i = 0; i < started; i++) thread_join(tids[i]);
+	free(tids);
+}
+
+#ifdef _WIN32
+int mutex_init(mutex_t *mutex) { InitializeCriticalSection(mutex); return 1; }
+void mutex_destroy(mutex_t *mutex) { DeleteCriticalSection(mutex); }
+void mutex_lock(mutex_t *mutex) { EnterCriticalSection(mutex); }
+void mutex_unlock(mutex_t *mutex) { LeaveCriticalSection(mutex); }
+
+int rwlock_init(rwlock_t *lock) { InitializeSRWLock(lock); return 1; }
+void rwlock_destroy(rwlock_t *lock) { (void) lock; }
+void rwlock_rdlock(rwlock_t *lock) { AcquireSRWLockShared(lock); }
+void rwlock_rdunlock(rwlock_t *lock) { ReleaseSRWLockShared(lock); }
+void rwlock_wrlock(rwlock_t *lock) { AcquireSRWLockExclusive(lock); }
+void rwlock_wrunlock(rwlock_t *lock) { ReleaseSRWLockExclusive(lock); }
+
+int cond_init(cond_t *cond) { InitializeConditionVariable(cond); return 1; }
+void cond_destroy(cond_t *cond) { (void) cond; }
+void cond_wait(cond_t *cond, mutex_t *mutex) { SleepConditionVariableCS(cond, mutex, INFINITE); }
+void cond_signal(cond_t *cond) { WakeConditionVariable(cond); }
+void cond_broadcast(cond_t *cond) { WakeAllConditionVariable(cond); }
+#else
+int mutex_init(mutex_t *mutex) { return pthread_mutex_init(mutex, NULL) == 0; }
+void mutex_destroy(mutex_t *mutex) { pthread_mutex_destroy(mutex); }
+void mutex_lock(mutex_t *mutex) { pthread_mutex_lock(mutex); }
+void mutex_unlock(mutex_t *mutex) { pthread_mutex_unlock(mutex); }
+
+int rwlock_init(rwlock_t *lock) { return pthread_rwlock_init(lock, NULL) == 0; }
+void rwlock_destroy(rwlock_t *lock) { pthread_rwlock_destroy(lock); }
+void rwlock_rdlock(rwlock_t *lock) { pthread_rwlock_rdlock(lock); }
+void rwlock_rdunlock(rwlock_t *lock) { pthread_rwlock_unlock(lock); }
+void rwlock_wrlock(rwlock_t *lock) { pthread_rwlock_wrlock(lock); }
+void rwlock_wrunlock(rwlock_t *lock) { pthread_rwlock_unlock(lock); }
+
+int cond_init(cond_t *cond) { return pthread_cond_init(cond, NULL) == 0; }
+void cond_destroy(cond_t *cond) { pthread_cond_destroy(cond); }
+void cond_wait(cond_t *cond, mutex_t *mutex) { pthread_cond_wait(cond, mutex); }
+void cond_signal(cond_t *cond) { pthread_cond_signal(cond); }
+void cond_broadcast(cond_t *cond) { pthread_cond_broadcast(cond); }
+#endif
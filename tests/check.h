@@ -0,0 +1,50 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdio.h>
+
+#include "table.h"
+#include "gen.h"
+
+/*
+ * checks for the behavior tests in this directory
+ * a failed check prints its place and the test goes on, main returns CHECK_RESULT
+ */
+
+static int check_failures;
+
+#define CHECK(cond) { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		check_failures++; \
+	} \
+}
+
+// a test that cannot run on this platform, ctest reports it as skipped
+#define CHECK_SKIP 77
+
+#define CHECK_RESULT (check_failures == 0 ? 0 : 1)
+
+/*
+ * a table of n generated rows with ids first_id, first_id + id_step, ...
+ * gen is seeded with seed and left for more rows
+ * returns NULL (and fails a check) on failure
+ */
+static table_t *check_table(gen_t *gen, uint64_t seed, size_t n, size_t first_id, size_t id_step) {
+	table_t *table = table_new(n);
+	CHECK(table != NULL);
+	if (table == NULL) return NULL;
+	gen_init(gen, gen_default_params(), seed);
+	for (size_t i = 0; i < n; i++) {
+		dbrow_t row;
+		gen_row(gen, first_id + i * id_step, &row);
+		if (!table_append(table, row)) {
+			CHECK(!"table_append");
+			table_free(table);
+			return NULL;
+		}
+	}
+	return table;
+}
+
+#endif
@@ -0,0 +1,83 @@
+#include <stdlib.h>
+
+#include "check.h"
+#include "table.h"
+#include "table_agg.h"
+
+/*
+ * aggregate min/max while the rows holding the current minimum or maximum are removed,
+ * with appends buffered in between, against a recount of the rows
+ */
+
+#define ROWS 2000
+
+static void compare(table_t const *table, size_t id) {
+	table_agg_group_t groups[2];
+	size_t n = 0;
+	CHECK(table_agg_read(table, id, groups, 2, &n));
+	for (size_t g = 0; g < n && g < 2; g++) {
+		table_agg_group_t want = {.min_c1 = INT64_MAX, .max_c1 = INT64_MIN};
+		int first = 1;
+		for (size_t i = 0; i < table->len; i++) {
+			dbrow_t const *row = &table->rows[i];
+			if (row->c4 != groups[g].key.c4) continue;
+			want.count++;
+			want.sum_c1 += row->c1;
+			if (row->c1 < want.min_c1) want.min_c1 = row->c1;
+			if (row->c1 > want.max_c1) want.max_c1 = row->c1;
+			if (first || row->c2 < want.min_c2) want.min_c2 = row->c2;
+			if (first || row->c2 > want.max_c2) want.max_c2 = row->c2;
+			first = 0;
+		}
+		CHECK(groups[g].count == want.count);
+		CHECK(groups[g].sum_c1 == want.sum_c1);
+		CHECK(groups[g].min_c1 == want.min_c1 && groups[g].max_c1 == want.max_c1);
+		CHECK(groups[g].min_c2 == want.min_c2 && groups[g].max_c2 == want.max_c2);
+	}
+	// every non-empty group is read
+	size_t nonempty = 0;
+	for (int key = 0; key < 2; key++) {
+		for (size_t i = 0; i < table->len; i++) {
+			if (table->rows[i].c4 == key) {
+				nonempty++;
+				break;
+			}
+		}
+	}
+	CHECK(n == nonempty);
+}
+
+// position of the row with the least (or greatest) c1, c2 when by_c2
+static size_t extreme(table_t const *table, int by_c2, int greatest) {
+	size_t best = 0;
+	for (size_t i = 1; i < table->len; i++) {
+		dbrow_t const *a = &table->rows[i], *b = &table->rows[best];
+		int less = by_c2 ? a->c2 < b->c2 : a->c1 < b->c1;
+		int more = by_c2 ? a->c2 > b->c2 : a->c1 > b->c1;
+		if (greatest ? more : less) best = i;
+	}
+	return best;
+}
+
+int main(void) {
+	gen_t gen;
+	table_t *table = check_table(&gen, 3, ROWS, 1, 1);
+	if (table == NULL) return CHECK_RESULT;
+	size_t next = ROWS + 1;
+	size_t id;
+	CHECK(table_agg_add(table, (table_agg_spec_t) {.group = TC_C4}, &id));
+	compare(table, id);
+	for (size_t step = 0; table->len > 0; step++) {
+		CHECK(table_remove_at(table, extreme(table, step % 2, step % 4 >= 2)));
+		// a row appended since the last removal may be the next minimum
+		if (step % 3 == 0 && step < ROWS) {
+			dbrow_t row;
+			gen_row(&gen, next++, &row);
+			CHECK(table_append(table, row));
+		}
+		if (step % 7 == 0 || table->len < 20) compare(table, id);
+	}
+	compare(table, id);
+	table_free(table);
+	return CHECK_RESULT;
+}
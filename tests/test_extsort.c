@@ -0,0 +1,70 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "check.h"
+#include "table.h"
+#include "table_extsort.h"
+
+/*
+ * external sort at the minimum budget against table_sort
+ * enough rows for more runs than merge at once, so a pre-merge pass runs too
+ */
+
+#define ROWS 120000
+
+typedef struct {
+	dbrow_t *rows;
+	size_t len;
+	size_t cap;
+} collect_t;
+
+static int collect_sink(void *ctx, dbrow_t const *rows, size_t n) {
+	collect_t *c = ctx;
+	if (n > c->cap - c->len) return 0;
+	memcpy(c->rows + c->len, rows, n * sizeof(dbrow_t));
+	c->len += n;
+	return 1;
+}
+
+int main(void) {
+	gen_t gen;
+	table_t *table = check_table(&gen, 7, ROWS, 1, 1);
+	collect_t out = {malloc(ROWS * sizeof(dbrow_t)), 0, ROWS};
+	unsigned char *seen = malloc(ROWS + 1);
+	CHECK(out.rows != NULL && seen != NULL);
+	if (table == NULL || out.rows == NULL || seen == NULL) return CHECK_RESULT;
+	for (column_t column = 0; column < TABLE_NCOLUMNS; column++) {
+		for (sort_dir_t direction = S_ASC; direction <= S_DESC; direction++) {
+			table_sort_t sortspec = {.column = column, .direction = direction};
+			dbrow_t *sorted = NULL;
+			CHECK(table_sort(table, sortspec, &sorted));
+			out.len = 0;
+			CHECK(table_extsort(table, sortspec, TABLE_EXTSORT_MIN_BUDGET, NULL, collect_sink, &out));
+			CHECK(out.len == ROWS);
+			if (sorted == NULL || out.len != ROWS) {
+				free(sorted);
+				continue;
+			}
+			// ties may come in another order, every row comes out once
+			table_cmp_t cmp = table_sort_cmp(sortspec);
+			size_t misplaced = 0, lost = 0;
+			memset(seen, 0, ROWS + 1);
+			for (size_t i = 0; i < ROWS; i++) {
+				if (cmp(&out.rows[i], &sorted[i]) != 0) misplaced++;
+				if (out.rows[i].id == 0 || out.rows[i].id > ROWS || seen[out.rows[i].id]++) lost++;
+			}
+			CHECK(misplaced == 0);
+			CHECK(lost == 0);
+			if (column == TC_ID) {
+				size_t other = 0;
+				for (size_t i = 0; i < ROWS; i++) other += out.rows[i].id != sorted[i].id;
+				CHECK(other == 0);
+			}
+			free(sorted);
+		}
+	}
+	free(seen);
+	free(out.rows);
+	table_free(table);
+	return CHECK_RESULT;
+}
@@ -0,0 +1,56 @@
+#include <stdlib.h>
+
+#include "check.h"
+#include "table.h"
+
+/*
+ * searches on the id column against a plain scan with table_row_matches,
+ * while ids ascend (binary search) and after they stopped (scan)
+ */
+
+#define ROWS 5000
+
+static void compare(table_t const *table, size_t *got) {
+	condition_t const conditions[] = {C_EQ, C_NEQ, C_LT, C_GT, C_LE, C_GE, C_BTW};
+	size_t const probes[] = {0, 1, 2, ROWS / 3, ROWS, ROWS + 1, 3 * ROWS, 3 * ROWS + 7};
+	size_t nprobes = sizeof(probes) / sizeof(probes[0]);
+	for (size_t c = 0; c < sizeof(conditions) / sizeof(conditions[0]); c++) {
+		for (size_t p = 0; p < nprobes; p++) {
+			for (size_t start = 0; start < table->len; start += table->len / 3) {
+				table_find_t findspec = {.column = TC_ID, .condition = conditions[c], .start_pos = start,
+					.data1.id = probes[p], .data2.id = probes[(p + 3) % nprobes]};
+				size_t n = table_find_all(table, findspec, got, table->len, NULL), k = 0;
+				int same = 1;
+				for (size_t i = start; i < table->len; i++) {
+					if (!table_row_matches(&table->rows[i], findspec)) continue;
+					same = same && k < n && got[k] == i;
+					k++;
+				}
+				CHECK(same && k == n);
+				size_t first;
+				int found = table_find_first(table, findspec, &first);
+				CHECK(found == (n > 0) && (!found || first == got[0]));
+			}
+		}
+	}
+}
+
+int main(void) {
+	// ids with holes
+	gen_t gen;
+	table_t *table = check_table(&gen, 1, ROWS, 1, 3);
+	size_t *got = malloc((ROWS + 1) * sizeof(size_t));
+	CHECK(got != NULL);
+	if (table == NULL || got == NULL) return CHECK_RESULT;
+	CHECK(table->ids_ascending);
+	compare(table, got);
+	// a smaller id turns the id search off
+	dbrow_t row;
+	gen_row(&gen, ROWS, &row);
+	CHECK(table_append(table, row));
+	CHECK(!table->ids_ascending);
+	compare(table, got);
+	free(got);
+	table_free(table);
+	return CHECK_RESULT;
+}
@@ -0,0 +1,93 @@
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <wchar.h>
+
+#include "check.h"
+#include "table.h"
+#include "table_mvcc.h"
+#include "thread.h"
+
+/*
+ * a snapshot taken before the writer starts keeps its rows while another thread removes
+ * from the front and middle of the table (copy-on-write of every chunk behind)
+ */
+
+#define ROWS (8 * TABLE_CHUNK_ROWS + 100)
+#define REMOVES 500
+
+typedef struct {
+	table_mvcc_t *mvcc;
+	table_snap_t const *snap;
+	dbrow_t const *copy;
+	atomic_int *done;
+	size_t *changed; // reader: rows that differed from the copy
+} job_t;
+
+static int same_row(dbrow_t const *a, dbrow_t const *b) {
+	return a->id == b->id && a->c1 == b->c1 && a->c2 == b->c2 && wcscmp(a->c3, b->c3) == 0
+		&& a->c4 == b->c4 && wcscmp(a->c5, b->c5) == 0;
+}
+
+static void run(void *arg) {
+	job_t *job = arg;
+	if (job->changed == NULL) {
+		// writer
+		for (size_t i = 0; i < REMOVES; i++) {
+			size_t len = table_snap_len(job->snap) - i;
+			if (!table_mvcc_remove_at(job->mvcc, i % 2 == 0 ? 0 : len / 2)) break;
+		}
+		atomic_store(job->done, 1);
+		return;
+	}
+	// reader, at least one pass after the writer is done
+	int last;
+	do {
+		last = atomic_load(job->done);
+		for (size_t i = 0; i < table_snap_len(job->snap); i++) {
+			if (!same_row(table_snap_row(job->snap, i), &job->copy[i])) (*job->changed)++;
+		}
+	} while (!last);
+}
+
+int main(void) {
+	gen_t gen;
+	table_t *table = check_table(&gen, 5, ROWS, 1, 1);
+	dbrow_t *copy = malloc(ROWS * sizeof(dbrow_t));
+	CHECK(copy != NULL);
+	if (table == NULL || copy == NULL) return CHECK_RESULT;
+	table_mvcc_t *mvcc = table_mvcc_new(table);
+	CHECK(mvcc != NULL);
+	if (mvcc == NULL) return CHECK_RESULT;
+	table_snap_t const *snap = table_snap_acquire(mvcc);
+	CHECK(table_snap_len(snap) == ROWS);
+	CHECK(table_snap_rows(snap, 0, copy, ROWS) == ROWS);
+
+	atomic_int done = 0;
+	size_t changed = 0;
+	job_t jobs[2] = {
+		{mvcc, snap, copy, &done, NULL},
+		{mvcc, snap, copy, &done, &changed},
+	};
+	thread_run(run, jobs, sizeof(job_t), 2);
+	CHECK(atomic_load(&done) == 1);
+	CHECK(changed == 0);
+	CHECK(table_snap_len(snap) == ROWS);
+
+	// a new snapshot sees the removals, in the order the writer made them
+	table_snap_t const *now = table_snap_acquire(mvcc);
+	CHECK(table_snap_len(now) == ROWS - REMOVES);
+	for (size_t i = 0; i < REMOVES; i++) {
+		size_t len = ROWS - i;
+		size_t pos = i % 2 == 0 ? 0 : len / 2;
+		for (size_t j = pos; j + 1 < len; j++) copy[j] = copy[j + 1];
+	}
+	size_t differ = 0;
+	for (size_t i = 0; i < table_snap_len(now); i++) differ += !same_row(table_snap_row(now, i), &copy[i]);
+	CHECK(differ == 0);
+	table_snap_release(mvcc, now);
+	table_snap_release(mvcc, snap);
+	table_mvcc_free(mvcc);
+	free(copy);
+	table_free(table);
+	return CHECK_RESULT;
+}
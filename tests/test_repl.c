@@ -0,0 +1,200 @@
+#include "check.h"
+
+#ifdef _WIN32
+
+int main(void) {
+	return CHECK_SKIP;
+}
+
+#else
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <wchar.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "table.h"
+#include "table_mvcc.h"
+#include "repl.h"
+#include "proto.h"
+#include "collate.h"
+
+/*
+ * the test plays the primary: it accepts the replica's connections itself and hands them to
+ * repl_log_follow like the server does
+ * - first connection: a snapshot
+ * - cut, changes, second connection: resumes from the log without a snapshot
+ * - cut, third connection gets a change that skips a seq: the replica drops it
+ * - fourth connection: starts over with a snapshot
+ */
+
+#define ROWS 3000
+#define WAIT_MS 10000
+
+typedef struct {
+	table_mvcc_t *mvcc;
+	repl_log_t *log;
+	gen_t gen;
+	size_t next_id;
+} primary_t;
+
+static void append(primary_t *p, size_t n) {
+	dbrow_t *rows = malloc(n * sizeof(dbrow_t));
+	if (rows == NULL) return;
+	for (size_t i = 0; i < n; i++) {
+		gen_row(&p->gen, p->next_id++, &rows[i]);
+		collate_row(&rows[i]);
+	}
+	CHECK(table_mvcc_append(p->mvcc, rows, n));
+	repl_log_append(p->log, rows, n);
+	free(rows);
+}
+
+static void remove_at(primary_t *p, size_t pos) {
+	table_snap_t const *snap = table_snap_acquire(p->mvcc);
+	uint64_t id = table_snap_row(snap, pos)->id;
+	table_snap_release(p->mvcc, snap);
+	CHECK(table_mvcc_remove_at(p->mvcc, pos));
+	repl_log_remove(p->log, id);
+}
+
+static int same_tables(table_mvcc_t *a, table_mvcc_t *b) {
+	table_snap_t const *x = table_snap_acquire(a), *y = table_snap_acquire(b);
+	int same = table_snap_len(x) == table_snap_len(y);
+	for (size_t i = 0; same && i < table_snap_len(x); i++) {
+		dbrow_t const *r = table_snap_row(x, i), *s = table_snap_row(y, i);
+		same = r->id == s->id && r->c1 == s->c1 && wcscmp(r->c5, s->c5) == 0;
+	}
+	table_snap_release(a, x);
+	table_snap_release(b, y);
+	return same;
+}
+
+static void wait_same(table_mvcc_t *primary, table_mvcc_t *replica) {
+	struct timespec step = {.tv_nsec = 1000000L};
+	int same = 0;
+	for (int waited = 0; !same && waited < WAIT_MS; waited++) {
+		same = same_tables(primary, replica);
+		if (!same) nanosleep(&step, NULL);
+	}
+	CHECK(same);
+}
+
+// accepts the next connection and reads its follow request, -1 on failure
+static int accept_follow(int lfd, proto_follow_t *out_req) {
+	struct pollfd pfd = {.fd = lfd, .events = POLLIN};
+	if (poll(&pfd, 1, WAIT_MS) != 1) return -1;
+	int fd = accept(lfd, NULL, NULL);
+	if (fd < 0) return -1;
+	proto_header_t hdr;
+	if (recv(fd, &hdr, sizeof(hdr), MSG_WAITALL) != sizeof(hdr) || hdr.op != OP_FOLLOW
+		|| hdr.len != sizeof(*out_req) || recv(fd, out_req, sizeof(*out_req), MSG_WAITALL) != sizeof(*out_req)) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+// hands fd to the log and keeps a duplicate to cut the connection with
+static int follow(primary_t *p, int fd, proto_follow_t req) {
+	int cut = dup(fd);
+	CHECK(cut >= 0);
+	CHECK(repl_log_follow(p->log, p->mvcc, fd, req));
+	return cut;
+}
+
+static void cut(int fd) {
+	shutdown(fd, SHUT_RDWR);
+	close(fd);
+}
+
+static size_t count_lines(FILE *f, wchar_t const *prefix) {
+	wchar_t line[256];
+	size_t n = 0;
+	rewind(f);
+	while (fgetws(line, sizeof(line) / sizeof(line[0]), f) != NULL) {
+		if (wcsncmp(line, prefix, wcslen(prefix)) == 0) n++;
+	}
+	return n;
+}
+
+int main(void) {
+	char dir[] = "/tmp/stankindb-repl-XXXXXX";
+	CHECK(mkdtemp(dir) != NULL);
+	struct sockaddr_un addr = {.sun_family = AF_UNIX};
+	strcpy(addr.sun_path, dir);
+	strcat(addr.sun_path, "/sock");
+	int lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+	CHECK(lfd >= 0 && bind(lfd, (struct sockaddr *) &addr, sizeof(addr)) == 0 && listen(lfd, 8) == 0);
+
+	// rows from before the log started reach the replica through the snapshot
+	primary_t p = {.log = repl_log_new(), .next_id = ROWS + 1};
+	table_t *table = check_table(&p.gen, 11, ROWS, 1, 1);
+	if (table != NULL) {
+		p.mvcc = table_mvcc_new(table);
+		table_free(table);
+	}
+	table_mvcc_t *mirror = table_mvcc_new(NULL);
+	FILE *ferr = tmpfile();
+	CHECK(p.mvcc != NULL && p.log != NULL && mirror != NULL && ferr != NULL);
+	if (p.mvcc == NULL || p.log == NULL || mirror == NULL || ferr == NULL) return CHECK_RESULT;
+	repl_replica_t *replica = repl_replica_start(addr.sun_path, mirror, ferr);
+	CHECK(replica != NULL);
+
+	// a new replica has nothing to resume from
+	proto_follow_t req;
+	int fd = accept_follow(lfd, &req);
+	CHECK(fd >= 0 && req.epoch == 0 && req.seq == 0);
+	int conn = follow(&p, fd, req);
+	wait_same(p.mvcc, mirror);
+	append(&p, 10);
+	remove_at(&p, 0);
+	remove_at(&p, ROWS / 2);
+	wait_same(p.mvcc, mirror);
+
+	// changes made while it is away come from the log
+	cut(conn);
+	append(&p, 5);
+	remove_at(&p, 7);
+	fd = accept_follow(lfd, &req);
+	CHECK(fd >= 0 && req.epoch != 0 && req.seq == 3);
+	conn = follow(&p, fd, req);
+	wait_same(p.mvcc, mirror);
+
+	// a change that skips a seq is a gap
+	cut(conn);
+	fd = accept_follow(lfd, &req);
+	CHECK(fd >= 0 && req.seq == 5);
+	if (fd >= 0) {
+		struct {
+			proto_header_t hdr;
+			proto_change_t change;
+		} gap = {{PS_OK, sizeof(proto_change_t)}, {.op = CH_APPEND, .epoch = req.epoch, .seq = req.seq + 2}};
+		CHECK(send(fd, &gap, sizeof(gap), 0) == sizeof(gap));
+		close(fd);
+	}
+	append(&p, 3);
+	fd = accept_follow(lfd, &req);
+	CHECK(fd >= 0 && req.epoch == 0 && req.seq == 0);
+	conn = follow(&p, fd, req);
+	wait_same(p.mvcc, mirror);
+
+	// the first and the last connection sent snapshots, the second resumed
+	repl_replica_stop(replica);
+	CHECK(count_lines(ferr, L"Synced") == 2);
+	cut(conn);
+	repl_log_free(p.log);
+	table_mvcc_free(mirror);
+	table_mvcc_free(p.mvcc);
+	fclose(ferr);
+	close(lfd);
+	unlink(addr.sun_path);
+	rmdir(dir);
+	return CHECK_RESULT;
+}
+
+#endif